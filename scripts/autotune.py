@@ -0,0 +1,487 @@
+import json
+import math
+import os
+import platform
+import shutil
+import subprocess
+import sys
+import tempfile
+import time
+from concurrent.futures import ThreadPoolExecutor
+from decimal import Decimal, getcontext
+
+import numpy as np
+
+# Cost model and configuration choice for the solvers of Step 2.
+#
+# "calibrate" times the solvers on this machine and fits
+#   mpf (isingZToTxt, P bits, N = Lx*Ly spins, m = P/64 limbs):
+#     t = a + N (b0 + b m^beta) + N^1.5 (c0 + c m^gamma)
+#   (sample setup and dissection; the constant terms are the overhead
+#   of an operation at few limbs)
+#   batch (isingZBatch, n seeds in one process):
+#     t = a + n (b N + c N^1.5)
+#   dist (isingZDist on r MPI ranks): t_mpf(N, P) / (r e_r)
+# and how many bits of the sectors the double precision batch loses,
+#   loss = a + b log2 N + c / T_frac + d sqrt(N) / T_frac
+# (upper envelope of the measurements).
+# The model is stored as JSON (by default in ~/.cache/fkt).
+#
+# "run" predicts the wall time of every configuration for a point of
+# Step 1 and runs the fastest one that meets the requested accuracy:
+# bits of every sector relative to the largest one, i.e. of the sector
+# probabilities Z_k / sum Z.  isingZToTxt meets it at P bits with the
+# rounding guard and the sector cancellation bound of Sample::get_prec,
+# read from the interaction files of the point (the bound grows as 1/T),
+# and runs with --target-bits so that small nodes need fewer; the batch
+# if 53 - loss is enough and T_frac is within the calibrated range.
+# Samples run as separate processes on the cores, or, with fewer samples
+# than cores, each on several MPI ranks.  tuning.txt next to every Z.txt
+# records the configuration chosen.
+#
+# "check" runs isingZToTxt at the precision "run" would choose and at a
+# much higher one, and fails if a sample misses the requested bits.
+
+SCRIPT_DIR = os.path.dirname(os.path.abspath(__file__))
+DEFAULT_BIN_DIR = os.path.join(SCRIPT_DIR, "..", "build")
+DEFAULT_MODEL = os.path.join(os.environ.get("XDG_CACHE_HOME", os.path.expanduser("~/.cache")),
+                             "fkt", "autotune.json")
+
+MODEL_VERSION = 1                      # of the fields below; older files are rejected
+CAL_PROB = 0.1
+CAL_MPF = [(L, P) for L in (8, 16, 24, 32) for P in (128, 512, 2048)]
+CAL_MPF_QUICK = [(L, P) for L in (8, 16) for P in (128, 512)]
+CAL_BATCH = (8, 16, 32)
+CAL_T_FRAC = (1.0, 0.5)
+EXPONENTS = (1.0, 1.2, 1.4, 1.6, 1.8, 2.0)
+
+
+def host_info():
+    cpu = platform.processor()
+    try:
+        with open("/proc/cpuinfo") as f:
+            for line in f:
+                if line.startswith("model name"):
+                    cpu = line.split(":", 1)[1].strip()
+                    break
+    except OSError:
+        pass
+    return {"machine": platform.machine(), "cpu": cpu, "cores": os.cpu_count()}
+
+
+def binaries(bin_dir):
+    return {
+        "generator": os.path.join(bin_dir, "generator_random_bond", "isingGeneratorRandomBond"),
+        "mpf": os.path.join(bin_dir, "Z_to_txt", "isingZToTxt"),
+        "batch": os.path.join(bin_dir, "Z_batch", "isingZBatch"),
+        "dist": os.path.join(bin_dir, "Z_dist", "isingZDist"),
+    }
+
+
+def available(bins, name):
+    if not os.path.isfile(bins[name]):
+        return False
+    return name != "dist" or shutil.which("mpirun") is not None
+
+
+def mpirun(ranks):
+    # Open MPI counts cores, not hardware threads, as slots
+    cmd = ["mpirun", "-np", str(ranks)]
+    version = subprocess.run(["mpirun", "--version"], stdout=subprocess.PIPE, text=True).stdout
+    if "Open MPI" in version:
+        cmd.append("--oversubscribe")
+        if os.geteuid() == 0:
+            cmd.append("--allow-run-as-root")
+    return cmd
+
+
+def timed(cmd):
+    start = time.perf_counter()
+    result = subprocess.run(cmd, stdout=subprocess.DEVNULL, stderr=subprocess.PIPE, text=True)
+    elapsed = time.perf_counter() - start
+    if result.returncode != 0:
+        raise RuntimeError(f"{' '.join(cmd)} failed: {result.stderr.strip()}")
+    return elapsed
+
+
+def batch_lanes(bins):
+    # the usage line says how many samples run at a time
+    out = subprocess.run([bins["batch"]], stdout=subprocess.PIPE, text=True).stdout
+    words = out.split()
+    return int(words[words.index("samples") - 1])
+
+
+def guard_bits(Lx, Ly):
+    # rounding error growth over all levels, as in Sample::get_prec
+    levels = math.ceil(math.log2(Lx * Ly))
+    per_level = math.ceil(math.log2(4.0 * (Lx + Ly)))
+    return 32 + (levels + 1) * per_level
+
+
+def interaction_path(directory, prob, stddev, Lx, Ly, seed):
+    return os.path.join(directory, "interactionsGaussian", f"{prob:.6f}", str(Lx), str(Ly), f"{stddev:.6f}",
+                        str(seed), "interaction_lattice.txt")
+
+
+def temperature(prob, T_frac, std_dev):
+    # as isingZToTxt: T_frac in units of the Nishimori temperature
+    if std_dev is None and prob != 0:
+        return T_frac * 2 / math.log((1 - prob) / prob)
+    return T_frac
+
+
+def cancel_bits(path, T):
+    # bits the sector combination can cancel, as Sample::set_target_bits:
+    # a seam flip changes every energy by at most 2 sum |J| along the seam,
+    # |log2 w| = 2|J|/T log2(e) per bond, and |y_k| <= 4 Zmax
+    with open(path) as f:
+        words = f.read().split()
+    Lx, Ly = int(words[0]), int(words[1])
+    columns, rows = [0.0] * Lx, [0.0] * Ly
+    for i in range(2, len(words) - 3, 4):
+        x, y, d, J = int(words[i]), int(words[i + 1]), words[i + 2], float(words[i + 3])
+        b = 2 * abs(J) / T * math.log2(math.e)
+        if d in ("E", "1", "W", "3"):
+            columns[(x - (d in ("W", "3"))) % Lx] += b
+        else:
+            rows[(y - (d in ("N", "0"))) % Ly] += b
+    return math.ceil(min(columns) + min(rows)) + 2
+
+
+def mpf_precision(Lx, Ly, bits, cancel):
+    return (bits + cancel + guard_bits(Lx, Ly) + 63) // 64 * 64
+
+
+def point_cancel_bits(args, seeds):
+    # largest bound over the seeds of a point
+    T = temperature(args.probability, args.temperature, args.std_dev)
+    stddev = args.std_dev if args.std_dev is not None else 0.0
+    cancel = 0
+    for seed in seeds:
+        path = interaction_path(args.directory, args.probability, stddev, args.Lx, args.Ly, seed)
+        if not os.path.isfile(path):
+            sys.stderr.write(f"Error: '{path}' not found, run the generator (Step 1) first.\n")
+            sys.exit(1)
+        cancel = max(cancel, cancel_bits(path, T))
+    return cancel
+
+
+def result_path(directory, prob, stddev, Lx, Ly, T_frac, prec, seed):
+    return os.path.join(directory, "resultsGaussian", f"{prob:.6f}", f"{stddev:.6f}", str(Lx), str(Ly),
+                        f"{T_frac:.6f}", str(prec), str(seed))
+
+
+def read_sectors(path):
+    with open(os.path.join(path, "Z.txt")) as f:
+        return [Decimal(v) for v in f.read().split()]
+
+
+def agreement_bits(Z, reference, exact=53.0):
+    # bits of Z relative to the largest sector of the reference
+    getcontext().prec = max(60, max(len(str(r)) for r in reference))
+    largest = max(abs(r) for r in reference)
+    err = max(abs(z - r) for z, r in zip(Z, reference))
+    if err == 0:
+        return exact
+    return float(-(err / largest).ln() / Decimal(2).ln())
+
+
+def fit_least_squares(X, t, weights):
+    # least squares in relative error, dropping terms that come out negative
+    cols = list(range(X.shape[1]))
+    while True:
+        A = X[:, cols] * weights[:, None]
+        coef, *_ = np.linalg.lstsq(A, t * weights, rcond=None)
+        if (coef >= 0).all() or len(cols) == 1:
+            full = np.zeros(X.shape[1])
+            full[cols] = np.maximum(coef, 0)
+            return full
+        cols = [c for c, v in zip(cols, coef) if v >= 0]
+
+
+def fit_mpf(points):
+    N = np.array([L * L for L, _, _ in points], dtype=float)
+    m = np.array([P / 64 for _, P, _ in points], dtype=float)
+    t = np.array([s for _, _, s in points])
+    best = None
+    for beta in EXPONENTS:
+        for gamma in EXPONENTS:
+            X = np.column_stack([np.ones_like(N), N, N * m**beta, N**1.5, N**1.5 * m**gamma])
+            coef = fit_least_squares(X, t, 1 / t)
+            err = float(np.sum(((X @ coef) / t - 1) ** 2))
+            if best is None or err < best[0]:
+                best = (err, {"a": coef[0], "b0": coef[1], "b": coef[2], "c0": coef[3], "c": coef[4],
+                              "beta": beta, "gamma": gamma})
+    return best[1]
+
+
+def mpf_seconds(model, Lx, Ly, P):
+    f, N, m = model["mpf"], Lx * Ly, P / 64
+    return (f["a"] + N * (f["b0"] + f["b"] * m ** f["beta"])
+            + N**1.5 * (f["c0"] + f["c"] * m ** f["gamma"]))
+
+
+def batch_seconds(model, Lx, Ly, n):
+    f, N = model["batch"], Lx * Ly
+    return f["a"] + n * (f["b"] * N + f["c"] * N**1.5)
+
+
+def batch_bits(model, Lx, Ly, T_frac):
+    # not extrapolated below the calibrated temperatures: double precision
+    # breaks down there faster than the fit
+    if T_frac < min(CAL_T_FRAC):
+        return 0
+    loss = model["batch"]["loss"]
+    N = Lx * Ly
+    return 53 - (loss["a"] + loss["b"] * math.log2(N) + (loss["c"] + loss["d"] * math.sqrt(N)) / T_frac)
+
+
+def calibrate(args):
+    bins = binaries(args.bin_dir)
+    for name in ("generator", "mpf"):
+        if not available(bins, name):
+            sys.stderr.write(f"Error: '{bins[name]}' not found, run make first.\n")
+            sys.exit(1)
+    work = tempfile.mkdtemp(prefix="fkt_autotune_", dir=args.work_dir)
+    mpf_grid = CAL_MPF_QUICK if args.quick else CAL_MPF
+    sizes = sorted(set([L for L, _ in mpf_grid] + ([] if args.quick else list(CAL_BATCH))))
+    seeds = 2
+    model = {"version": MODEL_VERSION, "host": host_info(), "created": time.strftime("%Y-%m-%d %H:%M:%S")}
+    try:
+        lanes = batch_lanes(bins) if available(bins, "batch") else 0
+        for L in sizes:
+            for seed in range(1, max(seeds, 4 * lanes) + 1):
+                timed([bins["generator"], str(L), str(L), str(seed), str(CAL_PROB), work])
+
+        points = []
+        for L, P in mpf_grid:
+            t = min(timed([bins["mpf"], str(P), str(L), str(L), str(seed), str(CAL_PROB), "1.0", work])
+                    for seed in range(1, seeds + 1))
+            points.append((L, P, t))
+            print(f"mpf    L={L:3d} P={P:5d}: {t:8.3f} s")
+        model["mpf"] = fit_mpf(points)
+        model["mpf"]["points"] = points
+
+        model["batch"] = None
+        if lanes:
+            rows, t = [], []
+            for L in (CAL_BATCH[:2] if args.quick else CAL_BATCH):
+                for n in (lanes, 4 * lanes):
+                    s = timed([bins["batch"], str(L), str(L), "1", str(n), str(CAL_PROB), "1.0", work])
+                    rows.append([1, n * L * L, n * (L * L) ** 1.5])
+                    t.append(s)
+                    print(f"batch  L={L:3d} n={n:5d}: {s:8.3f} s")
+            t = np.array(t)
+            coef = fit_least_squares(np.array(rows, dtype=float), t, 1 / t)
+            model["batch"] = {"a": coef[0], "b": coef[1], "c": coef[2], "lanes": lanes}
+
+            # accuracy of the batch against isingZToTxt at 64 bits more
+            rows, loss = [], []
+            for L in (CAL_BATCH[:2] if args.quick else CAL_BATCH):
+                for T_frac in CAL_T_FRAC:
+                    # seeds with no correct bits left are reported and not written
+                    subprocess.run([bins["batch"], str(L), str(L), "1", str(lanes), str(CAL_PROB), str(T_frac), work],
+                                   stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+                    for seed in range(1, lanes + 1):
+                        path = lambda P: result_path(work, CAL_PROB, 0.0, L, L, T_frac, P, seed)
+                        rows.append([1, math.log2(L * L), 1 / T_frac, L / T_frac])
+                        if not os.path.exists(os.path.join(path(53), "Z.txt")):
+                            loss.append(53.0)
+                            continue
+                        cancel = cancel_bits(interaction_path(work, CAL_PROB, 0.0, L, L, seed),
+                                             temperature(CAL_PROB, T_frac, None))
+                        P = mpf_precision(L, L, 64 + 53, cancel)
+                        timed([bins["mpf"], str(P), str(L), str(L), str(seed), str(CAL_PROB), str(T_frac), work])
+                        bits = agreement_bits(read_sectors(path(53)), read_sectors(path(P)))
+                        loss.append(53 - bits)
+                    print(f"batch  L={L:3d} T={T_frac:.2f}: {53 - max(loss[-lanes:]):5.1f} bits")
+            X, loss = np.array(rows), np.array(loss)
+            coef, *_ = np.linalg.lstsq(X, loss, rcond=None)
+            coef[0] += max(0.0, float(np.max(loss - X @ coef)))
+            model["batch"]["loss"] = {"a": coef[0], "b": coef[1], "c": coef[2], "d": coef[3]}
+
+        # efficiency of isingZDist on r ranks against one process
+        model["dist"] = None
+        if available(bins, "dist") and os.cpu_count() > 1:
+            L, P = (16, 512) if args.quick else (32, 512)
+            serial = timed([bins["mpf"], str(P), str(L), str(L), "1", str(CAL_PROB), "1.0", work])
+            model["dist"] = {}
+            r = 2
+            while r <= os.cpu_count():
+                t = timed(mpirun(r) + [bins["dist"], str(P), str(L), str(L), "1", str(CAL_PROB), "1.0", work])
+                model["dist"][str(r)] = serial / (r * t)
+                print(f"dist   r={r:3d}: efficiency {model['dist'][str(r)]:.2f}")
+                r *= 2
+    finally:
+        shutil.rmtree(work, ignore_errors=True)
+
+    os.makedirs(os.path.dirname(os.path.abspath(args.model)), exist_ok=True)
+    with open(args.model, "w") as f:
+        json.dump(model, f, indent=2)
+        f.write("\n")
+    f = model["mpf"]
+    print(f"mpf: t = {f['a']:.3g} + N ({f['b0']:.3g} + {f['b']:.3g} m^{f['beta']}) "
+          f"+ N^1.5 ({f['c0']:.3g} + {f['c']:.3g} m^{f['gamma']}) s")
+    print(f"Stored cost model in {args.model}")
+
+
+def candidates(model, Lx, Ly, T_frac, samples, bits, cancel, cores, bins):
+    # (predicted wall seconds, configuration) of everything that meets bits
+    result = []
+    P = mpf_precision(Lx, Ly, bits, cancel)
+    t = mpf_seconds(model, Lx, Ly, P)
+    workers = min(cores, samples)
+    result.append((math.ceil(samples / workers) * t,
+                   {"backend": "isingZToTxt", "precision": P, "workers": workers, "ranks": 1,
+                    "seconds_per_sample": t}))
+    if model.get("dist") and available(bins, "dist") and samples < cores:
+        for r, efficiency in model["dist"].items():
+            r = int(r)
+            if r * samples > cores:
+                continue
+            td = t / (r * efficiency)
+            result.append((td, {"backend": "isingZDist", "precision": P, "workers": samples, "ranks": r,
+                                "seconds_per_sample": td}))
+    if model.get("batch") and available(bins, "batch") and batch_bits(model, Lx, Ly, T_frac) >= bits:
+        lanes = model["batch"]["lanes"]
+        batches = math.ceil(samples / lanes)
+        workers = min(cores, batches)
+        width = math.ceil(batches / workers) * lanes
+        tb = batch_seconds(model, Lx, Ly, width)
+        result.append((tb, {"backend": "isingZBatch", "precision": 53, "workers": workers, "ranks": 1,
+                            "batch_width": width, "seconds_per_sample": tb / min(width, samples)}))
+    return sorted(result, key=lambda c: c[0])
+
+
+def run(args):
+    bins = binaries(args.bin_dir)
+    if not os.path.isfile(args.model):
+        sys.stderr.write(f"Error: no cost model '{args.model}', run calibrate first.\n")
+        sys.exit(1)
+    with open(args.model) as f:
+        model = json.load(f)
+    if model.get("version") != MODEL_VERSION:
+        sys.stderr.write(f"Error: '{args.model}' is from another version of this script, run calibrate again.\n")
+        sys.exit(1)
+    if model.get("host") != host_info():
+        sys.stderr.write(f"Warning: the cost model was calibrated on {model.get('host')}, "
+                         f"this host is {host_info()}.\n")
+    cores = args.cores or os.cpu_count()
+    stddev = args.std_dev if args.std_dev is not None else 0.0
+    seeds = list(range(args.firstSeed, args.lastSeed + 1))
+    cancel = point_cancel_bits(args, seeds)
+    plan = candidates(model, args.Lx, args.Ly, args.temperature, len(seeds), args.bits, cancel, cores, bins)
+    for seconds, config in plan:
+        print(f"  {seconds:10.3f} s  {config}")
+    predicted, config = plan[0]
+    print(f"chosen: {config['backend']} at {config['precision']} bits (sector cancellation up to {cancel} "
+          f"bits), {config['workers']} workers x {config['ranks']} ranks, predicted {predicted:.3f} s")
+    if args.dry_run:
+        return
+
+    common = [str(args.probability), str(args.temperature), args.directory]
+    if args.std_dev is not None:
+        common.append(str(args.std_dev))
+    if config["backend"] == "isingZBatch":
+        width = config["batch_width"]
+        jobs = [[bins["batch"], str(args.Lx), str(args.Ly), str(s), str(min(s + width - 1, seeds[-1]))] + common
+                for s in range(seeds[0], seeds[-1] + 1, width)]
+    else:
+        if config["backend"] == "isingZDist":
+            prefix = mpirun(config["ranks"]) + [bins["dist"]]
+        else:
+            prefix = [bins["mpf"], "--target-bits", str(args.bits)]
+        jobs = [prefix + [str(config["precision"]), str(args.Lx), str(args.Ly), str(s)] + common for s in seeds]
+    start = time.perf_counter()
+    with ThreadPoolExecutor(max_workers=config["workers"]) as pool:
+        list(pool.map(timed, jobs))
+    wall = time.perf_counter() - start
+
+    for seed in seeds:
+        path = result_path(args.directory, args.probability, stddev, args.Lx, args.Ly, args.temperature,
+                           config["precision"], seed)
+        with open(os.path.join(path, "tuning.txt"), "w") as f:
+            for key in ("backend", "precision", "workers", "ranks", "batch_width"):
+                if key in config:
+                    f.write(f"{key} {config[key]}\n")
+            f.write(f"target_bits {args.bits}\n")
+            if config["backend"] != "isingZBatch":
+                f.write(f"cancellation_bits {cancel}\n")
+            f.write(f"predicted_seconds {config['seconds_per_sample']:.6g}\n")
+            f.write(f"model {os.path.abspath(args.model)} {model.get('created')}\n")
+    print(f"{len(seeds)} samples in {wall:.3f} s (predicted {predicted:.3f} s)")
+
+
+def check(args):
+    # the precision of "run" against a reference with 4 times the bits
+    # beyond the cancellation, sample by sample
+    bins = binaries(args.bin_dir)
+    if not available(bins, "mpf"):
+        sys.stderr.write(f"Error: '{bins['mpf']}' not found, run make first.\n")
+        sys.exit(1)
+    stddev = args.std_dev if args.std_dev is not None else 0.0
+    T = temperature(args.probability, args.temperature, args.std_dev)
+    common = [str(args.probability), str(args.temperature), args.directory]
+    if args.std_dev is not None:
+        common.append(str(args.std_dev))
+    failed = 0
+    for seed in range(args.firstSeed, args.lastSeed + 1):
+        cancel = cancel_bits(interaction_path(args.directory, args.probability, stddev, args.Lx, args.Ly, seed), T)
+        P = mpf_precision(args.Lx, args.Ly, args.bits, cancel)
+        reference = mpf_precision(args.Lx, args.Ly, 4 * (P - cancel), cancel)
+        timed([bins["mpf"], "--target-bits", str(args.bits), str(P), str(args.Lx), str(args.Ly), str(seed)] + common)
+        timed([bins["mpf"], str(reference), str(args.Lx), str(args.Ly), str(seed)] + common)
+        path = lambda P: result_path(args.directory, args.probability, stddev, args.Lx, args.Ly,
+                                     args.temperature, P, seed)
+        bits = agreement_bits(read_sectors(path(P)), read_sectors(path(reference)), exact=math.inf)
+        status = "ok" if bits >= args.bits else "FAILED"
+        failed += bits < args.bits
+        print(f"seed {seed}: {P} bits (cancellation {cancel}) against {reference}: {bits:.1f} bits  {status}")
+    if failed:
+        sys.stderr.write(f"{failed} samples have fewer than {args.bits} bits\n")
+        sys.exit(1)
+
+
+if __name__ == "__main__":
+    import argparse
+
+    parser = argparse.ArgumentParser(description="Cost model and configuration choice for the solvers.")
+    parser.add_argument("--bin-dir", default=DEFAULT_BIN_DIR, help="Build directory with the binaries")
+    parser.add_argument("--model", default=DEFAULT_MODEL, help="Cost model file (JSON)")
+    sub = parser.add_subparsers(dest="command", required=True)
+
+    cal = sub.add_parser("calibrate", help="Time the solvers on this machine and store the cost model")
+    cal.add_argument("--quick", action="store_true", help="Fewer and smaller calibration runs")
+    cal.add_argument("--work-dir", default=None, help="Directory for the samples (default temporary)")
+
+    job = sub.add_parser("run", help="Compute a point of Step 1 with the fastest configuration")
+    job.add_argument("--bits", type=int, default=32,
+                     help="Bits of every sector relative to the largest (default 32)")
+    job.add_argument("--cores", type=int, default=None, help="Cores to use (default all)")
+    job.add_argument("--dry-run", action="store_true", help="Only print the predictions")
+    job.add_argument("Lx", type=int)
+    job.add_argument("Ly", type=int)
+    job.add_argument("firstSeed", type=int)
+    job.add_argument("lastSeed", type=int)
+    job.add_argument("probability", type=float)
+    job.add_argument("temperature", type=float)
+    job.add_argument("directory")
+    job.add_argument("std_dev", type=float, nargs="?", default=None)
+
+    chk = sub.add_parser("check", help="Compare the precision run chooses with a much higher one")
+    chk.add_argument("--bits", type=int, default=32,
+                     help="Bits of every sector relative to the largest (default 32)")
+    for name in ("Lx", "Ly", "firstSeed", "lastSeed"):
+        chk.add_argument(name, type=int)
+    chk.add_argument("probability", type=float)
+    chk.add_argument("temperature", type=float)
+    chk.add_argument("directory")
+    chk.add_argument("std_dev", type=float, nargs="?", default=None)
+    args = parser.parse_args()
+
+    if args.command == "calibrate":
+        calibrate(args)
+    elif args.command == "check":
+        check(args)
+    else:
+        run(args)
@@ -0,0 +1,233 @@
+import json
+import os
+import platform
+import shutil
+import subprocess
+import sys
+import tempfile
+import time
+from concurrent.futures import ThreadPoolExecutor
+
+# End-to-end benchmark of the workflow of the README: generator, solver
+# and combine_to_hdf5.py on a fixed grid of (L, p, T_frac, precision).
+# Samples are independent processes, so a thread count is the number of
+# samples run at once.  Strong scaling keeps the samples of a grid point
+# fixed, weak scaling the samples per thread.  The single-thread results
+# are compared against a baseline stored on this host (none is shipped:
+# timings of another machine say nothing about a regression here).
+
+SCRIPT_DIR = os.path.dirname(os.path.abspath(__file__))
+DEFAULT_BASELINE = os.path.join(os.environ.get("XDG_CACHE_HOME", os.path.expanduser("~/.cache")),
+                                "fkt", "benchmark_baseline.json")
+DEFAULT_BIN_DIR = os.path.join(SCRIPT_DIR, "..", "build")
+
+# (L, p, T_frac, precision, samples at one thread)
+GRID = [
+    (8, 0.10, 1.0, 256, 32),
+    (16, 0.10, 1.0, 512, 16),
+    (32, 0.10, 1.0, 1024, 8),
+    (32, 0.05, 0.5, 2048, 4),
+]
+QUICK_GRID = [(L, p, T, prec, max(1, n // 2)) for L, p, T, prec, n in GRID[:2]]
+
+
+def point_name(L, p, T_frac, prec):
+    return f"L={L} p={p:.2f} T={T_frac:.2f} prec={prec}"
+
+
+def percentile(values, q):
+    # nearest rank
+    ordered = sorted(values)
+    rank = max(1, int(-(-q * len(ordered) // 100)))
+    return ordered[rank - 1]
+
+
+def host_info():
+    cpu = platform.processor()
+    try:
+        with open("/proc/cpuinfo") as f:
+            for line in f:
+                if line.startswith("model name"):
+                    cpu = line.split(":", 1)[1].strip()
+                    break
+    except OSError:
+        pass
+    return {"machine": platform.machine(), "cpu": cpu, "cores": os.cpu_count()}
+
+
+def timed(cmd):
+    start = time.perf_counter()
+    result = subprocess.run(cmd, stdout=subprocess.DEVNULL, stderr=subprocess.PIPE, text=True)
+    elapsed = time.perf_counter() - start
+    if result.returncode != 0:
+        raise RuntimeError(f"{' '.join(cmd)} failed: {result.stderr.strip()}")
+    return elapsed
+
+
+def run_sample(bins, run_dir, point, seed):
+    L, p, T_frac, prec = point
+    gen = timed([bins["generator"], str(L), str(L), str(seed), str(p), run_dir])
+    solve = timed([bins["solver"], str(prec), str(L), str(L), str(seed), str(p), str(T_frac), run_dir])
+    z_path = os.path.join(run_dir, "resultsGaussian", f"{p:.6f}", f"{0:.6f}", str(L), str(L),
+                          f"{T_frac:.6f}", str(prec), str(seed), "Z.txt")
+    with open(z_path) as f:
+        if len(f.read().split()) != 4:
+            raise RuntimeError(f"{z_path} does not contain 4 values")
+    return gen, solve
+
+
+def run(bins, work_dir, point, samples, threads):
+    # samples seeds 1..samples on threads workers, then pack the results
+    run_dir = tempfile.mkdtemp(dir=work_dir)
+    start = time.perf_counter()
+    with ThreadPoolExecutor(max_workers=threads) as pool:
+        latencies = list(pool.map(lambda seed: run_sample(bins, run_dir, point, seed),
+                                  range(1, samples + 1)))
+    pack = timed([sys.executable, bins["pack"], run_dir, os.path.join(run_dir, "results.h5")])
+    wall = time.perf_counter() - start
+    shutil.rmtree(run_dir)
+
+    gen = [g for g, _ in latencies]
+    solve = [s for _, s in latencies]
+    return {
+        "threads": threads,
+        "samples": samples,
+        "wall": wall,
+        "throughput": samples / wall,
+        "throughput_per_core": samples / wall / threads,
+        "gen_p50": percentile(gen, 50),
+        "solve_p50": percentile(solve, 50),
+        "solve_p90": percentile(solve, 90),
+        "solve_p99": percentile(solve, 99),
+        "pack": pack,
+    }
+
+
+def benchmark_point(bins, work_dir, point, samples, thread_counts):
+    strong, weak = [], []
+    for threads in thread_counts:
+        strong.append(run(bins, work_dir, point, samples, threads))
+        if threads == 1:
+            weak.append(strong[-1])
+        else:
+            weak.append(run(bins, work_dir, point, samples * threads, threads))
+    for r in strong:
+        r["efficiency"] = r["throughput"] / (strong[0]["throughput"] * r["threads"])
+    for r in weak:
+        r["efficiency"] = weak[0]["wall"] / r["wall"]
+    return strong, weak
+
+
+def print_point(name, strong, weak):
+    print(name)
+    print("  scaling threads samples   wall[s] samples/s /core  p50[s]  p90[s]  p99[s] gen[s] pack[s] eff")
+    for label, results in (("strong", strong), ("weak", weak)):
+        for r in results:
+            print(f"  {label:7s} {r['threads']:7d} {r['samples']:7d} {r['wall']:9.3f} "
+                  f"{r['throughput']:9.3f} {r['throughput_per_core']:5.2f} "
+                  f"{r['solve_p50']:7.3f} {r['solve_p90']:7.3f} {r['solve_p99']:7.3f} "
+                  f"{r['gen_p50']:6.3f} {r['pack']:7.3f} {r['efficiency']:4.2f}")
+
+
+def compare(results, baseline, tolerance):
+    # regressions of the single-thread runs: fewer samples/s per core or a
+    # slower median solve than the baseline allows
+    regressions = []
+    for name, r in results.items():
+        base = baseline["points"].get(name)
+        if base is None:
+            print(f"{name}: not in baseline")
+            continue
+        ratio = r["throughput_per_core"] / base["throughput_per_core"]
+        slowdown = r["solve_p50"] / base["solve_p50"]
+        status = "ok"
+        if ratio < 1 - tolerance or slowdown > 1 + tolerance:
+            status = "REGRESSION"
+            regressions.append(name)
+        print(f"{name}: samples/s per core {ratio:.2f}x, median solve {slowdown:.2f}x of baseline  {status}")
+    return regressions
+
+
+if __name__ == "__main__":
+    import argparse
+
+    parser = argparse.ArgumentParser(description="End-to-end throughput and scaling benchmark.")
+    parser.add_argument("--quick", action="store_true", help="Two small grid points with fewer samples")
+    parser.add_argument("--threads", default=None,
+                        help="Comma separated thread counts (default 1,2,4,... up to the cores)")
+    parser.add_argument("--bin-dir", default=DEFAULT_BIN_DIR, help="Build directory with the binaries")
+    parser.add_argument("--work-dir", default=None, help="Directory for the samples (default temporary)")
+    parser.add_argument("--baseline", default=DEFAULT_BASELINE, help="Stored baseline (JSON)")
+    parser.add_argument("--tolerance", type=float, default=0.15,
+                        help="Allowed relative loss against the baseline")
+    parser.add_argument("--update-baseline", action="store_true",
+                        help="Store the single-thread results as the new baseline")
+    parser.add_argument("--output", default=None, help="Write all results to this JSON file")
+    args = parser.parse_args()
+
+    bins = {
+        "generator": os.path.join(args.bin_dir, "generator_random_bond", "isingGeneratorRandomBond"),
+        "solver": os.path.join(args.bin_dir, "Z_to_txt", "isingZToTxt"),
+        "pack": os.path.join(SCRIPT_DIR, "combine_to_hdf5.py"),
+    }
+    for path in bins.values():
+        if not os.path.isfile(path):
+            sys.stderr.write(f"Error: '{path}' not found, run make first.\n")
+            sys.exit(1)
+
+    if args.threads:
+        thread_counts = sorted(set([1] + [int(t) for t in args.threads.split(",")]))
+    else:
+        thread_counts = [1]
+        while thread_counts[-1] * 2 <= os.cpu_count():
+            thread_counts.append(thread_counts[-1] * 2)
+
+    work_dir = tempfile.mkdtemp(prefix="fkt_bench_", dir=args.work_dir)
+    grid = QUICK_GRID if args.quick else GRID
+    results, report = {}, {"host": host_info(), "points": {}}
+    try:
+        for L, p, T_frac, prec, samples in grid:
+            name = point_name(L, p, T_frac, prec)
+            strong, weak = benchmark_point(bins, work_dir, (L, p, T_frac, prec), samples, thread_counts)
+            print_point(name, strong, weak)
+            results[name] = strong[0]
+            report["points"][name] = {"strong": strong, "weak": weak}
+    finally:
+        shutil.rmtree(work_dir, ignore_errors=True)
+
+    if args.output:
+        with open(args.output, "w") as f:
+            json.dump(report, f, indent=2)
+
+    if args.update_baseline:
+        baseline = {"host": report["host"],
+                    "points": {name: {key: r[key] for key in ("throughput_per_core", "solve_p50", "solve_p90")}
+                               for name, r in results.items()}}
+        if os.path.isfile(args.baseline):
+            with open(args.baseline) as f:
+                old = json.load(f)
+            if old.get("host") == baseline["host"]:
+                # keep grid points a --quick run did not measure
+                old["points"].update(baseline["points"])
+                baseline = old
+        os.makedirs(os.path.dirname(os.path.abspath(args.baseline)), exist_ok=True)
+        with open(args.baseline, "w") as f:
+            json.dump(baseline, f, indent=2)
+            f.write("\n")
+        print(f"Stored baseline of {len(results)} grid points in {args.baseline}")
+        sys.exit(0)
+
+    if not os.path.isfile(args.baseline):
+        sys.stderr.write(f"Error: no baseline '{args.baseline}'; run with --update-baseline "
+                         "on this host first (with the code to compare against).\n")
+        sys.exit(1)
+    with open(args.baseline) as f:
+        baseline = json.load(f)
+    if baseline.get("host") != report["host"]:
+        sys.stderr.write(f"Error: baseline was measured on {baseline.get('host')}, "
+                         f"this host is {report['host']}; run with --update-baseline here.\n")
+        sys.exit(1)
+    regressions = compare(results, baseline, args.tolerance)
+    if regressions:
+        sys.stderr.write(f"{len(regressions)} grid points regressed by more than {args.tolerance:.0%}\n")
+        sys.exit(3)
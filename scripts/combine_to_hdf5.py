@@ -2,9 +2,48 @@ import os
 import h5py
 import sys
 
-def collect_txt_to_hdf5(root_dir, output_hdf5_path):
+def collect_sweep(h5file, sweep_path):
+    # Lines of isingZMpi: prob stddev x y T_frac prec seed ZPP ZPA ZAP ZAA
     count = 0
+    dt = h5py.string_dtype(encoding='utf-8')
+    with open(sweep_path, 'r') as f:
+        for line in f:
+            if line.startswith('#') or not line.strip():
+                continue
+            fields = line.split()
+            if len(fields) != 11:
+                print(f"Warning: {sweep_path} has a malformed line")
+                continue
+            prob, stddev, x, y, T_frac, prec, seed = fields[:7]
+            group_path = f"{T_frac}/{prob}/{stddev}/{x}/{y}/{prec}/{seed}"
+            group = h5file.require_group(group_path)
+            if "Z" in group:
+                del group["Z"]
+            group.create_dataset("Z", data=fields[7:], dtype=dt)
+            count += 1
+    return count
+
+def read_weight(weight_path, prob):
+    # weight.txt of generator --bias: logWeight and the probability the
+    # flips were drawn at, which must differ from the target probability
+    with open(weight_path, 'r') as f:
+        fields = dict(line.split() for line in f if line.strip())
+    try:
+        log_weight = float(fields["logWeight"])
+        drawn = float(fields["drawnProbability"])
+    except (KeyError, ValueError):
+        raise ValueError(f"{weight_path} lacks logWeight or drawnProbability")
+    if not 0 < drawn < 1 or f"{drawn:.6f}" == prob:
+        raise ValueError(f"{weight_path}: drawnProbability {drawn} is not a bias of probability {prob}")
+    return log_weight, drawn
+
+
+def collect_txt_to_hdf5(root_dir, output_hdf5_path, sweeps=()):
+    count = 0
+    drawn_at = {}  # (prob, stddev, x, y) -> drawnProbability, None if not biased
     with h5py.File(output_hdf5_path, 'w') as h5file:
+        for sweep_path in sweeps:
+            count += collect_sweep(h5file, sweep_path)
         for dirpath, _, filenames in os.walk(root_dir):
             for filename in filenames:
                 if filename == "Z.txt":
@@ -33,7 +72,26 @@ def collect_txt_to_hdf5(root_dir, output_hdf5_path):
                     # Store as strings for precision reason
                     dt = h5py.string_dtype(encoding='utf-8')
                     group = h5file.require_group(group_path)
+                    if dataset_name in group:
+                        del group[dataset_name]
                     group.create_dataset(dataset_name, data=values, dtype=dt)
+
+                    # Importance-sampled lattice (generator --bias): ln of its likelihood ratio
+                    weight_path = os.path.join(root_dir, "interactionsGaussian", prob, x, y, stddev,
+                                               seed, "weight.txt")
+                    drawn = None
+                    if os.path.isfile(weight_path):
+                        log_weight, drawn = read_weight(weight_path, prob)
+                        for name, value in (("logWeight", log_weight), ("drawnProbability", drawn)):
+                            if name in group:
+                                del group[name]
+                            group.create_dataset(name, data=value)
+                    # the weights of one estimate must all refer to the same bias
+                    point = (prob, stddev, x, y)
+                    if drawn_at.setdefault(point, drawn) != drawn:
+                        drawn_text = lambda q: "probability (not biased)" if q is None else str(q)
+                        raise ValueError(f"samples of probability {prob}, {x}x{y} were drawn at both "
+                                         f"{drawn_text(drawn_at[point])} and {drawn_text(drawn)}")
                     count += 1
     return count
 
@@ -43,13 +101,20 @@ if __name__ == "__main__":
     parser = argparse.ArgumentParser(description="Combine result txt files into HDF5.")
     parser.add_argument("result_dir", help="Root directory containing resultsGaussian")
     parser.add_argument("output_hdf5", help="Output HDF5 filename")
+    parser.add_argument("--sweep", action="append", default=[],
+                        help="Result file of isingZMpi to include (repeatable)")
     args = parser.parse_args()
 
     if not os.path.isdir(args.result_dir):
         sys.stderr.write(f"Error: result directory '{args.result_dir}' does not exist or is not a directory.\n")
         sys.exit(1)
 
-    combined_count = collect_txt_to_hdf5(args.result_dir, args.output_hdf5)
+    try:
+        combined_count = collect_txt_to_hdf5(args.result_dir, args.output_hdf5, args.sweep)
+    except ValueError as e:
+        sys.stderr.write(f"Error: {e}\n")
+        os.remove(args.output_hdf5)
+        sys.exit(1)
 
     if combined_count == 0:
         sys.stderr.write(
@@ -0,0 +1,513 @@
+// FINDbatch.cc
+//
+// Mirrors FINDmatrix.cc operation by operation; see there for the
+// orderings and for the diagrams of the cross operation.
+
+#include "FINDbatch.h"
+#include "../Z_to_txt/Partition.h"
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+scaled::scaled()
+{
+  for (int l = 0; l < LANES; l++)
+  {
+    m[l] = 1;
+    e[l] = 0;
+  }
+}
+
+void scaled::mul(const lanes &x)
+{
+  for (int l = 0; l < LANES; l++)
+  {
+    int ex;
+    m[l] = std::frexp(m[l]*x[l], &ex);
+    e[l] += ex;
+  }
+}
+
+void scaled::mul(const scaled &x)
+{
+  for (int l = 0; l < LANES; l++)
+  {
+    int ex;
+    m[l] = std::frexp(m[l]*x.m[l], &ex);
+    e[l] += ex + x.e[l];
+  }
+}
+
+void scaled::mul(const dataType &x, int lane)
+{
+  long ex;
+  double xm = mpf_get_d_2exp(&ex, x.get_mpf_t());
+  int ex2;
+  m[lane] = std::frexp(m[lane]*xm, &ex2);
+  e[lane] += ex + ex2;
+}
+
+dataType scaled::get(int lane) const
+{
+  dataType x = m[lane];
+  if (e[lane] >= 0)
+    mpf_mul_2exp(x.get_mpf_t(), x.get_mpf_t(), e[lane]);
+  else
+    mpf_div_2exp(x.get_mpf_t(), x.get_mpf_t(), -e[lane]);
+  return x;
+}
+
+static lanes broadcast(double x)
+{
+  lanes v;
+  for (int l = 0; l < LANES; l++)
+    v[l] = x;
+  return v;
+}
+
+FINDbatch::FINDbatch(Sample** _S)
+: offx(0), offy(0), S(_S)
+{
+  Lx = S[0]->get_Lx();
+  Ly = S[0]->get_Ly();
+  initialize();
+}
+
+FINDbatch::FINDbatch(FINDbatch& other)
+: Lx(other.Lx), Ly(other.Ly), offx(other.offx), offy(other.offy),
+  mtx_L(other.mtx_L), S(other.S), A(NULL), B(NULL), prefactor(other.prefactor),
+  failedLanes(other.failedLanes), lostBits(other.lostBits)
+{
+  copy_matrix(other.mat,&mat,mtx_L);
+}
+
+FINDbatch::FINDbatch(int _Lx, int _Ly, int _offx, int _offy, Sample** _S)
+: Lx(_Lx), Ly(_Ly), offx(_offx), offy(_offy), S(_S)
+{
+  initialize();
+}
+
+void FINDbatch::initialize()
+{
+  failedLanes = 0;
+  lostBits = broadcast(0);
+  if (Lx == 1 && Ly == 1)              // Base case: Kasteleyn city
+  {
+    A = NULL;
+    B = NULL;
+    mtx_L = 4;
+    allocate_matrix(&mat,mtx_L);
+    mat[0][0] = mat[0][1] = mat[0][2] = broadcast(1);
+    mat[1][0] = mat[1][1] = broadcast(1);
+    mat[2][0] = broadcast(1);
+    return;
+  }
+  if (Lx > Ly)                         // Recursion with a vertical separator
+  {
+    A = new FINDbatch(Lx/2,Ly,offx,offy,S);
+    B = new FINDbatch(Lx-Lx/2,Ly,offx+Lx/2,offy,S);
+    prefactor = combine_vertical();
+  }
+  else                                 // Recursion with a horizontal separator
+  {
+    A = new FINDbatch(Lx,Ly/2,offx,offy,S);
+    B = new FINDbatch(Lx,Ly-Ly/2,offx,offy+Ly/2,S);
+    prefactor = combine_horizontal();
+  }
+  failedLanes |= A->failedLanes | B->failedLanes;
+  lostBits = lostBits > A->lostBits ? lostBits : A->lostBits;
+  lostBits = lostBits > B->lostBits ? lostBits : B->lostBits;
+  delete A; A = NULL;
+  delete B; B = NULL;
+}
+
+FINDbatch::~FINDbatch()
+{
+  if (A != NULL)
+    delete A;
+  if (B != NULL)
+    delete B;
+  if (mat != NULL)
+    delete_matrix(&mat,mtx_L);
+  mat = NULL;
+}
+
+int FINDbatch::failed()
+{
+  return failedLanes;
+}
+
+lanes FINDbatch::lost()
+{
+  return lostBits;
+}
+
+lanes FINDbatch::get_p_bond(int px, int py, Dir dir)
+{
+  lanes v;
+  for (int l = 0; l < LANES; l++)
+    v[l] = S[l]->get_p_bond(px,py,dir).get_d();
+  return v;
+}
+
+void FINDbatch::allocate_matrix(lanes*** mtx, int L)
+{
+  (*mtx) = new lanes*[L-1];
+  for (int i=0; i<L-1; i++)
+  {
+    (*mtx)[i] = new lanes[L-1-i];
+    for (int j=0; j<L-1-i; j++)
+      (*mtx)[i][j] = broadcast(0);
+  }
+}
+
+void FINDbatch::copy_matrix(lanes** mtx1, lanes*** mtx2, int L)
+{
+  (*mtx2) = new lanes*[L-1];
+  for (int i=0; i<L-1; i++)
+  {
+    (*mtx2)[i] = new lanes[L-1-i];
+    for (int j=0; j<L-1-i; j++)
+      (*mtx2)[i][j] = mtx1[i][j];
+  }
+}
+
+void FINDbatch::delete_matrix(lanes*** mtx, int L)
+{
+  for (int i=0; i<L-1; i++)
+    delete[] (*mtx)[i];
+  delete[] (*mtx);
+}
+
+// presume wrapHorz already done
+scaled FINDbatch::Zvert(int vsep)
+{
+  for (int i=0; i<Ly; i++)
+    mat[i][2*Ly-2*i-2] -= vsep*get_p_bond(offx,offy+i,W);
+  scaled Z = prefactor;
+  Z.mul(Pf_eliminate(Ly));
+  return Z;
+}
+
+void FINDbatch::wrapHorz(int hsep)
+{
+  for (int i=0; i<Lx; i++)
+    mat[i][2*Lx+Ly-2*i-2] += hsep*get_p_bond(offx+i,offy,N);
+  int xchgfactor = 1;
+  for (int i = 0; i < Ly/2; ++i) {
+    swaprows(Lx+i, Lx+Ly-1-i);
+    xchgfactor = -xchgfactor;
+  }
+  for (int i = 0; i < Lx/2; ++i) {
+    swaprows(Lx+Ly+i, Lx+Ly+Lx-1-i);
+    xchgfactor = -xchgfactor;
+  }
+  for (int i = 0; i < (Lx+Ly)/2; ++i) {
+    swaprows(Lx+i, Lx+Ly+Lx-1-i);
+    xchgfactor = -xchgfactor;
+  }
+  prefactor.mul(Pf_eliminate(Lx));
+  prefactor.mul(broadcast(xchgfactor));
+}
+
+scaled FINDbatch::combine_vertical()
+{
+  mtx_L = A->mtx_L + B->mtx_L;
+  allocate_matrix(&mat,mtx_L);
+
+  int* Aordering = new int[A->mtx_L];
+  int* Bordering = new int[B->mtx_L];
+  int counter = 0;
+  for (int i=0; i<Ly; i++)             // interleaving part
+  {
+    Bordering[2*B->Lx+2*Ly-1-i] = counter++;
+    Aordering[A->Lx+i] = counter++;
+    mat[counter-2][0] = -get_p_bond(B->offx,offy+i,W);
+  }
+  for (int i=0; i<A->Lx; i++)
+    Aordering[i] = counter++;
+  for (int i=0; i<2*B->Lx+Ly; i++)
+    Bordering[i] = counter++;
+  for (int i=0; i<A->Lx+Ly; i++)
+    Aordering[A->Lx+Ly+i] = counter++;
+
+  fill_mat(A,Aordering);
+  fill_mat(B,Bordering);
+
+  delete[] Aordering;
+  delete[] Bordering;
+
+  scaled pf = A->prefactor;
+  pf.mul(B->prefactor);
+  pf.mul(Pf_eliminate(Ly));
+  return pf;
+}
+
+scaled FINDbatch::combine_horizontal()
+{
+  mtx_L = A->mtx_L + B->mtx_L;
+  allocate_matrix(&mat,mtx_L);
+
+  int* Aordering = new int[A->mtx_L];
+  int* Bordering = new int[B->mtx_L];
+  int counter = 0;
+  for (int i=0; i<Lx; i++)             // interleaving part
+  {
+    Aordering[Lx+A->Ly+i] = counter++;
+    Bordering[Lx-1-i] = counter++;
+    mat[counter-2][0] = get_p_bond(offx+Lx-1-i,B->offy,N);
+  }
+  for (int i=0; i<Lx+A->Ly; i++)
+    Aordering[i] = counter++;
+  for (int i=0; i<Lx+2*B->Ly; i++)
+    Bordering[Lx+i] = counter++;
+  for (int i=0; i<A->Ly; i++)
+    Aordering[2*Lx+A->Ly+i] = counter++;
+
+  fill_mat(A,Aordering);
+  fill_mat(B,Bordering);
+
+  delete[] Aordering;
+  delete[] Bordering;
+
+  scaled pf = A->prefactor;
+  pf.mul(B->prefactor);
+  pf.mul(Pf_eliminate(Lx));
+  return pf;
+}
+
+void FINDbatch::fill_mat(FINDbatch* from, int* ordering)
+{
+  for (int i=0; i<from->mtx_L; i++)
+  {
+    int newi = ordering[i];
+    for (int j=0; j<from->mtx_L-1-i; j++)
+    {
+      int newj = ordering[j+1+i];
+      if (newi > newj)
+        mat[newj][newi-newj-1] = -from->mat[i][j];
+      else
+        mat[newi][newj-newi-1] = from->mat[i][j];
+    }
+  }
+}
+
+// Semi-pivoted elimination as in FINDmatrix::Pf_eliminate.  Each lane
+// picks its own pivot row; lanes with the same pivot are swapped together.
+scaled FINDbatch::Pf_eliminate(int numEvenRows)
+{
+  lanes pivotfactor = broadcast(1);
+  // A pivot row whose largest entry shrank by 2^k through the cross
+  // operations before its turn has lost up to k bits to cancellation.
+  // This tends to overestimate (shrinking by products of small weights
+  // loses nothing), but only costs one pass over the rows.
+  lanes* rowMax = new lanes[numEvenRows*2];
+  lanes shrink = broadcast(1);
+  for (int i = 0; i < numEvenRows*2; i += 2)
+  {
+    rowMax[i] = broadcast(0);
+    for (int j = 0; j < mtx_L-i-1; j++)
+    {
+      lanes mag = mat[i][j] < 0 ? -mat[i][j] : mat[i][j];
+      rowMax[i] = mag > rowMax[i] ? mag : rowMax[i];
+    }
+  }
+  for (int i = 0; i < numEvenRows*2; i += 2)
+  {
+    const mask none = {};
+    lanes maxMag = broadcast(0);
+    mask pivotrow = none;
+    for (int j = 0; j < numEvenRows*2-i-1; j++)
+    {
+      lanes mag = mat[i][j] < 0 ? -mat[i][j] : mat[i][j];
+      mask bigger = mag > maxMag;
+      pivotrow = bigger ? none + j : pivotrow;
+      maxMag = bigger ? mag : maxMag;
+    }
+    for (int l = 0; l < LANES; l++)
+    {
+      if (pivotrow[l] == 0)
+        continue;
+      int j = pivotrow[l];
+      mask m = pivotrow == j;
+      pivotrows(i, j, m);
+      pivotfactor = m ? -pivotfactor : pivotfactor;
+      pivotrow = m ? none : pivotrow;
+    }
+    mask zero = mat[i][0] == 0;
+    for (int l = 0; l < LANES; l++)
+      if (zero[l])                     // zero superdiag error: give up on
+        failedLanes |= 1 << l;         // .. this lane, keep the others going
+    mat[i][0] = zero ? broadcast(1) : mat[i][0];
+    lanes pivot = mat[i][0] < 0 ? -mat[i][0] : mat[i][0];
+    lanes ratio = rowMax[i] / pivot;
+    shrink = ratio > shrink ? ratio : shrink;
+    for (int j = 1; j < mtx_L - i - 1; j++)
+    {				       // do the cross operation
+      mask nonzero = mat[i][j] != 0;
+      for (int l = 0; l < LANES; l++)
+        if (nonzero[l])
+        {
+          crossOp(i, j);
+          break;
+        }
+    }
+  }
+
+  delete[] rowMax;
+  for (int l = 0; l < LANES; l++)
+    lostBits[l] = std::max(lostBits[l], std::log2(shrink[l]));
+
+  scaled superDiagProd;
+  superDiagProd.mul(pivotfactor);
+  for (int i = 0; i < numEvenRows * 2; i += 2)
+    superDiagProd.mul(mat[i][0]);
+
+  if (2*numEvenRows < mtx_L)
+  {
+    for (int i=0; i<2*numEvenRows; i++)
+      delete[] mat[i];
+    mtx_L -= 2*numEvenRows;
+    lanes** newmat = new lanes*[mtx_L-1];
+    for (int i=0; i<mtx_L-1; i++)
+      newmat[i] = mat[i+2*numEvenRows];
+    delete[] mat;
+    mat = newmat;
+  }
+  return superDiagProd;
+}
+
+// same as FINDmatrix::swaprows; the reordering is identical in all lanes
+void FINDbatch::swaprows(int i, int j) {
+  if (j < i) {int tmpr = i; i = j; j = tmpr;}
+  lanes tmp;
+  int rowA, offA, rowB, offB, flag;
+  mat[i][j-i-1] = -mat[i][j-i-1];
+  for (int k = 0; k < mtx_L; ++k) {
+    if (k == i || k == j) continue;
+    if (k < i) {
+      rowA = k;
+      offA = i - k - 1;
+      flag = 1;
+    } else {
+      rowA = i;
+      offA = k - i - 1;
+      flag = -1;
+    }
+    if (k < j) {
+      rowB = k;
+      offB = j - k - 1;
+    } else {
+      rowB = j;
+      offB = k - j - 1;
+      flag = -flag;
+    }
+    tmp = flag * mat[rowA][offA];
+    mat[rowA][offA] = flag * mat[rowB][offB];
+    mat[rowB][offB] = tmp;
+  }
+}
+
+// FINDmatrix::pivotrows restricted to the lanes selected by m
+void FINDbatch::pivotrows(int i, int j, const mask &m)
+{
+  lanes a, b;
+  // i) - swap x,y
+  a = mat[i][0];
+  b = mat[i][j];
+  mat[i][0] = m ? b : a;
+  mat[i][j] = m ? a : b;
+
+  // ii) - swap 1,c, with negation
+  for (int k = 0; k < j-1; ++k)
+  {
+    a = mat[i+1][k];
+    b = mat[i+2+k][j-k-2];
+    mat[i+1][k] = m ? -b : a;
+    mat[i+2+k][j-k-2] = m ? -a : b;
+  }
+
+  // iii) negate intersection
+  mat[i+1][j-1] = m ? -mat[i+1][j-1] : mat[i+1][j-1];
+
+  // iv) swap end of row i with end of row i+j
+  for (int k = 0; j + k < mtx_L-i-2; k++)
+  {
+    a = mat[i+1][j+k];
+    b = mat[i+j+1][k];
+    mat[i+1][j+k] = m ? b : a;
+    mat[i+j+1][k] = m ? a : b;
+  }
+}
+
+// Lanes with mat[i][j] == 0 have a zero scale factor and are unchanged.
+void FINDbatch::crossOp(int i, int j)
+{
+  lanes scaleFactor = -mat[i][j]/mat[i][0];
+  mat[i][j] = broadcast(0);
+  for (int k = 0; k < j - 1; ++k)
+    mat[i+2+k][j-k-2] -= scaleFactor * mat[i+1][k];
+  for (int k = 0; j + k < mtx_L-i-2; k++)
+    mat[i+j+1][k] += scaleFactor * mat[i+1][j+k];
+}
+
+// A sector is a signed sum of the four Pfaffians y_k, which cancels
+// log2(max_k |y_k| / |Z_s|) bits at low temperature; the y_k themselves
+// are only good to 53 bits less those lost in their eliminations.  When
+// the two together use up the 53 bits of a double, the sector has no
+// correct bits left (it can be off by orders of magnitude), and the lane
+// is reported as failed instead.
+int findPartitionBatch(Sample** S, scaled Z[4], int* inexact)
+{
+  FINDbatch X(S);
+
+  FINDbatch Ypls1(X);
+  FINDbatch Yneg1(X);
+
+  Ypls1.wrapHorz(1);
+  Yneg1.wrapHorz(-1);
+
+  FINDbatch Ypls2(Ypls1);
+  FINDbatch Yneg2(Yneg1);
+
+  scaled y[4] = {Ypls1.Zvert(1), Yneg1.Zvert(1), Ypls2.Zvert(-1), Yneg2.Zvert(-1)};
+  static const int sign[4][4] = {{ 1,  1,  1,  1},   // ZPP
+                                 {-1, -1,  1,  1},   // ZPA
+                                 {-1,  1, -1,  1},   // ZAP
+                                 {-1,  1,  1, -1}};  // ZAA
+
+  lanes lost[4] = {Ypls1.lost(), Yneg1.lost(), Ypls2.lost(), Yneg2.lost()};
+  int inexactLanes = 0;
+  for (int l = 0; l < LANES; l++)
+  {
+    double ylost = 0;
+    for (int k = 0; k < 4; k++)
+      ylost = std::max(ylost, lost[k][l]);
+    long emax = y[0].e[l];
+    for (int k = 1; k < 4; k++)
+      if (y[k].e[l] > emax)
+        emax = y[k].e[l];
+    for (int s = 0; s < 4; s++)
+    {
+      double sum = 0;
+      double ymax = 0;
+      for (int k = 0; k < 4; k++)
+      {
+        double yk = std::ldexp(y[k].m[l], y[k].e[l] - emax);
+        sum += sign[s][k] * yk;
+        ymax = std::max(ymax, std::fabs(yk));
+      }
+      if (sum == 0 || std::log2(ymax / std::fabs(sum)) + ylost >=
+                      std::numeric_limits<double>::digits)
+        inexactLanes |= 1 << l;
+      int ex;
+      Z[s].m[l] = std::frexp(std::fabs(0.5*sum), &ex);
+      Z[s].e[l] = emax + ex;
+      Z[s].mul(S[l]->get_Z_prefactor(), l);
+    }
+  }
+  if (inexact != NULL)
+    *inexact = inexactLanes;
+  return X.failed() | Ypls1.failed() | Yneg1.failed() | Ypls2.failed() | Yneg2.failed() |
+         inexactLanes;
+}
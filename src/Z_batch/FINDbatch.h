@@ -0,0 +1,100 @@
+// FINDbatch.h
+//
+// Batched variant of FINDmatrix: runs the nested dissection for LANES
+// samples of identical size at once.  The index operations of fill_mat,
+// wrapHorz and the elimination only depend on the lattice size, so they
+// are shared by the whole batch, and every matrix entry holds one double
+// per sample (structure of arrays).  The arithmetic then runs on SIMD
+// vectors: 4 lanes with AVX2, 8 lanes with AVX-512.
+// Samples choose different pivots; pivoting is done with masked swaps,
+// one pass per distinct pivot row in the batch.
+// Prefactors and products of superdiagonal elements are kept per lane
+// as mantissa and binary exponent, so that they do not overflow.
+//
+// Doubles carry about 16 significant digits, and the semi-pivoted
+// elimination loses some of them as the range of weights grows (lower
+// temperature): relative errors of 1e-13 to 1e-8 on the largest sector
+// are typical around the Nishimori temperature.  The smaller sectors are
+// accurate relative to the largest one only.  A lane in which a sector
+// has no correct bits left is reported as failed (see
+// findPartitionBatch).  Where the sectors matter (low temperature, large
+// lattices) use isingZToTxt with sufficient bits of precision.
+
+#ifndef FIND_BATCH_H
+#define FIND_BATCH_H
+
+#include "../Z_to_txt/dataType.h"
+#include "../Z_to_txt/Sample.h"
+
+#ifndef LANES
+#ifdef __AVX512F__
+#define LANES 8
+#else
+#define LANES 4
+#endif
+#endif
+
+typedef double    lanes __attribute__((vector_size(LANES*sizeof(double))));
+typedef long long mask  __attribute__((vector_size(LANES*sizeof(long long))));
+
+// m * 2^e for every lane
+struct scaled
+{
+  double m[LANES];
+  long   e[LANES];
+  scaled();                            // all lanes 1
+  void mul(const lanes &x);
+  void mul(const scaled &x);
+  void mul(const dataType &x, int lane);
+  dataType get(int lane) const;
+};
+
+class FINDbatch
+{
+  public:
+    FINDbatch(Sample** S);             // LANES samples of identical size
+    FINDbatch(int _Lx, int _Ly, int _offx, int _offy, Sample** _S);
+    FINDbatch(FINDbatch& other);       // copy constructor (does not copy
+				       // .. submatrices)
+    ~FINDbatch();
+    scaled Zvert(int vsep);
+    void wrapHorz(int hsep);
+    int failed();                      // bit mask of lanes that hit a
+				       // .. zero superdiagonal
+    lanes lost();                      // bits lost to cancellation in
+				       // .. the eliminations, per lane
+
+  private:
+    int Lx, Ly;
+    int offx, offy;
+    int mtx_L;
+    Sample** S;
+    FINDbatch* A;
+    FINDbatch* B;
+    lanes**  mat;
+    scaled   prefactor;
+    int      failedLanes;
+    lanes    lostBits;
+
+    void initialize();
+    lanes get_p_bond(int px, int py, Dir dir);
+
+    scaled combine_vertical();
+    scaled combine_horizontal();
+    scaled Pf_eliminate(int numEvenRows);
+    void swaprows(int i, int j);
+    void pivotrows(int i, int j, const mask &m);
+    void crossOp(int i, int j);
+    void fill_mat(FINDbatch* from, int* ordering);
+    void allocate_matrix(lanes*** mtx, int L);
+    void copy_matrix(lanes** mtx1, lanes*** mtx2, int L);
+    void delete_matrix(lanes*** mtx, int L);
+};
+
+// The four sector partition functions (in the order of Sector) of a
+// batch of LANES samples.  Returns the bit mask of failed lanes; those
+// that only failed because a sector has no correct bits left (see
+// findPartitionBatch) are also set in *inexact.
+int findPartitionBatch(Sample** S, scaled Z[4], int* inexact = NULL);
+
+#endif // FIND_BATCH_H
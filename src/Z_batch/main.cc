@@ -0,0 +1,148 @@
+// main.cc
+// Batched partition function calculation in double precision: processes
+// the seeds firstSeed..lastSeed of one (probability, Lx, Ly, std dev)
+// point LANES samples at a time (see FINDbatch.h).  Input and output
+// files are the same as for isingZToTxt; results are stored under the
+// precision label 53, the mantissa bits of a double.
+
+#include <iostream>
+#include <cmath>
+#include <fstream>
+#include <string>
+#include <cstdlib>
+#include <algorithm>
+#include "FINDbatch.h"
+
+void createDirectory(const std::string &path) {
+    std::string command = "mkdir -p " + path;
+    int status = system(command.c_str());
+    if (status != 0) {
+        std::cerr << "Error creating directory: " << path << std::endl;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+  if (argc < 8 || argc > 9)
+  {
+    std::cout << "FIND2DIsing batch: computes partition functions of 2D Ising models in double precision, " << LANES << " samples at a time\n";
+    std::cout << "usage: " << argv[0] << " Lx Ly firstSeed lastSeed probability temperature directory [std dev] \n";
+    return 1;
+  }
+
+  // weights are read at a modest precision and converted to doubles
+  mpf_set_default_prec(128);
+
+  int x   = atoi(argv[1]);
+  int y   = atoi(argv[2]);
+  int firstSeed = atoi(argv[3]);
+  int lastSeed  = atoi(argv[4]);
+  double prob = atof(argv[5]);
+  double T_frac = atof(argv[6]);
+
+  bool useGaussian = (argc == 9);
+  double stddev = 0.0;
+  dataType T_nish = 1.0;
+  if (prob!=0){
+    T_nish = 2/std::log((1-prob)/prob);
+  }
+  if (useGaussian) {
+    T_nish = 1.0;
+    stddev = std::atof(argv[8]);
+    if (stddev <= 0) {
+      std::cerr << "Error: Std dev must be positive.\n";
+      return 1;
+    }
+  }
+  dataType T = T_frac*T_nish;
+
+  std::string directory = argv[7];
+
+  int failures = 0;
+  for (int seed0 = firstSeed; seed0 <= lastSeed; seed0 += LANES)
+  {
+    // a partial last batch, and the lanes of seeds whose file cannot be
+    // read as an x by y lattice, are filled with copies of a good sample
+    Sample* S[LANES];
+    bool own[LANES] = {false};
+    int n = std::min(LANES, lastSeed - seed0 + 1);
+    int good = -1;
+    int unread = 0;
+    for (int l = 0; l < n; l++)
+    {
+      std::string input = directory + "/interactionsGaussian/" +
+                          std::to_string(prob) + "/" +
+                          std::to_string(x) + "/" +
+                          std::to_string(y) + "/" +
+                          std::to_string(stddev) + "/" +
+                          std::to_string(seed0+l) + "/interaction_lattice.txt";
+      S[l] = new Sample(input, T);
+      own[l] = S[l]->good() && S[l]->get_Lx() == x && S[l]->get_Ly() == y;
+      if (own[l])
+      {
+        if (good < 0)
+          good = l;
+        continue;
+      }
+      std::cerr << "Error: cannot read " << input << " as a " << x << " x "
+                << y << " lattice\n";
+      delete S[l];
+      unread |= 1 << l;
+    }
+    if (good < 0)
+    {
+      failures += n;
+      continue;
+    }
+    for (int l = 0; l < LANES; l++)
+      if (l >= n || (unread & (1 << l)))
+        S[l] = S[good];
+
+    scaled Z[4];
+    int inexact;
+    int failed = findPartitionBatch(S, Z, &inexact);
+
+    for (int l = 0; l < n; l++)
+    {
+      int seed = seed0+l;
+      if (unread & (1 << l))
+      {
+        failures++;
+        continue;
+      }
+      if (inexact & (1 << l))
+      {
+        std::cerr << "no correct bits left in double precision for seed " << seed
+                  << " (use isingZToTxt)\n";
+        failures++;
+        continue;
+      }
+      if (failed & (1 << l))
+      {
+        std::cerr << "zero superdiag error for seed " << seed << "\n";
+        failures++;
+        continue;
+      }
+      std::string outputDir = directory + "/resultsGaussian/" +
+                              std::to_string(prob) + "/" +
+                              std::to_string(stddev) + "/" +
+                              std::to_string(x) + "/" +
+                              std::to_string(y) + "/" +
+                              std::to_string(T_frac) + "/53/" +
+                              std::to_string(seed);
+      createDirectory(outputDir);
+      std::ofstream outFile((outputDir + "/Z.txt").c_str());
+      outFile.precision(17);
+      outFile << std::scientific;
+      for (int s = 0; s < 4; s++)
+        outFile << Z[s].get(l) << "\t";
+      outFile.close();
+    }
+    for (int l = 0; l < n; l++)
+      if (own[l])
+        delete S[l];
+  }
+  std::cout << "Z results written for seeds " << firstSeed << " to " << lastSeed
+            << " (" << failures << " failed)" << std::endl;
+  return failures != 0;
+}
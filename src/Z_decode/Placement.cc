@@ -0,0 +1,109 @@
+#include "Placement.h"
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <sched.h>
+
+// numbers of a sysfs list such as "0-3,8-11"
+static std::vector<int> parseList(const std::string &list)
+{
+  std::vector<int> cpus;
+  std::stringstream ss(list);
+  std::string range;
+  while (std::getline(ss, range, ','))
+  {
+    int first, last;
+    char dash;
+    std::stringstream rs(range);
+    if (!(rs >> first))
+      continue;
+    last = (rs >> dash >> last) ? last : first;
+    for (int c = first; c <= last; c++)
+      cpus.push_back(c);
+  }
+  return cpus;
+}
+
+Placement::Placement()
+{
+  cpu_set_t allowed;
+  CPU_ZERO(&allowed);
+  if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+    for (int c = 0; c < CPU_SETSIZE; c++)
+      CPU_SET(c, &allowed);
+
+  // node ids need not be contiguous (offline or memory-only nodes)
+  std::ifstream online("/sys/devices/system/node/online");
+  std::string list;
+  std::getline(online, list);
+  for (int node : parseList(list))
+  {
+    std::ifstream in("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+    std::string cpulist;
+    std::getline(in, cpulist);
+    std::vector<int> mine;
+    for (int c : parseList(cpulist))
+      if (c < CPU_SETSIZE && CPU_ISSET(c, &allowed))
+        mine.push_back(c);
+    if (!mine.empty())
+    {
+      cpus.push_back(mine);
+      ids.push_back(node);
+    }
+  }
+  if (cpus.empty())                    // no sysfs: one node
+  {
+    cpus.resize(1);
+    ids.assign(1, 0);
+    for (int c = 0; c < CPU_SETSIZE; c++)
+      if (CPU_ISSET(c, &allowed))
+        cpus[0].push_back(c);
+  }
+
+  for (size_t node = 0; node < cpus.size(); node++)
+    for (int c : cpus[node])
+    {
+      if (c >= int(nodeOf.size()))
+        nodeOf.resize(c + 1, -1);
+      nodeOf[c] = node;
+    }
+}
+
+int Placement::nodes() const
+{
+  return cpus.size();
+}
+
+int Placement::node_id(int node) const
+{
+  return ids[node];
+}
+
+int Placement::node_of_cpu(int cpu) const
+{
+  return (cpu >= 0 && cpu < int(nodeOf.size())) ? nodeOf[cpu] : -1;
+}
+
+int Placement::node_of_worker(int worker) const
+{
+  return worker % cpus.size();
+}
+
+int Placement::cpu_of_worker(int worker) const
+{
+  const std::vector<int> &mine = cpus[node_of_worker(worker)];
+  return mine[(worker / cpus.size()) % mine.size()];
+}
+
+bool Placement::pin(int cpu)
+{
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  return sched_setaffinity(0, sizeof(set), &set) == 0;
+}
+
+int Placement::current_cpu()
+{
+  return sched_getcpu();
+}
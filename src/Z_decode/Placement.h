@@ -0,0 +1,36 @@
+// Placement.h
+//
+// Placement of worker threads on the NUMA nodes of the machine.  The
+// online nodes and their cores are read from /sys/devices/system/node
+// (one node with all cores if it is missing), restricted to the cores the
+// process may run on.  Nodes are numbered 0 .. nodes()-1 here; node_id
+// gives the kernel's number, which may have gaps.  Workers are dealt out
+// round robin over the nodes, so that any number of workers uses the
+// memory bandwidth of every node, and a pinned worker stays on its core.
+// Memory a thread touches first is placed on the node it runs on, so a
+// worker that is pinned before it allocates its Sample, FINDmatrix and
+// weights works on local memory.
+
+#ifndef PLACEMENT_H
+#define PLACEMENT_H
+
+#include <vector>
+
+class Placement
+{
+  public:
+    Placement();
+    int  nodes() const;
+    int  node_id(int node) const;      // as numactl and sysfs count
+    int  node_of_cpu(int cpu) const;   // -1 if unknown
+    int  cpu_of_worker(int worker) const;
+    int  node_of_worker(int worker) const;
+    static bool pin(int cpu);          // the calling thread
+    static int  current_cpu();
+  private:
+    std::vector<std::vector<int> > cpus; // allowed cpus per node
+    std::vector<int> ids;              // kernel id per node
+    std::vector<int> nodeOf;           // indexed by cpu
+};
+
+#endif // PLACEMENT_H
@@ -0,0 +1,328 @@
+// main.cc
+// Decoder for a stream of error configurations: each record gives the
+// flipped bonds of an Lx x Ly lattice, the couplings are built in memory
+// (J = -1 on a flipped bond, +1 otherwise) at the Nishimori temperature
+// of the error probability, and the answer is the most likely of the four
+// sectors together with the log-likelihood ratios ln(Z_k/Z_PP) of the
+// other three.  Only the two couplings +-1 occur, so with one WeightCache
+// per thread the exponentials are evaluated once per thread instead of
+// once per bond and record.
+//
+// Records are read in chunks; the threads take batches of records from a
+// chunk until it is done, and the answers are written in the order of the
+// records.  The workers live for the whole run; with --pin each is bound
+// to a core, spread over the NUMA nodes (see Placement.h), and allocates
+// its weights and matrices only after that, so they are local to its
+// node.  Formats of a record (bond k in the order of the generator:
+// spins row by row, E then S bond):
+//   b8  ceil(2*Lx*Ly/8) bytes, bond k in bit k%8 of byte k/8 (least
+//       significant bit first, as the b8 format of stim)
+//   01  one line of 2*Lx*Ly characters '0' or '1'
+// Output, one line per record:
+//   record  sector  ln(Z_PA/Z_PP)  ln(Z_AP/Z_PP)  ln(Z_AA/Z_PP)
+// The throughput, and per node the workers, the records decoded there and
+// the busy time of its workers, are printed to stderr at the end.
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "../Z_to_txt/Partition.h"
+#include "Placement.h"
+
+static const char *sectorName[4] = {"PP", "PA", "AP", "AA"};
+
+// next record of in into bits (0 or 1 per bond); false at the end of the
+// stream, error set if the stream ends inside a record
+static bool readRecord(std::istream &in, bool text, std::vector<char> &bits,
+                       std::vector<unsigned char> &bytes, bool &error)
+{
+  size_t nBonds = bits.size();
+  if (text)
+  {
+    std::string line;
+    if (!std::getline(in, line))
+      return false;
+    if (!line.empty() && line.back() == '\r')
+      line.pop_back();
+    if (line.size() != nBonds ||
+        line.find_first_not_of("01") != std::string::npos)
+    {
+      error = true;
+      return false;
+    }
+    for (size_t k = 0; k < nBonds; k++)
+      bits[k] = line[k] - '0';
+    return true;
+  }
+  in.read(reinterpret_cast<char*>(bytes.data()), bytes.size());
+  if (in.gcount() == 0)
+    return false;
+  if (size_t(in.gcount()) != bytes.size())
+  {
+    error = true;
+    return false;
+  }
+  for (size_t k = 0; k < nBonds; k++)
+    bits[k] = (bytes[k/8] >> (k%8)) & 1;
+  return true;
+}
+
+static double logOf(const dataType &Z)
+{
+  if (Z <= 0)
+    return -INFINITY;
+  long e;
+  double m = mpf_get_d_2exp(&e, Z.get_mpf_t());
+  return std::log(m) + e * M_LN2;
+}
+
+// answer line of one record
+static std::string decode(long record, int Lx, int Ly, const char *bits,
+                          WeightCache &cache, std::vector<double> &J)
+{
+  for (size_t k = 0; k < J.size(); k++)
+    J[k] = bits[k] ? -1.0 : 1.0;
+  Sample S(Lx, Ly, J.data(), cache);
+  dataType Z[4];
+  findPartition(S, Z);
+
+  double logZ[4];
+  int best = PP;
+  for (int k = PP; k <= AA; k++)
+  {
+    logZ[k] = logOf(Z[k]);
+    if (Z[k] > Z[best])
+      best = k;
+  }
+  char line[160];
+  snprintf(line, sizeof(line), "%ld\t%s\t%.10g\t%.10g\t%.10g\n", record,
+           sectorName[best], logZ[PA] - logZ[PP], logZ[AP] - logZ[PP],
+           logZ[AA] - logZ[PP]);
+  return line;
+}
+
+int main(int argc, char* argv[])
+{
+  int threads = std::thread::hardware_concurrency();
+  int batch = 16;
+  bool text = false;
+  bool pin = false;
+  double T_frac = 1.0;
+  while (argc > 2 && strncmp(argv[1], "--", 2) == 0)
+  {
+    if (strcmp(argv[1], "--pin") == 0)
+    {
+      pin = true;
+      argc--;
+      argv++;
+      continue;
+    }
+    if (strcmp(argv[1], "--threads") == 0)
+      threads = atoi(argv[2]);
+    else if (strcmp(argv[1], "--batch") == 0)
+      batch = atoi(argv[2]);
+    else if (strcmp(argv[1], "--temperature") == 0)
+      T_frac = atof(argv[2]);
+    else if (strcmp(argv[1], "--format") == 0 &&
+             (strcmp(argv[2], "b8") == 0 || strcmp(argv[2], "01") == 0))
+      text = (strcmp(argv[2], "01") == 0);
+    else
+      break;
+    argc -= 2;
+    argv += 2;
+  }
+  if (argc != 7)
+  {
+    std::cout << "usage: " << argv[0] << " [--threads n] [--pin] [--batch records] [--format b8|01] [--temperature T_frac] bitsOfPrecision Lx Ly probability input output \n";
+    return 1;
+  }
+
+  int prec = atoi(argv[1]);
+  mpf_set_default_prec(prec);
+  int Lx = atoi(argv[2]);
+  int Ly = atoi(argv[3]);
+  double prob = atof(argv[4]);
+  std::string inputFile = argv[5];
+  std::string outputFile = argv[6];
+  if (prec < 1 || Lx < 1 || Ly < 1 || T_frac <= 0)
+  {
+    std::cerr << "Error: precision, Lx, Ly and temperature must be positive.\n";
+    return 1;
+  }
+  if (!(prob > 0 && prob < 0.5))
+  {
+    std::cerr << "Error: probability must be in (0, 0.5).\n";
+    return 1;
+  }
+  if (threads < 1)
+    threads = 1;
+  if (batch < 1)
+    batch = 1;
+
+  dataType T_nish = 1.0;               // Nishimori temperature, as isingZToTxt
+  T_nish = 2/std::log((1-prob)/prob);
+  dataType T = T_frac*T_nish;
+
+  std::ios::sync_with_stdio(false);
+  std::ifstream inFile;
+  std::istream *in = &std::cin;
+  if (inputFile != "-")
+  {
+    inFile.open(inputFile, text ? std::ios::in : std::ios::in | std::ios::binary);
+    if (!inFile)
+    {
+      std::cerr << "Error: cannot open " << inputFile << "\n";
+      return 1;
+    }
+    in = &inFile;
+  }
+  std::ofstream outFile;
+  std::ostream *out = &std::cout;
+  if (outputFile != "-")
+  {
+    outFile.open(outputFile);
+    if (!outFile)
+    {
+      std::cerr << "Error: cannot open " << outputFile << "\n";
+      return 1;
+    }
+    out = &outFile;
+  }
+
+  size_t nBonds = 2*size_t(Lx)*Ly;
+  size_t chunk = 4*size_t(threads)*batch; // records read at once
+  std::vector<char> bits(nBonds);
+  std::vector<unsigned char> bytes((nBonds + 7)/8);
+  std::vector<char> records(chunk*nBonds);
+  std::vector<std::string> answers(chunk);
+
+  // chunk handed to the workers: records [0, n) are numbered from done
+  Placement placement;
+  std::mutex m;
+  std::condition_variable start, finish;
+  long generation = 0;
+  int finished = 0;
+  bool stop = false;
+  size_t n = 0;
+  long done = 0;
+  std::atomic<size_t> next(0);
+  std::vector<int> pinned(threads, 0);
+  std::vector<double> busy(threads, 0.0);
+  std::vector<std::vector<long> > onNode(threads, std::vector<long>(placement.nodes(), 0));
+
+  std::vector<std::thread> pool;
+  for (int t = 0; t < threads; t++)
+    pool.emplace_back([&, t]() {
+      if (pin)
+        pinned[t] = Placement::pin(placement.cpu_of_worker(t));
+      WeightCache cache(T);
+      std::vector<double> J(nBonds);
+      long seen = 0;
+      while (true)
+      {
+        {
+          std::unique_lock<std::mutex> lock(m);
+          start.wait(lock, [&]() { return stop || generation != seen; });
+          if (stop)
+            break;
+          seen = generation;
+        }
+        auto begin = std::chrono::steady_clock::now();
+        size_t first;
+        while ((first = next.fetch_add(batch)) < n)
+        {
+          for (size_t i = first; i < std::min<size_t>(first + batch, n); i++)
+            answers[i] = decode(done + i, Lx, Ly, &records[i*nBonds], cache, J);
+          int node = placement.node_of_cpu(Placement::current_cpu());
+          if (node >= 0)
+            onNode[t][node] += std::min<size_t>(first + batch, n) - first;
+        }
+        busy[t] += std::chrono::duration<double>(
+          std::chrono::steady_clock::now() - begin).count();
+        std::lock_guard<std::mutex> lock(m);
+        if (++finished == threads)
+          finish.notify_one();
+      }
+    });
+
+  bool error = false;
+  auto begin = std::chrono::steady_clock::now();
+  while (true)
+  {
+    size_t count = 0;
+    while (count < chunk && readRecord(*in, text, bits, bytes, error))
+      memcpy(&records[count++*nBonds], bits.data(), nBonds);
+    if (count == 0)
+      break;
+
+    {
+      std::unique_lock<std::mutex> lock(m);
+      n = count;
+      next = 0;
+      finished = 0;
+      generation++;
+      start.notify_all();
+      finish.wait(lock, [&]() { return finished == threads; });
+    }
+
+    for (size_t i = 0; i < count; i++)
+      *out << answers[i];
+    out->flush();
+    done += count;
+    if (error || count < chunk)
+      break;
+  }
+  double seconds = std::chrono::duration<double>(
+    std::chrono::steady_clock::now() - begin).count();
+  {
+    std::lock_guard<std::mutex> lock(m);
+    stop = true;
+  }
+  start.notify_all();
+  for (std::thread &t : pool)
+    t.join();
+
+  if (error)
+  {
+    std::cerr << "Error: record " << done << " is incomplete or malformed.\n";
+    return 1;
+  }
+  if (!*out)
+  {
+    std::cerr << "Error writing " << outputFile << "\n";
+    return 1;
+  }
+  std::cerr << "decoded " << done << " records in " << seconds << " s, "
+            << done/seconds << " records/s on " << threads << " threads\n";
+  for (int node = 0; node < placement.nodes(); node++)
+  {
+    int workers = 0, pinnedHere = 0;
+    long decoded = 0;
+    double nodeBusy = 0;
+    for (int t = 0; t < threads; t++)
+    {
+      decoded += onNode[t][node];
+      if (placement.node_of_worker(t) == node)
+      {
+        workers++;
+        pinnedHere += pinned[t];
+        nodeBusy += busy[t];
+      }
+    }
+    std::cerr << "node " << placement.node_id(node) << ": " << decoded << " records, "
+              << workers << " workers (" << pinnedHere << " pinned), busy "
+              << nodeBusy << " s\n";
+  }
+  return 0;
+}
@@ -0,0 +1,245 @@
+// main.cc
+// isingZToTxt with the work for one lattice spread over MPI ranks: the
+// top levels of the nested dissection run on different ranks.  The ranks are
+// split in halves along with the lattice, as FINDmatrix::initialize()
+// splits it, until a single rank is left, which dissects its sublattice
+// locally.  The first rank of the right (bottom) half then sends the
+// boundary matrix of its half, as raw mpf limbs, to the first rank of
+// the left (top) half, which combines the two.  Rank 0 ends up with the
+// dissected lattice and sends it to up to three more ranks; each then
+// wraps and eliminates some of the four boundary sectors, and rank 0
+// combines the Pfaffians into Z.
+// The arithmetic is that of the serial code, so Z.txt is identical to
+// the one isingZToTxt writes; every rank reads the interaction file.
+// The dense eliminations of the combinations and of each sector are not
+// split, so rank 0 holds the largest matrices of the serial run: this
+// saves time, not memory.
+
+#include <mpi.h>
+#include <iostream>
+#include <fstream>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdlib>
+#include "../Z_to_txt/Partition.h"
+
+#define CHUNK (1 << 30)                // bytes per message, below INT_MAX
+
+static int rank, size;
+
+void createDirectory(const std::string &path) {
+    std::string command = "mkdir -p " + path;
+    int status = system(command.c_str());
+    if (status != 0) {
+        std::cerr << "Error creating directory: " << path << std::endl;
+    }
+}
+
+static void sendBuffer(const std::vector<char> &buf, int to)
+{
+  long long n = buf.size();
+  MPI_Send(&n, 1, MPI_LONG_LONG, to, 0, MPI_COMM_WORLD);
+  for (long long k = 0; k < n; k += CHUNK)
+    MPI_Send(buf.data()+k, (int)std::min((long long)CHUNK, n-k), MPI_CHAR, to, 0,
+             MPI_COMM_WORLD);
+}
+
+static std::vector<char> receiveBuffer(int from)
+{
+  long long n;
+  MPI_Recv(&n, 1, MPI_LONG_LONG, from, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+  std::vector<char> buf(n);
+  for (long long k = 0; k < n; k += CHUNK)
+    MPI_Recv(buf.data()+k, (int)std::min((long long)CHUNK, n-k), MPI_CHAR, from, 0,
+             MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+  return buf;
+}
+
+// Dissects the sublattice with ranks first..last-1; returns the node on
+// rank first and NULL on the others.
+static FINDmatrix* dissect(Sample* S, int Lx, int Ly, int offx, int offy,
+                           int first, int last)
+{
+  if (last - first == 1 || (Lx == 1 && Ly == 1))
+    return (rank == first) ? new FINDmatrix(Lx, Ly, offx, offy, S) : NULL;
+
+  int mid = first + (last-first)/2;
+  FINDmatrix* A = NULL;
+  FINDmatrix* B = NULL;
+  if (Lx > Ly)                         // vertical separator, as initialize()
+  {
+    if (rank < mid)
+      A = dissect(S, Lx/2, Ly, offx, offy, first, mid);
+    else
+      B = dissect(S, Lx-Lx/2, Ly, offx+Lx/2, offy, mid, last);
+  }
+  else                                 // horizontal separator
+  {
+    if (rank < mid)
+      A = dissect(S, Lx, Ly/2, offx, offy, first, mid);
+    else
+      B = dissect(S, Lx, Ly-Ly/2, offx, offy+Ly/2, mid, last);
+  }
+
+  if (rank == mid)
+  {
+    std::vector<char> buf;
+    B->pack(buf);
+    delete B;
+    sendBuffer(buf, first);
+  }
+  if (rank != first)
+    return NULL;
+  std::vector<char> buf = receiveBuffer(mid);
+  const char* p = buf.data();
+  B = new FINDmatrix(p, S);
+  buf.clear();
+  buf.shrink_to_fit();
+  return new FINDmatrix(Lx, Ly, offx, offy, S, A, B);
+}
+
+int main(int argc, char* argv[])
+{
+  MPI_Init(&argc, &argv);
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  MPI_Comm_size(MPI_COMM_WORLD, &size);
+
+  if (argc < 8 || argc > 9)
+  {
+    if (rank == 0)
+    {
+      std::cout << "FIND2DIsing distributed: partition functions of one sample, dissected on all MPI ranks\n";
+      std::cout << "usage: mpirun -np N " << argv[0] << " bitsOfPrecision Lx Ly seed probability temperature directory [std dev] \n";
+    }
+    MPI_Finalize();
+    return 1;
+  }
+
+  int prec = atoi(argv[1]);
+  int x   = atoi(argv[2]);
+  int y   = atoi(argv[3]);
+  int seed = atoi(argv[4]);
+  double prob = atof(argv[5]);
+  double T_frac = atof(argv[6]);
+
+  bool useGaussian = (argc == 9);
+  double stddev = 0.0;
+  dataType T_nish(1.0, prec);          // see Z_to_txt/main.cc
+  if (prob!=0){
+    T_nish = 2/std::log((1-prob)/prob);
+  }
+  if (useGaussian) {
+    T_nish = 1.0;
+    stddev = std::atof(argv[8]);
+    if (stddev <= 0) {
+      if (rank == 0)
+        std::cerr << "Error: Std dev must be positive.\n";
+      MPI_Finalize();
+      return 1;
+    }
+  }
+  dataType T = T_frac*T_nish;
+
+  std::string directory = argv[7];
+  std::string input =   directory + "/interactionsGaussian/" +
+                            std::to_string(prob) + "/" +
+                            std::to_string(x) + "/" +
+                            std::to_string(y) + "/" +
+                            std::to_string(stddev) + "/" +
+                            std::to_string(seed) + "/interaction_lattice.txt";
+  if (!std::ifstream(input.c_str()))
+  {
+    if (rank == 0)
+      std::cerr << "Error: missing " << input << "\n";
+    MPI_Finalize();
+    return 1;
+  }
+  Sample S(input, T);
+
+  double t0 = MPI_Wtime();
+  FINDmatrix* X = dissect(&S, x, y, 0, 0, 0, size);
+  double t1 = MPI_Wtime();
+
+  // sector k (signs as in combineSectors) is eliminated on rank k % nr
+  int nr = std::min(size, 4);
+  std::vector<char> buf;
+  if (rank == 0)
+  {
+    X->pack(buf);
+    for (int r = 1; r < nr; r++)
+      sendBuffer(buf, r);
+  }
+  else if (rank < nr)
+  {
+    buf = receiveBuffer(0);
+    const char* p = buf.data();
+    X = new FINDmatrix(p, &S);
+  }
+  buf.clear();
+  buf.shrink_to_fit();
+
+  dataType yk[4] = {dataType(0, prec), dataType(0, prec),
+                    dataType(0, prec), dataType(0, prec)};
+  if (rank < nr)
+  {
+    for (int k = 0; k < 2; k++)        // wrap sign +1 for k = 0, 2
+    {                                  // .. and -1 for k = 1, 3
+      if (k % nr != rank && (k+2) % nr != rank)
+        continue;
+      FINDmatrix Y(*X);
+      Y.wrapHorz(k == 0 ? 1 : -1);
+      if (k % nr == rank)
+      {
+        FINDmatrix Yv(Y);
+        yk[k] = Yv.Zvert(1);
+      }
+      if ((k+2) % nr == rank)
+        yk[k+2] = Y.Zvert(-1);
+    }
+    delete X;
+  }
+
+  for (int k = 0; k < 4; k++)
+  {
+    int owner = k % nr;
+    if (owner == 0)
+      continue;
+    if (rank == owner)
+    {
+      std::vector<char> ybuf;
+      FINDmatrix::pack(ybuf, yk[k]);
+      sendBuffer(ybuf, 0);
+    }
+    else if (rank == 0)
+    {
+      std::vector<char> ybuf = receiveBuffer(owner);
+      const char* p = ybuf.data();
+      FINDmatrix::unpack(p, yk[k]);
+    }
+  }
+  double t2 = MPI_Wtime();
+
+  if (rank == 0)
+  {
+    dataType Z[4];
+    combineSectors(S, yk, Z);
+
+    std::string outputDir =   directory + "/resultsGaussian/" +
+                              std::to_string(prob) + "/" +
+                              std::to_string(stddev) + "/" +
+                              std::to_string(x) + "/" +
+                              std::to_string(y) + "/" +
+                              std::to_string(T_frac) + "/" +
+                              std::to_string(prec) + "/" +
+                              std::to_string(seed);
+    createDirectory(outputDir);
+    writePartition(Z, outputDir + "/Z.txt", prec);
+    std::cout << "dissection " << t1-t0 << " s, sectors " << t2-t1 << " s on "
+              << size << " ranks\n";
+    std::cout << "Z results written to: " << outputDir << std::endl;
+  }
+  MPI_Finalize();
+  return 0;
+}
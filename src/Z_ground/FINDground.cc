@@ -0,0 +1,595 @@
+// FINDground.cc
+//
+// Mirrors FINDmatrix.cc operation by operation; see there for the
+// orderings and for the diagrams of the cross operation.
+
+#include "FINDground.h"
+#include "../Z_to_txt/Gauge.h"
+#include <cmath>
+#include <cstdlib>
+#include <algorithm>
+#include <utility>
+#include <iostream>
+#include <climits>
+
+GroundSample::GroundSample(const std::string &filename)
+: Lx(0), Ly(0), unit(0), sumJ(0)
+{
+  std::vector<std::string> bonds;
+  if (!readCouplings(filename, Lx, Ly, bonds))
+  {
+    message = "cannot read " + filename;
+    return;
+  }
+  std::vector<double> J(bonds.size(), 0);
+  for (size_t b = 0; b < bonds.size(); b++)
+    if (!bonds[b].empty())
+    {
+      J[b] = strtod(bonds[b].c_str(), NULL);
+      sumJ += J[b];
+      if (J[b] != 0 && (unit == 0 || std::fabs(J[b]) < unit))
+        unit = std::fabs(J[b]);
+    }
+  if (unit == 0)
+    unit = 1;
+  xexp.assign(Lx*Ly, 0);
+  yexp.assign(Lx*Ly, 0);
+  xset.assign(Lx*Ly, false);
+  yset.assign(Lx*Ly, false);
+  for (int y = 0; y < Ly; y++)
+    for (int x = 0; x < Lx; x++)
+      for (int d = 0; d < 2; d++)
+      {
+        int b = 2*(y*Lx + x) + d;
+        double e = J[b]/unit;
+        if (std::fabs(e - std::round(e)) > 1e-9 * std::max(1.0, std::fabs(e)))
+        {
+          message = "couplings are not integer multiples of " +
+                    std::to_string(unit) + ": " + bonds[b];
+          return;
+        }
+        (d == 0 ? xexp : yexp)[x*Ly + y] = (int)std::lround(e);
+        (d == 0 ? xset : yset)[x*Ly + y] = !bonds[b].empty();
+      }
+}
+
+bool GroundSample::good()
+{
+  return Lx > 0 && message.empty();
+}
+
+const std::string &GroundSample::error()
+{
+  return message;
+}
+
+int GroundSample::get_Lx()
+{
+  return Lx;
+}
+
+int GroundSample::get_Ly()
+{
+  return Ly;
+}
+
+double GroundSample::get_unit()
+{
+  return unit;
+}
+
+double GroundSample::get_sumJ()
+{
+  return sumJ;
+}
+
+// A sector differs from the ground state of all sectors by at most a
+// domain wall along a column (E bonds) and one along a row (S bonds).
+int GroundSample::gap()
+{
+  long column = -1, row = -1;
+  for (int x = 0; x < Lx; x++)
+  {
+    long sum = 0;
+    for (int y = 0; y < Ly; y++)
+      sum += std::abs(xexp[x*Ly + y]);
+    if (column < 0 || sum < column)
+      column = sum;
+  }
+  for (int y = 0; y < Ly; y++)
+  {
+    long sum = 0;
+    for (int x = 0; x < Lx; x++)
+      sum += std::abs(yexp[x*Ly + y]);
+    if (row < 0 || sum < row)
+      row = sum;
+  }
+  return column + row;
+}
+
+bool GroundSample::get_exponent(int x, int y, Dir dir, int &e)
+{
+  const std::vector<int> &exps = (dir == E) ? xexp : yexp;
+  const std::vector<bool> &set = (dir == E) ? xset : yset;
+  e = exps[x*Ly + y];
+  return set[x*Ly + y];
+}
+
+// absent bonds have weight zero, as in Sample
+Laurent GroundSample::weight(const std::vector<int> &e,
+                             const std::vector<bool> &set, int x, int y)
+{
+  return set[x*Ly + y] ? Laurent(1, e[x*Ly + y]) : Laurent();
+}
+
+// as Sample::get_p_bond
+Laurent GroundSample::get_p_bond(int px, int py, Dir dir)
+{
+  switch(dir)
+  {
+    case N:
+      return -weight(xexp, xset, px, py);
+    case E:
+      return weight(yexp, yset, px+1, py);
+    case S:
+      return weight(xexp, xset, px, py+1);
+    case W:
+      return -weight(yexp, yset, px, py);
+    default:
+      return Laurent();
+  }
+}
+
+FINDground::FINDground(GroundSample* _S)
+: offx(0), offy(0), S(_S)
+{
+  Lx = S->get_Lx();
+  Ly = S->get_Ly();
+  initialize();
+}
+
+FINDground::FINDground(FINDground& other)
+: Lx(other.Lx), Ly(other.Ly), offx(other.offx), offy(other.offy),
+  mtx_L(other.mtx_L), S(other.S), A(NULL), B(NULL), prefactor(other.prefactor),
+  lost(other.lost)
+{
+  copy_matrix(other.mat,&mat,mtx_L);
+}
+
+FINDground::FINDground(int _Lx, int _Ly, int _offx, int _offy, GroundSample* _S)
+: Lx(_Lx), Ly(_Ly), offx(_offx), offy(_offy), S(_S)
+{
+  initialize();
+}
+
+void FINDground::initialize()
+{
+  lost = false;
+  prefactor = Laurent(1, 0);
+  if (Lx == 1 && Ly == 1)              // Base case: Kasteleyn city
+  {
+    A = NULL;
+    B = NULL;
+    mtx_L = 4;
+    allocate_matrix(&mat,mtx_L);
+    mat[0][0] = mat[0][1] = mat[0][2] = Laurent(1, 0);
+    mat[1][0] = mat[1][1] = Laurent(1, 0);
+    mat[2][0] = Laurent(1, 0);
+    return;
+  }
+  if (Lx > Ly)                         // Recursion with a vertical separator
+  {
+    A = new FINDground(Lx/2,Ly,offx,offy,S);
+    B = new FINDground(Lx-Lx/2,Ly,offx+Lx/2,offy,S);
+    prefactor = combine_vertical();
+  }
+  else                                 // Recursion with a horizontal separator
+  {
+    A = new FINDground(Lx,Ly/2,offx,offy,S);
+    B = new FINDground(Lx,Ly-Ly/2,offx,offy+Ly/2,S);
+    prefactor = combine_horizontal();
+  }
+  lost |= A->lost || B->lost;
+  delete A; A = NULL;
+  delete B; B = NULL;
+}
+
+FINDground::~FINDground()
+{
+  if (A != NULL)
+    delete A;
+  if (B != NULL)
+    delete B;
+  if (mat != NULL)
+    delete_matrix(&mat,mtx_L);
+  mat = NULL;
+}
+
+bool FINDground::failed()
+{
+  return lost;
+}
+
+void FINDground::allocate_matrix(Laurent*** mtx, int L)
+{
+  (*mtx) = new Laurent*[L-1];
+  for (int i=0; i<L-1; i++)
+    (*mtx)[i] = new Laurent[L-1-i];
+}
+
+void FINDground::copy_matrix(Laurent** mtx1, Laurent*** mtx2, int L)
+{
+  (*mtx2) = new Laurent*[L-1];
+  for (int i=0; i<L-1; i++)
+  {
+    (*mtx2)[i] = new Laurent[L-1-i];
+    for (int j=0; j<L-1-i; j++)
+      (*mtx2)[i][j] = mtx1[i][j];
+  }
+}
+
+void FINDground::delete_matrix(Laurent*** mtx, int L)
+{
+  for (int i=0; i<L-1; i++)
+    delete[] (*mtx)[i];
+  delete[] (*mtx);
+}
+
+// presume wrapHorz already done
+Laurent FINDground::Zvert(int vsep)
+{
+  for (int i=0; i<Ly; i++)
+    mat[i][2*Ly-2*i-2] -= Laurent(vsep, 0) * S->get_p_bond(offx,offy+i,W);
+  return prefactor * Pf_eliminate(Ly);
+}
+
+void FINDground::wrapHorz(int hsep)
+{
+  for (int i=0; i<Lx; i++)
+    mat[i][2*Lx+Ly-2*i-2] += Laurent(hsep, 0) * S->get_p_bond(offx+i,offy,N);
+  int* perm = new int[mtx_L];
+  for (int i = 0; i < mtx_L; ++i)
+    perm[i] = i;
+  int xchgfactor = 1;
+  for (int i = 0; i < Ly/2; ++i) {
+    std::swap(perm[Lx+i], perm[Lx+Ly-1-i]);
+    xchgfactor = -xchgfactor;
+  }
+  for (int i = 0; i < Lx/2; ++i) {
+    std::swap(perm[Lx+Ly+i], perm[Lx+Ly+Lx-1-i]);
+    xchgfactor = -xchgfactor;
+  }
+  for (int i = 0; i < (Lx+Ly)/2; ++i) {
+    std::swap(perm[Lx+i], perm[Lx+Ly+Lx-1-i]);
+    xchgfactor = -xchgfactor;
+  }
+  permute(perm);
+  delete[] perm;
+  prefactor = prefactor * Pf_eliminate(Lx) * Laurent(xchgfactor, 0);
+}
+
+Laurent FINDground::combine_vertical()
+{
+  mtx_L = A->mtx_L + B->mtx_L;
+  allocate_matrix(&mat,mtx_L);
+
+  int* Aordering = new int[A->mtx_L];
+  int* Bordering = new int[B->mtx_L];
+  int counter = 0;
+  for (int i=0; i<Ly; i++)             // interleaving part
+  {
+    Bordering[2*B->Lx+2*Ly-1-i] = counter++;
+    Aordering[A->Lx+i] = counter++;
+    mat[counter-2][0] = -S->get_p_bond(B->offx,offy+i,W);
+  }
+  for (int i=0; i<A->Lx; i++)
+    Aordering[i] = counter++;
+  for (int i=0; i<2*B->Lx+Ly; i++)
+    Bordering[i] = counter++;
+  for (int i=0; i<A->Lx+Ly; i++)
+    Aordering[A->Lx+Ly+i] = counter++;
+
+  fill_mat(A,Aordering);
+  fill_mat(B,Bordering);
+
+  delete[] Aordering;
+  delete[] Bordering;
+
+  return A->prefactor * B->prefactor * Pf_eliminate(Ly);
+}
+
+Laurent FINDground::combine_horizontal()
+{
+  mtx_L = A->mtx_L + B->mtx_L;
+  allocate_matrix(&mat,mtx_L);
+
+  int* Aordering = new int[A->mtx_L];
+  int* Bordering = new int[B->mtx_L];
+  int counter = 0;
+  for (int i=0; i<Lx; i++)             // interleaving part
+  {
+    Aordering[Lx+A->Ly+i] = counter++;
+    Bordering[Lx-1-i] = counter++;
+    mat[counter-2][0] = S->get_p_bond(offx+Lx-1-i,B->offy,N);
+  }
+  for (int i=0; i<Lx+A->Ly; i++)
+    Aordering[i] = counter++;
+  for (int i=0; i<Lx+2*B->Ly; i++)
+    Bordering[Lx+i] = counter++;
+  for (int i=0; i<A->Ly; i++)
+    Aordering[2*Lx+A->Ly+i] = counter++;
+
+  fill_mat(A,Aordering);
+  fill_mat(B,Bordering);
+
+  delete[] Aordering;
+  delete[] Bordering;
+
+  return A->prefactor * B->prefactor * Pf_eliminate(Lx);
+}
+
+// the submatrices are deleted afterwards, so their series are moved
+void FINDground::fill_mat(FINDground* from, int* ordering)
+{
+  for (int i=0; i<from->mtx_L; i++)
+  {
+    int newi = ordering[i];
+    for (int j=0; j<from->mtx_L-1-i; j++)
+    {
+      int newj = ordering[j+1+i];
+      if (newi > newj)
+        mat[newj][newi-newj-1] = -from->mat[i][j];
+      else
+        std::swap(mat[newi][newj-newi-1], from->mat[i][j]);
+    }
+  }
+}
+
+// Semi-pivoted elimination as in FINDmatrix::Pf_eliminate, with the
+// magnitude of an entry taken as T -> 0 (Laurent::dominates).  A zero
+// pivot is exact here; FINDmatrix proceeds on its rounding error.
+Laurent FINDground::Pf_eliminate(int numEvenRows)
+{
+  int pivotfactor = 1;
+  for (int i = 0; i < numEvenRows*2; i += 2)
+  {
+    int pivotrow = 0;
+    for (int j = 1; j < numEvenRows*2-i-1; j++)
+      if (mat[i][j].dominates(mat[i][pivotrow]))
+        pivotrow = j;
+    if (pivotrow != 0)
+    {
+      pivotfactor = -pivotfactor;
+      pivotrows(i, pivotrow);
+    }
+    if (!mat[i][0].known())
+    {
+      if (mat[i][0].is_zero())
+      {
+        std::cerr << "zero superdiag error\n";
+        exit(1);
+      }
+      lost = true;                     // pivot below the window: carry on
+      mat[i][0] = Laurent(1, 0);       // .. with a placeholder
+    }
+    for (int j = 1; j < mtx_L - i - 1; j++)
+      if (!mat[i][j].is_zero())
+        crossOp(i, j);
+  }
+
+  Laurent superDiagProd(pivotfactor, 0);
+  for (int i = 0; i < numEvenRows * 2; i += 2)
+    superDiagProd = superDiagProd * mat[i][0];
+
+  if (2*numEvenRows < mtx_L)
+  {
+    for (int i=0; i<2*numEvenRows; i++)
+      delete[] mat[i];
+    mtx_L -= 2*numEvenRows;
+    Laurent** newmat = new Laurent*[mtx_L-1];
+    for (int i=0; i<mtx_L-1; i++)
+      newmat[i] = mat[i+2*numEvenRows];
+    delete[] mat;
+    mat = newmat;
+  }
+  return superDiagProd;
+}
+
+// as FINDmatrix::permute: the new entry (a,b) is the old entry
+// (perm[a],perm[b]), moved along the cycles of the upper triangle
+void FINDground::permute(const int* perm)
+{
+  std::vector<long> start(mtx_L);      // linear index of (a,a+1)
+  for (int a = 0, n = 0; a < mtx_L; n += mtx_L-1-a, a++)
+    start[a] = n;
+  std::vector<bool> done((long)mtx_L*(mtx_L-1)/2, false);
+  for (int a = 0; a < mtx_L-1; a++)
+    for (int b = a+1; b < mtx_L; b++)
+    {
+      if (done[start[a]+b-a-1])
+        continue;
+      int ca = a, cb = b;              // cycle through (a,b)
+      while (true)
+      {
+        done[start[ca]+cb-ca-1] = true;
+        int sa = std::min(perm[ca], perm[cb]), sb = std::max(perm[ca], perm[cb]);
+        if (sa == a && sb == b)
+          break;
+        std::swap(mat[ca][cb-ca-1], mat[sa][sb-sa-1]);
+        if (perm[ca] > perm[cb])
+          mat[ca][cb-ca-1] = -mat[ca][cb-ca-1];
+        ca = sa;
+        cb = sb;
+      }
+      if (perm[ca] > perm[cb])
+        mat[ca][cb-ca-1] = -mat[ca][cb-ca-1];
+    }
+}
+
+// same as FINDmatrix::pivotrows
+void FINDground::pivotrows(int i, int j)
+{
+  // i) - swap x,y
+  std::swap(mat[i][0], mat[i][j]);
+
+  // ii) - swap 1,c, with negation
+  for (int k = 0; k < j-1; ++k)
+  {
+    Laurent tmp = -mat[i+1][k];
+    mat[i+1][k] = -mat[i+2+k][j-k-2];
+    mat[i+2+k][j-k-2] = tmp;
+  }
+
+  // iii) negate intersection
+  mat[i+1][j-1] = -mat[i+1][j-1];
+
+  // iv) swap end of row i with end of row i+j
+  for (int k = 0; j + k < mtx_L-i-2; k++)
+    std::swap(mat[i+1][j+k], mat[i+j+1][k]);
+}
+
+void FINDground::crossOp(int i, int j)
+{
+  Laurent scaleFactor = -mat[i][j]/mat[i][0];
+  Laurent negScaleFactor = -scaleFactor;
+  mat[i][j] = Laurent();
+  for (int k = 0; k < j - 1; ++k)
+    mat[i+2+k][j-k-2].addmul(negScaleFactor, mat[i+1][k]);
+  for (int k = 0; j + k < mtx_L-i-2; k++)
+    mat[i+j+1][k].addmul(scaleFactor, mat[i+1][j+k]);
+}
+
+bool findGroundStates(GroundSample* S, Laurent Z[4])
+{
+  FINDground X(S);
+
+  FINDground Ypls1(X);
+  FINDground Yneg1(X);
+
+  Ypls1.wrapHorz(1);
+  Yneg1.wrapHorz(-1);
+
+  FINDground Ypls2(Ypls1);
+  FINDground Yneg2(Yneg1);
+
+  Laurent y[4] = {Ypls1.Zvert(1), Yneg1.Zvert(1), Ypls2.Zvert(-1), Yneg2.Zvert(-1)};
+  static const int sign[4][4] = {{ 1,  1,  1,  1},   // ZPP
+                                 {-1, -1,  1,  1},   // ZPA
+                                 {-1,  1, -1,  1},   // ZAP
+                                 {-1,  1,  1, -1}};  // ZAA
+
+  bool ok = !(X.failed() || Ypls1.failed() || Yneg1.failed() ||
+              Ypls2.failed() || Yneg2.failed());
+  for (int s = 0; s < 4; s++)
+  {
+    Z[s] = Laurent();
+    for (int k = 0; k < 4; k++)
+      Z[s] += Laurent(sign[s][k], 0) * y[k];
+    Z[s] = Z[s] / Laurent(2, 0);
+    ok = ok && Z[s].known();
+  }
+  return ok;
+}
+
+// Rows of the narrow width w run along the long direction; a bond costs
+// its exponent when its spins differ, or agree if the sector flips it
+// (the wrapping bonds of an antiperiodic direction).  The state of the
+// first row is fixed in turn, and the rows after it are added one at a
+// time keeping, per state of the last row, the least cost and the
+// number of configurations that reach it.
+bool transferGroundStates(GroundSample* S, int order[4], mpz_class g[4])
+{
+  int Lx = S->get_Lx(), Ly = S->get_Ly();
+  bool rowsAlongY = Lx <= 2;           // else Ly <= 2: rows along x
+  int w = rowsAlongY ? Lx : Ly;
+  int n = rowsAlongY ? Ly : Lx;
+  Dir inRow = rowsAlongY ? Dir::E : Dir::S;
+  Dir across = rowsAlongY ? Dir::S : Dir::E;
+  // exponent of the bond at position i of row r, in or across rows
+  std::vector<int> inExp(w*n), acrossExp(w*n);
+  for (int r = 0; r < n; r++)
+    for (int i = 0; i < w; i++)
+    {
+      int x = rowsAlongY ? i : r, y = rowsAlongY ? r : i;
+      if (!S->get_exponent(x, y, inRow, inExp[r*w + i]) ||
+          !S->get_exponent(x, y, across, acrossExp[r*w + i]))
+        return false;
+    }
+  const long unreached = LONG_MAX;
+  int states = 1 << w;
+  for (int s = 0; s < 4; s++)
+  {
+    // s = 2*(x antiperiodic) + (y antiperiodic), the order of Sector
+    bool flipIn = rowsAlongY ? (s & 2) : (s & 1);
+    bool flipAcross = rowsAlongY ? (s & 1) : (s & 2);
+    auto spin = [](int state, int i) { return (state >> i) & 1; };
+    auto rowCost = [&](int r, int state) {
+      long c = 0;
+      for (int i = 0; i < w; i++)
+      {
+        bool differ = spin(state, i) != spin(state, (i+1) % w);
+        if (differ != (flipIn && i == w-1))
+          c += inExp[r*w + i];
+      }
+      return c;
+    };
+    auto acrossCost = [&](int r, int from, int to) {
+      long c = 0;
+      for (int i = 0; i < w; i++)
+      {
+        bool differ = spin(from, i) != spin(to, i);
+        if (differ != (flipAcross && r == n-1))
+          c += acrossExp[r*w + i];
+      }
+      return c;
+    };
+    long best = unreached;
+    mpz_class count = 0;
+    for (int first = 0; first < states; first++)
+    {
+      std::vector<long> cost(states, unreached);
+      std::vector<mpz_class> ways(states);
+      cost[first] = rowCost(0, first);
+      ways[first] = 1;
+      for (int r = 1; r < n; r++)
+      {
+        std::vector<long> next(states, unreached);
+        std::vector<mpz_class> nextWays(states);
+        for (int from = 0; from < states; from++)
+        {
+          if (cost[from] == unreached)
+            continue;
+          for (int to = 0; to < states; to++)
+          {
+            long c = cost[from] + acrossCost(r-1, from, to) + rowCost(r, to);
+            if (c < next[to])
+            {
+              next[to] = c;
+              nextWays[to] = ways[from];
+            }
+            else if (c == next[to])
+              nextWays[to] += ways[from];
+          }
+        }
+        cost.swap(next);
+        ways.swap(nextWays);
+      }
+      for (int last = 0; last < states; last++)
+      {
+        if (cost[last] == unreached)
+          continue;
+        long c = cost[last] + acrossCost(n-1, last, first);
+        if (c < best)
+        {
+          best = c;
+          count = ways[last];
+        }
+        else if (c == best)
+          count += ways[last];
+      }
+    }
+    order[s] = (int)best;
+    g[s] = count;
+  }
+  return true;
+}
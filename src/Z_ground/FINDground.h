@@ -0,0 +1,109 @@
+// FINDground.h
+//
+// Zero-temperature variant of FINDmatrix: runs the nested dissection on
+// truncated Laurent series in x = exp(-2u/T) (Laurent.h) instead of
+// numbers at one temperature.  Couplings must be integer multiples of a
+// unit u, so that every weight exp(-2J/T) is the monomial x^(J/u).  The
+// Pfaffians, and the four sector partition functions, are then series
+//   Z_s = exp(sum J/T) (g_s x^m_s + ...),
+// whose leading term gives the ground-state energy E_s = 2u m_s - sum J
+// and its degeneracy g_s directly, at the cost of a few modular products
+// per matrix entry and order kept.  g_s is known modulo the prime of the
+// run; findGroundStates is repeated for several primes to recover it.
+//
+// Pivoting is by leading order.  The sector combination cancels the
+// leading orders of the four Pfaffians whenever the sectors differ in
+// energy; the window of orders kept must cover this gap, which is at
+// most the summed |J|/u of one row plus one column (GroundSample::gap),
+// and the orders that cancel within the elimination.  A result whose
+// leading term was lost to the window is reported as failed instead of
+// being returned wrong.  So is a separator block that is singular to all
+// orders, where FINDmatrix only proceeds on the rounding error of the
+// zero pivot.  Lattices of width 1 or 2 have such blocks in most
+// samples and are solved by a transfer matrix instead.
+
+#ifndef FIND_GROUND_H
+#define FIND_GROUND_H
+
+#include "Laurent.h"
+#include "../Z_to_txt/dataType.h"
+#include <string>
+#include <vector>
+
+// Couplings of an interaction file as exponents of x.
+class GroundSample
+{
+  public:
+    GroundSample(const std::string &filename);
+    bool good();                       // read, and couplings commensurate
+    const std::string &error();
+    int get_Lx();
+    int get_Ly();
+    double get_unit();                 // u
+    double get_sumJ();                 // sum of J over all bonds
+    int gap();                         // bound on sector gaps, in orders
+    bool get_exponent(int x, int y, Dir dir, int &e);
+				       // J/u of the E or S bond of (x,y);
+				       // .. false if the bond is absent
+    Laurent get_p_bond(int px, int py, Dir dir);
+  private:
+    int Lx, Ly;
+    double unit, sumJ;
+    std::string message;
+    std::vector<int> xexp, yexp;       // J/u of the E and S bond of (x,y)
+    std::vector<bool> xset, yset;      // bond present
+    Laurent weight(const std::vector<int> &e, const std::vector<bool> &set,
+                   int x, int y);
+};
+
+class FINDground
+{
+  public:
+    FINDground(GroundSample* S);
+    FINDground(int _Lx, int _Ly, int _offx, int _offy, GroundSample* _S);
+    FINDground(FINDground& other);     // copy constructor (does not copy
+				       // .. submatrices)
+    ~FINDground();
+    Laurent Zvert(int vsep);
+    void wrapHorz(int hsep);
+    bool failed();                     // a pivot was lost to the window
+
+  private:
+    int Lx, Ly;
+    int offx, offy;
+    int mtx_L;
+    GroundSample* S;
+    FINDground* A;
+    FINDground* B;
+    Laurent** mat;
+    Laurent   prefactor;
+    bool      lost;
+
+    void initialize();
+
+    Laurent combine_vertical();
+    Laurent combine_horizontal();
+    Laurent Pf_eliminate(int numEvenRows);
+    void permute(const int* perm);
+    void pivotrows(int i, int j);
+    void crossOp(int i, int j);
+    void fill_mat(FINDground* from, int* ordering);
+    void allocate_matrix(Laurent*** mtx, int L);
+    void copy_matrix(Laurent** mtx1, Laurent*** mtx2, int L);
+    void delete_matrix(Laurent*** mtx, int L);
+};
+
+// The four sector partition functions (in the order of Sector) without
+// the factor exp(sum J/T), modulo the current prime of Laurent.  Returns
+// false if any leading term was lost.
+bool findGroundStates(GroundSample* S, Laurent Z[4]);
+
+// Leading order m_s and exact degeneracy g_s of the four sectors for
+// lattices with Lx or Ly at most 2.  Their bonds run in parallel between
+// the same two spins, and the separator blocks of the dissection are
+// then singular to all orders in most samples.  A transfer matrix over
+// the 2^w spin states of a row of the narrow width w gives the same
+// numbers exactly.  Returns false if a bond is absent.
+bool transferGroundStates(GroundSample* S, int order[4], mpz_class g[4]);
+
+#endif // FIND_GROUND_H
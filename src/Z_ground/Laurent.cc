@@ -0,0 +1,268 @@
+// Laurent.cc
+//
+// See Laurent.h.  A series with hi == LAURENT_EXACT stores its terms up
+// to the last nonzero one; otherwise c holds exactly the hi-lo known
+// terms.  The exact zero is the series without terms and error.
+
+#include "Laurent.h"
+#include <algorithm>
+
+#define M61 ((uint64_t(1) << 61) - 1)
+
+// the eight largest primes 2^61 - c
+static const uint64_t primeOffset[LAURENT_PRIMES] =
+  {1, 31, 45, 229, 259, 283, 339, 391};
+
+int Laurent::window = 32;
+uint64_t Laurent::pc = 1;
+uint64_t Laurent::p = (uint64_t(1) << 61) - 1;
+
+void Laurent::set_window(int orders)
+{
+  window = orders;
+}
+
+void Laurent::set_prime(int i)
+{
+  pc = primeOffset[i];
+  p = prime(i);
+}
+
+uint64_t Laurent::prime(int i)
+{
+  return (uint64_t(1) << 61) - primeOffset[i];
+}
+
+// x mod p, folding the high bits with 2^61 = pc (mod p)
+uint64_t Laurent::reduce(Laurent::uint128 x)
+{
+  x = (x >> 61) * pc + (uint64_t(x) & M61);
+  uint64_t y = uint64_t(x >> 61) * pc + (uint64_t(x) & M61);
+  while (y >= p)
+    y -= p;
+  return y;
+}
+
+uint64_t Laurent::mul(uint64_t a, uint64_t b)
+{
+  return reduce((uint128)a * b);
+}
+
+// a^(p-2)
+uint64_t Laurent::inverse(uint64_t a)
+{
+  uint64_t r = 1, e = p - 2;
+  for (; e; e >>= 1, a = mul(a, a))
+    if (e & 1)
+      r = mul(r, a);
+  return r;
+}
+
+Laurent::Laurent()
+: lo(0), hi(LAURENT_EXACT)
+{
+}
+
+Laurent::Laurent(long _c, int e)
+: lo(e), hi(LAURENT_EXACT)
+{
+  if (_c != 0)
+    c.push_back(_c > 0 ? uint64_t(_c) % p : p - uint64_t(-_c) % p);
+}
+
+bool Laurent::is_zero() const
+{
+  return c.empty() && hi == LAURENT_EXACT;
+}
+
+bool Laurent::known() const
+{
+  return !c.empty();
+}
+
+int Laurent::order() const
+{
+  return lo;
+}
+
+uint64_t Laurent::leading() const
+{
+  return c.empty() ? 0 : c[0];
+}
+
+// Any nonzero pivot is exact; the lowest order is taken for the sake of
+// the window.
+bool Laurent::dominates(const Laurent &other) const
+{
+  return !c.empty() && (other.c.empty() || lo < other.lo);
+}
+
+uint64_t Laurent::coef(int k) const
+{
+  return k < lo || k - lo >= (int)c.size() ? 0 : c[k-lo];
+}
+
+// c holds the candidate terms of orders lo..  Drops cancelled leading
+// terms, then cuts the series to the window above its new leading term.
+void Laurent::normalize()
+{
+  size_t first = 0;
+  while (first < c.size() && c[first] == 0)
+    first++;
+  if (first == c.size())
+  {
+    c.clear();
+    if (hi != LAURENT_EXACT)
+      lo = hi;                         // nothing known below O(x^hi)
+    return;
+  }
+  c.erase(c.begin(), c.begin() + first);
+  lo += first;
+  if ((int)c.size() > window)
+  {
+    c.resize(window);
+    hi = lo + window;
+  }
+  if (hi == LAURENT_EXACT)
+    while (c.back() == 0)
+      c.pop_back();
+}
+
+Laurent Laurent::operator-() const
+{
+  Laurent r(*this);
+  for (size_t k = 0; k < r.c.size(); k++)
+    if (r.c[k] != 0)
+      r.c[k] = p - r.c[k];
+  return r;
+}
+
+Laurent& Laurent::operator+=(const Laurent &other)
+{
+  if (other.is_zero())
+    return *this;
+  if (is_zero())
+    return *this = other;
+  int newlo = std::min(c.empty() ? hi : lo, other.c.empty() ? other.hi : other.lo);
+  int newhi = std::min(hi, other.hi);
+  int end = newhi;
+  if (newhi == LAURENT_EXACT)
+    end = std::max(lo + (int)c.size(), other.lo + (int)other.c.size());
+  if (end > newlo + window + 1)        // one spare order for cancellation
+    end = newhi = newlo + window + 1;
+  std::vector<uint64_t> sum(std::max(end - newlo, 0));
+  for (int k = newlo; k < end; k++)
+  {
+    uint64_t s = coef(k) + other.coef(k);
+    sum[k-newlo] = s >= p ? s - p : s;
+  }
+  lo = newlo;
+  hi = newhi;
+  c.swap(sum);
+  normalize();
+  return *this;
+}
+
+Laurent& Laurent::operator-=(const Laurent &other)
+{
+  return *this += -other;
+}
+
+Laurent operator*(const Laurent &a, const Laurent &b)
+{
+  Laurent r;
+  r.addmul(a, b);
+  return r;
+}
+
+// Only the orders of a*b inside the window of the sum are formed.  The
+// products are summed in 128 bits and reduced once per 64 of them.
+void Laurent::addmul(const Laurent &a, const Laurent &b)
+{
+  if (a.is_zero() || b.is_zero())
+    return;
+  if (a.c.empty() || b.c.empty())      // adds only an error term
+  {
+    int alo = a.c.empty() ? a.hi : a.lo, blo = b.c.empty() ? b.hi : b.lo;
+    Laurent unknown;
+    unknown.lo = unknown.hi = alo + blo;
+    *this += unknown;
+    return;
+  }
+  int plo = a.lo + b.lo;
+  int phi = LAURENT_EXACT;
+  if (a.hi != LAURENT_EXACT)
+    phi = a.hi + b.lo;
+  if (b.hi != LAURENT_EXACT)
+    phi = std::min(phi, b.hi + a.lo);
+  int newlo = std::min(c.empty() ? hi : lo, plo);
+  if (is_zero())
+    newlo = plo;
+  int newhi = std::min(hi, phi);
+  int end = newhi;
+  if (newhi == LAURENT_EXACT)
+    end = std::max(is_zero() ? plo : lo + (int)c.size(),
+                   plo + (int)a.c.size() + (int)b.c.size() - 1);
+  if (end > newlo + window + 1)        // one spare order for cancellation
+    end = newhi = newlo + window + 1;
+  std::vector<uint64_t> sum(std::max(end - newlo, 0));
+  for (int k = newlo; k < end; k++)
+  {
+    uint64_t s = coef(k);
+    int n = k - plo;                   // a.c[i] * b.c[n-i]
+    int i0 = std::max(0, n - (int)b.c.size() + 1);
+    int i1 = std::min(n, (int)a.c.size() - 1);
+    for (int i = i0; i <= i1; i += 64)
+    {
+      uint128 acc = 0;
+      for (int j = i; j <= i1 && j < i + 64; j++)
+        acc += (uint128)a.c[j] * b.c[n-j];
+      s += reduce(acc);
+      if (s >= p)
+        s -= p;
+    }
+    sum[k-newlo] = s;
+  }
+  lo = newlo;
+  hi = newhi;
+  c.swap(sum);
+  normalize();
+}
+
+// Long division by the leading term of b, which must be known.
+Laurent operator/(const Laurent &a, const Laurent &b)
+{
+  if (a.is_zero())
+    return Laurent();
+  Laurent r;
+  if (a.c.empty())
+  {
+    r.lo = r.hi = a.hi - b.lo;
+    return r;
+  }
+  r.lo = a.lo - b.lo;
+  int n = Laurent::window + 1;
+  if (a.hi != LAURENT_EXACT)
+    n = std::min(n, a.hi - a.lo);
+  if (b.hi != LAURENT_EXACT)
+    n = std::min(n, b.hi - b.lo);
+  bool exact = a.hi == LAURENT_EXACT && b.hi == LAURENT_EXACT &&
+               b.c.size() == 1 && (int)a.c.size() <= n;
+  if (exact)
+    n = a.c.size();
+  r.hi = exact ? LAURENT_EXACT : r.lo + n;
+  r.c.assign(n, 0);
+  uint64_t inv = Laurent::inverse(b.c[0]);
+  for (int k = 0; k < n; k++)
+  {
+    uint64_t num = a.coef(a.lo + k);
+    for (int j = 1; j <= k && j < (int)b.c.size(); j++)
+    {
+      uint64_t t = Laurent::mul(b.c[j], r.c[k-j]);
+      num = num >= t ? num - t : num + Laurent::p - t;
+    }
+    r.c[k] = Laurent::mul(num, inv);
+  }
+  r.normalize();
+  return r;
+}
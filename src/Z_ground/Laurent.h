@@ -0,0 +1,67 @@
+// Laurent.h
+//
+// Truncated Laurent series in x = exp(-2u/T),
+//   sum_{k<n} c[k] x^(lo+k) + O(x^hi),
+// the scalar of the zero-temperature solver (FINDground.h).  As T -> 0
+// the term of lowest order dominates, so series are compared by lo.
+// At most `window` orders above the leading term are kept.  Orders lost
+// when leading terms cancel are tracked in hi, so a value whose leading
+// term is no longer known is detected (known() is false) instead of
+// being returned wrong.
+//
+// The coefficients of the partition functions are integers (numbers of
+// states), but the elimination divides.  Coefficients are therefore
+// computed exactly modulo a prime p = 2^61 - c, so that cancellations
+// are exact; set_prime() selects one of LAURENT_PRIMES such primes, and
+// the caller reconstructs integers from several of them.  A nonzero
+// rational is taken for zero only if p divides it, with probability
+// about 2^-61 per test.
+
+#ifndef LAURENT_H
+#define LAURENT_H
+
+#include <vector>
+#include <climits>
+#include <cstdint>
+
+#define LAURENT_EXACT  INT_MAX         // hi of a series without error term
+#define LAURENT_PRIMES 8
+
+class Laurent
+{
+  public:
+    Laurent();                         // exact zero
+    Laurent(long c, int e);            // exact monomial c x^e
+    static void set_window(int orders);
+    static void set_prime(int i);      // p = prime(i), 0 <= i < LAURENT_PRIMES
+    static uint64_t prime(int i);
+    bool is_zero() const;              // exact zero
+    bool known() const;                // leading term known
+    int order() const;                 // lo, for known values
+    uint64_t leading() const;          // c[0] mod p, for known values
+    bool dominates(const Laurent &other) const;
+				       // larger magnitude as T -> 0
+    Laurent operator-() const;
+    Laurent& operator+=(const Laurent &other);
+    Laurent& operator-=(const Laurent &other);
+    void addmul(const Laurent &a, const Laurent &b);
+				       // += a*b, without the temporary
+    friend Laurent operator*(const Laurent &a, const Laurent &b);
+    friend Laurent operator/(const Laurent &a, const Laurent &b);
+
+  private:
+    __extension__ typedef unsigned __int128 uint128;
+
+    int lo, hi;
+    std::vector<uint64_t> c;           // residues in [0,p)
+    static int window;
+    static uint64_t p, pc;             // p = 2^61 - pc
+
+    uint64_t coef(int k) const;
+    void normalize();
+    static uint64_t mul(uint64_t a, uint64_t b);
+    static uint64_t reduce(uint128 x);
+    static uint64_t inverse(uint64_t a);
+};
+
+#endif // LAURENT_H
@@ -0,0 +1,161 @@
+// main.cc
+// Ground states of the four boundary sectors at T = 0 (see FINDground.h):
+// reads the same interaction file as isingZToTxt and writes ground.txt,
+// one line per sector (in the order of Z.txt) with its name, the
+// ground-state energy E = -sum J s_i s_j and the degeneracy, the number
+// of spin configurations of that energy.
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <cstdlib>
+#include <algorithm>
+#include "FINDground.h"
+
+void createDirectory(const std::string &path) {
+    std::string command = "mkdir -p " + path;
+    int status = system(command.c_str());
+    if (status != 0) {
+        std::cerr << "Error creating directory: " << path << std::endl;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+  // optional leading "--orders n": orders of x initially kept above each
+  // leading term, by default the bound on the sector gap plus 8, and
+  // "--primes n": degeneracies are exact below half the product of n
+  // primes of 61 bits (n = 2: 2^121)
+  int orders = 0, primes = 2;
+  while (argc > 2 && std::string(argv[1]).compare(0, 2, "--") == 0)
+  {
+    std::string option = argv[1];
+    if (option == "--orders")
+      orders = atoi(argv[2]);
+    else if (option == "--primes")
+      primes = atoi(argv[2]);
+    else
+      break;
+    argv[2] = argv[0];
+    argv += 2;
+    argc -= 2;
+  }
+  if (argc < 6 || argc > 7 || primes < 1 || primes > LAURENT_PRIMES)
+  {
+    std::cout << "FIND2DIsing ground: ground-state energies and degeneracies of the boundary sectors of a 2D Ising model\n";
+    std::cout << "usage: " << argv[0] << " [--orders n] [--primes n] Lx Ly seed probability directory [std dev] \n";
+    return 1;
+  }
+
+  int x   = atoi(argv[1]);
+  int y   = atoi(argv[2]);
+  int seed = atoi(argv[3]);
+  double prob = atof(argv[4]);
+  std::string directory = argv[5];
+  double stddev = 0.0;
+  if (argc == 7) {
+    stddev = std::atof(argv[6]);
+    if (stddev <= 0) {
+      std::cerr << "Error: Std dev must be positive.\n";
+      return 1;
+    }
+  }
+
+  std::string input =   directory + "/interactionsGaussian/" +
+                            std::to_string(prob) + "/" +
+                            std::to_string(x) + "/" +
+                            std::to_string(y) + "/" +
+                            std::to_string(stddev) + "/" +
+                            std::to_string(seed) + "/interaction_lattice.txt";
+
+  std::string outputDir =   directory + "/resultsGaussian/" +
+                            std::to_string(prob) + "/" +
+                            std::to_string(stddev) + "/" +
+                            std::to_string(x) + "/" +
+                            std::to_string(y) + "/ground/" +
+                            std::to_string(seed);
+
+  GroundSample S(input);
+  if (!S.good())
+  {
+    std::cerr << "Error: " << S.error() << std::endl;
+    return 1;
+  }
+  int order[4];
+  mpz_class g[4], modulus = 1;
+  if (x <= 2 || y <= 2)
+  {
+    if (!transferGroundStates(&S, order, g))
+    {
+      std::cerr << "Error: absent bonds on a lattice of width " << std::min(x, y)
+                << ", use isingZToTxt at low temperature" << std::endl;
+      return 1;
+    }
+  }
+  else
+  {
+    // Each prime gives the degeneracies modulo that prime.  Orders also
+    // cancel inside the elimination: on a lost leading term the window is
+    // doubled, up to three times.
+    int window = orders > 0 ? orders : S.gap() + 8;
+    for (int q = 0; q < primes; q++)
+    {
+      Laurent::set_prime(q);
+      Laurent Z[4];
+      bool found = false;
+      for (int attempt = 0; attempt < 4 && !found; attempt++)
+      {
+        Laurent::set_window(window);
+        found = findGroundStates(&S, Z);
+        if (!found)
+          window *= 2;
+      }
+      if (!found)
+      {
+        std::cerr << "Error: leading term lost with " << window/2
+                  << " orders (singular separator block?), use isingZToTxt at low temperature"
+                  << std::endl;
+        return 1;
+      }
+      mpz_class p, inv;
+      mpz_set_ui(p.get_mpz_t(), Laurent::prime(q));
+      mpz_invert(inv.get_mpz_t(), modulus.get_mpz_t(), p.get_mpz_t());
+      for (int s = 0; s < 4; s++)
+      {
+        if (q == 0)
+          order[s] = Z[s].order();
+        else if (Z[s].order() != order[s])
+        {
+          std::cerr << "Error: leading orders differ between primes" << std::endl;
+          return 1;
+        }
+        mpz_class r;                   // Chinese remainder step
+        mpz_set_ui(r.get_mpz_t(), Z[s].leading());
+        r = (r - g[s]) % p;
+        r = (r * inv) % p;
+        if (r < 0)
+          r += p;
+        g[s] += modulus * r;
+      }
+      modulus *= p;
+    }
+    for (int s = 0; s < 4; s++)
+    {
+      // Z_s > 0, so the Pfaffian signs leave g or -g (mod modulus)
+      if (2*g[s] > modulus)
+        g[s] = modulus - g[s];
+    }
+  }
+
+  createDirectory(outputDir);
+  std::ofstream outFile((outputDir + "/ground.txt").c_str());
+  static const char* name[4] = {"PP", "PA", "AP", "AA"};
+  for (int s = 0; s < 4; s++)
+  {
+    double E = 2*S.get_unit()*order[s] - S.get_sumJ();
+    outFile << name[s] << "\t" << E << "\t" << g[s] << "\n";
+  }
+  outFile.close();
+  std::cout << "ground states written to: " << outputDir << std::endl;
+  return 0;
+}
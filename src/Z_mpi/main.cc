@@ -0,0 +1,219 @@
+// main.cc
+// MPI driver for parameter sweeps: computes the partition functions of
+// every sample of a grid of (precision, L, p, T, seed) points read from a
+// grid file, with the interaction files written by
+// isingGeneratorRandomBond as input, and stores all results in one file.
+//
+// Every rank reads the grid file and builds the same job list, one job per
+// seed, sorted by estimated cost (largest first, so that the long jobs
+// do not end up last).  Rank 0 hands out job indices one at a time to the
+// workers as they become idle; with a single rank it does all jobs itself.
+// The workers keep their results in memory, and at the end all ranks
+// write them with collective MPI-IO calls at offsets from MPI_Exscan.
+//
+// Grid file: one point per line, '#' starts a comment,
+//   precision Lx Ly firstSeed lastSeed probability temperature [std dev]
+// with the meaning of the isingZToTxt arguments.
+// Output: a header line, then one line per sample
+//   prob stddev Lx Ly T_frac precision seed ZPP ZPA ZAP ZAA
+// (parameters formatted as in the result directories of isingZToTxt), in
+// no particular order; scripts/combine_to_hdf5.py --sweep reads it.
+
+#include <mpi.h>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstdlib>
+#include "../Z_to_txt/Partition.h"
+
+#define TAG_READY 1                    // worker -> master: send a job
+#define TAG_JOB   2                    // master -> worker: job index
+#define TAG_STOP  3                    // master -> worker: no jobs left
+
+struct Job
+{
+  int prec, Lx, Ly, seed;
+  double prob, T_frac, stddev;
+  bool useGaussian;
+  double cost;                         // ~ (Lx Ly)^1.5 * prec
+};
+
+static std::vector<Job> readGrid(const char* filename)
+{
+  std::vector<Job> jobs;
+  std::ifstream infile(filename);
+  if (!infile)
+  {
+    std::cerr << "Error: cannot read grid file " << filename << "\n";
+    MPI_Abort(MPI_COMM_WORLD, 1);
+  }
+  std::string line;
+  while (std::getline(infile, line))
+  {
+    line = line.substr(0, line.find('#'));
+    std::istringstream in(line);
+    Job job;
+    int firstSeed, lastSeed;
+    if (!(in >> job.prec >> job.Lx >> job.Ly >> firstSeed >> lastSeed
+             >> job.prob >> job.T_frac))
+      continue;
+    job.useGaussian = bool(in >> job.stddev);
+    if (!job.useGaussian)
+      job.stddev = 0.0;
+    job.cost = std::pow((double)job.Lx*job.Ly, 1.5) * job.prec;
+    for (job.seed = firstSeed; job.seed <= lastSeed; job.seed++)
+      jobs.push_back(job);
+  }
+  std::stable_sort(jobs.begin(), jobs.end(),
+                   [](const Job &a, const Job &b) { return a.cost > b.cost; });
+  return jobs;
+}
+
+// One result line, or an empty string if the interaction file is missing.
+static std::string run(const Job &job, const std::string &directory)
+{
+  dataType T_nish(1.0, job.prec);      // as in Z_to_txt/main.cc
+  if (job.prob != 0)
+    T_nish = 2/std::log((1-job.prob)/job.prob);
+  if (job.useGaussian)
+    T_nish = 1.0;
+  dataType T = job.T_frac*T_nish;
+
+  std::string input =   directory + "/interactionsGaussian/" +
+                            std::to_string(job.prob) + "/" +
+                            std::to_string(job.Lx) + "/" +
+                            std::to_string(job.Ly) + "/" +
+                            std::to_string(job.stddev) + "/" +
+                            std::to_string(job.seed) + "/interaction_lattice.txt";
+  if (!std::ifstream(input.c_str()))
+  {
+    std::cerr << "Error: missing " << input << "\n";
+    return "";
+  }
+  Sample S(input, T);
+  dataType Z[4];
+  findPartition(S, Z);
+
+  std::ostringstream out;
+  out << std::to_string(job.prob) << "\t" << std::to_string(job.stddev) << "\t"
+      << job.Lx << "\t" << job.Ly << "\t" << std::to_string(job.T_frac) << "\t"
+      << job.prec << "\t" << job.seed << "\t";
+  writePartition(Z, out, job.prec);
+  out << "\n";
+  return out.str();
+}
+
+int main(int argc, char* argv[])
+{
+  MPI_Init(&argc, &argv);
+  int rank, size;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  MPI_Comm_size(MPI_COMM_WORLD, &size);
+
+  if (argc != 4)
+  {
+    if (rank == 0)
+    {
+      std::cout << "FIND2DIsing MPI: partition functions of a parameter grid, one rank hands out the jobs\n";
+      std::cout << "usage: mpirun -np N " << argv[0] << " gridFile directory outputFile \n";
+    }
+    MPI_Finalize();
+    return 1;
+  }
+  std::vector<Job> jobs = readGrid(argv[1]);
+  std::string directory = argv[2];
+
+  double t0 = MPI_Wtime();
+  double busy = 0;
+  std::string results;
+  if (rank == 0)
+    results = "# prob\tstddev\tLx\tLy\tT_frac\tprecision\tseed\tZPP\tZPA\tZAP\tZAA\n";
+
+  if (size == 1)
+  {
+    for (size_t j = 0; j < jobs.size(); j++)
+      results += run(jobs[j], directory);
+    busy = MPI_Wtime() - t0;
+  }
+  else if (rank == 0)
+  {
+    int next = 0, stopped = 0, dummy;
+    MPI_Status status;
+    while (stopped < size-1)
+    {
+      MPI_Recv(&dummy, 1, MPI_INT, MPI_ANY_SOURCE, TAG_READY, MPI_COMM_WORLD, &status);
+      if (next < (int)jobs.size())
+      {
+        MPI_Send(&next, 1, MPI_INT, status.MPI_SOURCE, TAG_JOB, MPI_COMM_WORLD);
+        next++;
+      }
+      else
+      {
+        MPI_Send(&next, 1, MPI_INT, status.MPI_SOURCE, TAG_STOP, MPI_COMM_WORLD);
+        stopped++;
+      }
+    }
+  }
+  else
+  {
+    int j = 0;
+    MPI_Status status;
+    while (true)
+    {
+      MPI_Send(&j, 1, MPI_INT, 0, TAG_READY, MPI_COMM_WORLD);
+      MPI_Recv(&j, 1, MPI_INT, 0, MPI_ANY_TAG, MPI_COMM_WORLD, &status);
+      if (status.MPI_TAG == TAG_STOP)
+        break;
+      double t = MPI_Wtime();
+      results += run(jobs[j], directory);
+      busy += MPI_Wtime() - t;
+    }
+  }
+
+  // collective write: rank r starts after the bytes of ranks 0..r-1
+  long long bytes = results.size(), offset = 0;
+  MPI_Exscan(&bytes, &offset, 1, MPI_LONG_LONG, MPI_SUM, MPI_COMM_WORLD);
+  if (rank == 0)
+    offset = 0;                        // MPI_Exscan leaves it undefined
+  MPI_File fh;
+  if (MPI_File_open(MPI_COMM_WORLD, argv[3], MPI_MODE_CREATE | MPI_MODE_WRONLY,
+                    MPI_INFO_NULL, &fh) != MPI_SUCCESS)
+  {
+    if (rank == 0)
+      std::cerr << "Error: cannot open " << argv[3] << "\n";
+    MPI_Abort(MPI_COMM_WORLD, 1);
+  }
+  MPI_File_set_size(fh, 0);
+  // counts are int: chunks of at most CHUNK bytes, the same number of
+  // collective calls on every rank
+  const long long CHUNK = INT_MAX;
+  long long chunks = (bytes + CHUNK - 1) / CHUNK, rounds;
+  MPI_Allreduce(&chunks, &rounds, 1, MPI_LONG_LONG, MPI_MAX, MPI_COMM_WORLD);
+  for (long long c = 0; c < rounds; c++)
+  {
+    long long from = std::min(c * CHUNK, bytes);
+    int count = (int)std::min(CHUNK, bytes - from);
+    MPI_File_write_at_all(fh, offset + from, results.data() + from, count,
+                          MPI_CHAR, MPI_STATUS_IGNORE);
+  }
+  MPI_File_close(&fh);
+
+  // load balance: time spent computing on the busiest worker vs. average
+  double wall = MPI_Wtime() - t0, busySum, busyMax;
+  MPI_Reduce(&busy, &busySum, 1, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+  MPI_Reduce(&busy, &busyMax, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+  if (rank == 0)
+  {
+    int workers = (size == 1) ? 1 : size-1;
+    std::cout << jobs.size() << " jobs on " << workers << " workers in "
+              << wall << " s, balance " << busySum/workers/std::max(busyMax, 1e-9)
+              << "\nResults written to: " << argv[3] << std::endl;
+  }
+  MPI_Finalize();
+  return 0;
+}
@@ -0,0 +1,65 @@
+// Estimator.h
+//
+// Running estimate of the logical failure rate from a stream of samples.
+// Each sample contributes its sector probabilities p_k = Z_k / sum_k Z_k.
+// Two per-sample quantities are tracked:
+//  - indicator: 1 if the maximum likelihood decoder at the given
+//    temperature picks a class other than the sampled one (PP), else 0,
+//  - posterior: 1 - max_k p_k, the failure probability of the maximum
+//    likelihood decoder given the syndrome.  At the Nishimori temperature
+//    the p_k are the exact coset probabilities, so this has the same
+//    expectation as the indicator at a much smaller variance.
+// Samples may carry weights (e.g. likelihood ratios); the mean is then
+// self-normalized and the effective sample count is Kish's
+// (sum w)^2 / sum w^2.  Half-widths are for a normal approximation of
+// the mean, whose variance is sum w^2 (x - mean)^2 / (sum w)^2 (delta
+// method; sum (x - mean)^2 / n^2 without weights), with a Wilson score
+// interval for the indicator so that a run without failures does not
+// look converged.
+
+#ifndef ESTIMATOR_H
+#define ESTIMATOR_H
+
+#include <cmath>
+
+class RunningMean
+{
+  public:
+    void add(double x, double w = 1)
+    {
+      n++;
+      sumW += w;
+      sumW2 += w*w;
+      double delta = x - mean;
+      double shift = w/sumW * delta;
+      mean += shift;
+      // sum w^2 (x - mean)^2 and sum w^2 (x - mean) about the new mean
+      sumW2Sq += shift * (shift * (sumW2 - w*w) - 2 * sumW2Dev);
+      sumW2Dev -= shift * (sumW2 - w*w);
+      sumW2Sq += w*w * (x - mean) * (x - mean);
+      sumW2Dev += w*w * (x - mean);
+    }
+    double get_mean() const { return mean; }
+    long   get_n() const { return n; }
+    double effective_n() const { return sumW2 > 0 ? sumW*sumW/sumW2 : 0; }
+    double half_width(double z) const
+    {
+      double ess = effective_n();
+      if (ess < 2) return INFINITY;
+      return z * std::sqrt(sumW2Sq) / sumW;
+    }
+    double wilson_half_width(double z) const
+    {
+      double ess = effective_n();
+      if (ess < 1) return INFINITY;
+      double p = mean < 0 ? 0 : (mean > 1 ? 1 : mean);
+      return z/(1 + z*z/ess) * std::sqrt(p*(1-p)/ess + z*z/(4*ess*ess));
+    }
+  private:
+    long   n = 0;
+    double sumW = 0, sumW2 = 0;
+    double mean = 0;
+    double sumW2Sq = 0, sumW2Dev = 0;
+};
+
+#endif // ESTIMATOR_H
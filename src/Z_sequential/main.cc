@@ -0,0 +1,251 @@
+// main.cc
+// Sequential estimate of the logical failure rate at one (p, L, T) point.
+// Draws the lattices of seeds firstSeed, firstSeed+1, ... in memory
+// (the couplings isingGeneratorRandomBond writes for these seeds, rounded
+// and read as in its interaction files),
+// computes the four sector partition functions of each and updates a
+// running estimate (see Estimator.h).  Stops as soon as the 95%
+// confidence half-width is below relHalfWidth times the estimate, or
+// after maxSamples seeds.
+// At T = 1 (in units of the Nishimori temperature) the estimate is the
+// mean posterior failure probability, otherwise the mean of the failure
+// indicator of the decoder at temperature T.
+// Several probabilities are solved from one draw per seed (nested error
+// sets, see Lattice.h); the differences of neighbouring points are
+// estimated from the paired samples.  With --bias the flips are drawn at
+// a larger probability and each sample is weighted with its likelihood
+// ratio, so that the rare failures far below threshold are sampled often.
+
+#include <iostream>
+#include <cmath>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+#include <gsl/gsl_rng.h>
+#include "../Z_to_txt/Partition.h"
+#include "../generator_random_bond/Lattice.h"
+#include "Estimator.h"
+
+#define MIN_SAMPLES 100                // before any stopping decision
+#define Z_95 1.959963984540054         // normal quantile of 95% confidence
+
+void createDirectory(const std::string &path) {
+    std::string command = "mkdir -p " + path;
+    int status = system(command.c_str());
+    if (status != 0) {
+        std::cerr << "Error creating directory: " << path << std::endl;
+    }
+}
+
+// one probability of the ladder
+struct Point
+{
+  double prob;
+  dataType T;
+  std::string outputDir;
+  std::ofstream samplesFile;
+  RunningMean indicator, failure;
+  double last;                         // quantity of the current seed
+  bool converged = false;
+};
+
+int main(int argc, char* argv[])
+{
+  // importance sampling: flips drawn at bias, samples weighted with the
+  // likelihood ratio of their couplings at probability over bias
+  bool biased = (argc > 2 && strcmp(argv[1], "--bias") == 0);
+  double bias = 0.0;
+  if (biased)
+  {
+    bias = atof(argv[2]);
+    argv[2] = argv[0];
+    argc -= 2;
+    argv += 2;
+  }
+  if (argc < 10 || argc > 11)
+  {
+    std::cout << "FIND2DIsing sequential: estimates the logical failure rate, drawing samples until a target confidence is reached\n";
+    std::cout << "usage: " << argv[0] << " [--bias drawnProbability] bitsOfPrecision Lx Ly firstSeed maxSamples probability[,probability...] temperature relHalfWidth directory [std dev] \n";
+    return 1;
+  }
+
+  int prec = atoi(argv[1]);
+  mpf_set_default_prec(prec);
+
+  int x   = atoi(argv[2]);
+  int y   = atoi(argv[3]);
+  int firstSeed  = atoi(argv[4]);
+  long maxSamples = atol(argv[5]);
+  std::vector<double> probs;
+  for (char *p = strtok(argv[6], ","); p != NULL; p = strtok(NULL, ","))
+    probs.push_back(atof(p));
+  double T_frac = atof(argv[7]);
+  double relHalfWidth = atof(argv[8]);
+  if (probs.empty())
+  {
+    std::cerr << "Error: no probability given.\n";
+    return 1;
+  }
+
+  bool useGaussian = (argc == 11);
+  double stddev = 0.0;
+  if (useGaussian) {
+    stddev = std::atof(argv[10]);
+    if (stddev <= 0) {
+      std::cerr << "Error: Std dev must be positive.\n";
+      return 1;
+    }
+  }
+  if (biased && (useGaussian || probs.size() != 1 || bias <= 0 || bias >= 1))
+  {
+    std::cerr << "Error: --bias needs the uniform model, one probability and 0 < drawnProbability < 1.\n";
+    return 1;
+  }
+  bool posterior = (T_frac == 1.0);
+  // the weights are exp(ln ratio - shift) with shift the mean of the ln
+  // ratio under the biased draw, a constant that cancels in the
+  // self-normalized estimate but keeps the weights within double range
+  double shift = 0.0;
+  if (biased)
+  {
+    double p = probs[0];
+    shift = 2.0*x*y * (bias*std::log(p/bias) + (1-bias)*std::log((1-p)/(1-bias)));
+  }
+
+  std::string directory = argv[9];
+  std::vector<Point> points(probs.size());
+  for (size_t i = 0; i < probs.size(); i++)
+  {
+    Point &pt = points[i];
+    pt.prob = probs[i];
+    dataType T_nish = 1.0; // Nishimori temperature, see Z_to_txt/main.cc
+    if (pt.prob!=0 && !useGaussian)
+      T_nish = 2/std::log((1-pt.prob)/pt.prob);
+    pt.T = T_frac*T_nish;
+    pt.outputDir =  directory + "/sequentialGaussian/" +
+                    std::to_string(pt.prob) + "/" +
+                    std::to_string(stddev) + "/" +
+                    std::to_string(x) + "/" +
+                    std::to_string(y) + "/" +
+                    std::to_string(T_frac) + "/" +
+                    std::to_string(prec);
+    createDirectory(pt.outputDir);
+    pt.samplesFile.open((pt.outputDir + "/samples.txt").c_str());
+    pt.samplesFile.precision(17);
+    pt.samplesFile << std::scientific;
+  }
+  // differences of neighbouring points, from the same seeds
+  std::vector<RunningMean> differences(points.size() - 1);
+
+  gsl_rng *rng = gsl_rng_alloc(gsl_rng_mt19937);
+  BondVariates variates;
+  std::vector<double> J;
+  bool converged = false;
+  int seed = firstSeed;
+  for (long n = 0; n < maxSamples && !converged; n++, seed++)
+  {
+    // one draw for all probabilities: nested error sets
+    gsl_rng_set(rng, seed);
+    drawVariates(rng, x, y, useGaussian, stddev, variates);
+    converged = true;
+    for (Point &pt : points)
+    {
+      thresholdCouplings(variates, biased ? bias : pt.prob, J);
+      double w = biased ? std::exp(logLikelihoodRatio(J, pt.prob, bias) - shift) : 1.0;
+      // as read from the generator's file, for Gaussian couplings too
+      mp_bitcnt_t prec = pt.T.get_prec();
+      Sample S(x, y, prec);
+      for (int b = 0; b < 2*x*y; b++)
+        S.add_bond((b/2) % x, (b/2) / x, (b % 2) ? 'S' : 'E',
+                   dataType(formatCoupling(J[b]).c_str(), prec), pt.T);
+      dataType Z[4];
+      findPartition(S, Z);
+
+      dataType total = Z[PP] + Z[PA] + Z[AP] + Z[AA];
+      int best = PP;
+      for (int k = PA; k <= AA; k++)
+        if (Z[k] > Z[best])
+          best = k;
+      pt.samplesFile << seed;
+      for (int k = PP; k <= AA; k++)
+        pt.samplesFile << "\t" << dataType(Z[k]/total).get_d();
+      if (biased)
+        pt.samplesFile << "\t" << w;
+      pt.samplesFile << "\n";
+
+      double failure = dataType(1 - Z[best]/total).get_d();
+      pt.indicator.add(best != PP, w);
+      pt.failure.add(failure, w);
+      pt.last = posterior ? failure : double(best != PP);
+
+      const RunningMean &est = posterior ? pt.failure : pt.indicator;
+      double hw = posterior ? est.half_width(Z_95) : est.wilson_half_width(Z_95);
+      pt.converged = est.get_n() >= MIN_SAMPLES && est.get_mean() > 0 &&
+                     hw <= relHalfWidth * est.get_mean();
+      converged = converged && pt.converged;
+    }
+    for (size_t i = 0; i < differences.size(); i++)
+      differences[i].add(points[i+1].last - points[i].last);
+  }
+  gsl_rng_free(rng);
+
+  for (Point &pt : points)
+  {
+    pt.samplesFile.close();
+    const RunningMean &est = posterior ? pt.failure : pt.indicator;
+    double hw = posterior ? est.half_width(Z_95) : est.wilson_half_width(Z_95);
+    std::ofstream outFile((pt.outputDir + "/estimate.txt").c_str());
+    outFile.precision(10);
+    outFile << "estimator\t" << (posterior ? "posterior" : "indicator") << "\n"
+            << "failureRate\t" << est.get_mean() << "\n"
+            << "halfWidth95\t" << hw << "\n"
+            << "samples\t" << est.get_n() << "\n"
+            << "effectiveSamples\t" << est.effective_n() << "\n"
+            << "indicatorRate\t" << pt.indicator.get_mean() << "\n"
+            << "posteriorRate\t" << pt.failure.get_mean() << "\n"
+            << "converged\t" << pt.converged << "\n";
+    if (biased)
+      outFile << "drawnProbability\t" << bias << "\n";
+    outFile.close();
+
+    std::cout << "p = " << pt.prob << ": failure rate " << est.get_mean()
+              << " +- " << hw << " (95%) from " << est.get_n() << " samples, "
+              << est.effective_n() << " effective"
+              << (pt.converged ? "" : ", target not reached") << "\n";
+    std::cout << "Estimate written to: " << pt.outputDir << std::endl;
+  }
+
+  if (!differences.empty())
+  {
+    // the half-width of the same difference from independent samples,
+    // for the variance reduction of the common random numbers
+    std::string ladderDir = directory + "/sequentialGaussian/ladder/" +
+                            std::to_string(stddev) + "/" +
+                            std::to_string(x) + "/" +
+                            std::to_string(y) + "/" +
+                            std::to_string(T_frac) + "/" +
+                            std::to_string(prec);
+    createDirectory(ladderDir);
+    std::ofstream diffFile((ladderDir + "/differences.txt").c_str());
+    diffFile.precision(10);
+    diffFile << "# prob\tnextProb\tdifference\thalfWidth95\tindependentHalfWidth95\n";
+    for (size_t i = 0; i < differences.size(); i++)
+    {
+      const RunningMean &a = posterior ? points[i].failure : points[i].indicator;
+      const RunningMean &b = posterior ? points[i+1].failure : points[i+1].indicator;
+      double hw = differences[i].half_width(Z_95);
+      double independent = std::hypot(a.half_width(Z_95), b.half_width(Z_95));
+      diffFile << points[i].prob << "\t" << points[i+1].prob << "\t"
+               << differences[i].get_mean() << "\t" << hw << "\t"
+               << independent << "\n";
+      std::cout << "p = " << points[i].prob << " -> " << points[i+1].prob
+                << ": difference " << differences[i].get_mean() << " +- " << hw
+                << " (95%), " << independent << " from independent samples\n";
+    }
+    diffFile.close();
+    std::cout << "Differences written to: " << ladderDir << std::endl;
+  }
+  return 0;
+}
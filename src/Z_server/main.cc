@@ -0,0 +1,297 @@
+// main.cc
+// Long running solver: reads requests line by line from stdin, or from
+// the clients of a Unix domain socket, and answers each with the four
+// sector partition functions.  Compared with one isingZToTxt run per
+// sample this saves the process start, the directory and file handling
+// and, through one WeightCache per (T, precision), the exponentials of
+// couplings already seen; freed matrices stay with the allocator for the
+// next request.
+//
+// Protocol (one line each, fields separated by white space):
+//   Z Lx Ly T prec J_0 ... J_{2*Lx*Ly-1}
+//       couplings in the order of the generator (spins row by row, E then
+//       S bond), T in units of the couplings, prec in bits; answered by
+//       "OK ZPP ZPA ZAP ZAA" with the digits of Z.txt, or "ERR message"
+//   STATS
+//       "STATS requests p50 p90 p99 max" with the latencies in microseconds
+//       of the last WINDOW requests
+//   QUIT
+//       closes the connection (ends the server when reading stdin)
+// Lattices are limited to MAX_SPINS spins and prec to MAX_PREC bits; a
+// request beyond them, or one the solver cannot eliminate, gets ERR and
+// the server goes on.
+// Each client of the socket is served on its own thread, so a long
+// request does not hold up the others; the weight caches and the
+// statistics are shared under one mutex.  On SIGINT or SIGTERM the
+// connections are shut down and their threads joined.  The latency
+// statistics are also printed to stderr on exit.
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <utility>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <cmath>
+#include <csignal>
+#include <new>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "../Z_to_txt/Partition.h"
+
+#define MAX_CACHED 65536               // weights kept over all caches
+#define MAX_SPINS  (1 << 22)           // Lx*Ly of a request
+#define MAX_PREC   (1 << 20)           // bits of a request
+#define WINDOW     100000              // latencies kept for STATS
+
+static std::mutex lock;                // guards the four below
+static std::map<std::pair<double, long>, WeightCache*> caches;
+static size_t cached = 0;
+static std::vector<double> latencies;  // microseconds, ring of WINDOW
+static size_t requests = 0;            // Z requests so far
+static volatile sig_atomic_t stopping = 0;
+
+struct Client
+{
+  int fd;
+  std::thread thread;
+  bool done;                           // fd about to be closed
+};
+static std::mutex clientLock;          // guards done
+static std::list<Client> clients;      // changed by the accept loop only
+
+// with lock held
+static WeightCache& cacheFor(double T, long prec)
+{
+  if (cached > MAX_CACHED)             // Gaussian couplings rarely repeat
+  {
+    for (auto &c : caches)
+      delete c.second;
+    caches.clear();
+    cached = 0;
+  }
+  WeightCache* &c = caches[std::make_pair(T, prec)];
+  if (c == NULL)
+    c = new WeightCache(dataType(T, prec));
+  return *c;
+}
+
+static double percentile(std::vector<double> &v, double q)
+{
+  size_t k = std::min(v.size()-1, (size_t)(q*v.size()));
+  std::nth_element(v.begin(), v.begin()+k, v.end());
+  return v[k];
+}
+
+static std::string stats()
+{
+  std::lock_guard<std::mutex> guard(lock);
+  std::ostringstream out;
+  out << "STATS " << requests;
+  if (latencies.empty())
+    return out.str() + " 0 0 0 0";
+  std::vector<double> v(latencies);
+  out << " " << percentile(v, 0.5) << " " << percentile(v, 0.9) << " "
+      << percentile(v, 0.99) << " " << *std::max_element(v.begin(), v.end());
+  return out.str();
+}
+
+static std::string solve(std::istringstream &in)
+{
+  int Lx, Ly;
+  double T;
+  long prec;
+  if (!(in >> Lx >> Ly >> T >> prec) || Lx < 1 || Ly < 1 || !(T > 0) ||
+      !std::isfinite(T) || prec <= 0)
+    return "ERR expected Z Lx Ly T prec couplings";
+  if (Lx > MAX_SPINS / Ly)
+    return "ERR more than " + std::to_string(MAX_SPINS) + " spins";
+  if (prec > MAX_PREC)
+    return "ERR more than " + std::to_string(MAX_PREC) + " bits";
+  std::vector<double> J(2*Lx*Ly);
+  for (size_t i = 0; i < J.size(); i++)
+    if (!(in >> J[i]) || !std::isfinite(J[i]))
+      return "ERR expected " + std::to_string(J.size()) + " finite couplings";
+
+  dataType Z[4];
+  try
+  {
+    std::unique_ptr<Sample> S;
+    {                                  // the weights are copied into S
+      std::lock_guard<std::mutex> guard(lock);
+      WeightCache &cache = cacheFor(T, prec);
+      size_t before = cache.size();
+      S.reset(new Sample(Lx, Ly, J.data(), cache));
+      cached += cache.size() - before;
+    }
+    findPartition(*S, Z);
+  }
+  catch (const FINDerror &e)
+  {
+    return std::string("ERR ") + e.what();
+  }
+  catch (const std::bad_alloc &)
+  {
+    return "ERR out of memory";
+  }
+
+  std::ostringstream out;
+  out << "OK\t";
+  writePartition(Z, out, prec);
+  return out.str();
+}
+
+// Answers the requests of one stream; returns when it ends or on QUIT.
+static void serve(FILE* in, FILE* out)
+{
+  char* line = NULL;
+  size_t n = 0;
+  while (!stopping && getline(&line, &n, in) > 0)
+  {
+    std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+    std::istringstream request(line);
+    std::string command, reply;
+    request >> command;
+    if (command == "Z")
+    {
+      reply = solve(request);
+      double us = std::chrono::duration<double, std::micro>(
+                    std::chrono::steady_clock::now() - t0).count();
+      std::lock_guard<std::mutex> guard(lock);
+      if (latencies.size() < WINDOW)
+        latencies.push_back(us);
+      else
+        latencies[requests % WINDOW] = us;
+      requests++;
+    }
+    else if (command == "STATS")
+      reply = stats();
+    else if (command == "QUIT")
+      break;
+    else if (command.empty())
+      continue;
+    else
+      reply = "ERR unknown command " + command;
+    fprintf(out, "%s\n", reply.c_str());
+    fflush(out);
+  }
+  free(line);
+}
+
+static void serveClient(Client* c)
+{
+  FILE* in = fdopen(c->fd, "r");
+  FILE* out = fdopen(dup(c->fd), "w");
+  serve(in, out);
+  {
+    std::lock_guard<std::mutex> guard(clientLock);
+    c->done = true;
+  }
+  fclose(in);
+  fclose(out);
+}
+
+// Joins the threads of closed connections.
+static void reapClients()
+{
+  std::lock_guard<std::mutex> guard(clientLock);
+  for (auto c = clients.begin(); c != clients.end(); )
+    if (c->done)
+    {
+      c->thread.join();
+      c = clients.erase(c);
+    }
+    else
+      ++c;
+}
+
+static void stop(int)
+{
+  stopping = 1;
+}
+
+int main(int argc, char* argv[])
+{
+  if (argc > 2)
+  {
+    std::cout << "FIND2DIsing server: partition functions for coupling sets sent over a pipe or socket\n";
+    std::cout << "usage: " << argv[0] << " [socket path] \n";
+    return 1;
+  }
+
+  FINDmatrix::throw_errors();
+  if (argc == 1)
+    serve(stdin, stdout);
+  else
+  {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(argv[1]) >= sizeof(addr.sun_path))
+    {
+      std::cerr << "Error: socket path too long: " << argv[1] << "\n";
+      return 1;
+    }
+    strcpy(addr.sun_path, argv[1]);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(argv[1]);
+    if (fd < 0 || bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 ||
+        listen(fd, 16) < 0)
+    {
+      std::cerr << "Error: cannot listen on " << argv[1] << ": "
+                << strerror(errno) << "\n";
+      return 1;
+    }
+    struct sigaction sa;                // no SA_RESTART: accept() returns
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = stop;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+    sigset_t signals, old;             // delivered to this thread only,
+    sigemptyset(&signals);             // .. to interrupt accept()
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    while (!stopping)
+    {
+      int client = accept(fd, NULL, NULL);
+      if (client < 0)
+        continue;
+      reapClients();
+      clients.push_back(Client());
+      Client &c = clients.back();
+      c.fd = client;
+      c.done = false;
+      pthread_sigmask(SIG_BLOCK, &signals, &old);
+      c.thread = std::thread(serveClient, &c);
+      pthread_sigmask(SIG_SETMASK, &old, NULL);
+    }
+    close(fd);
+    unlink(argv[1]);
+    {                                  // wakes the threads in getline()
+      std::lock_guard<std::mutex> guard(clientLock);
+      for (Client &c : clients)
+        if (!c.done)
+          shutdown(c.fd, SHUT_RDWR);
+    }
+    for (Client &c : clients)
+      c.thread.join();
+    clients.clear();
+  }
+  std::cerr << stats() << "\n";
+  for (auto &c : caches)
+    delete c.second;
+  return 0;
+}
@@ -0,0 +1,417 @@
+// FINDjet.cc
+//
+// Mirrors FINDmatrix.cc operation by operation; see there for the
+// orderings and for the diagrams of the cross operation.
+
+#include "FINDjet.h"
+#include "../Z_to_txt/exp_log.h"
+#include <fstream>
+#include <iostream>
+#include <cstdlib>
+#include <algorithm>
+#include <utility>
+
+// Same input format as Sample.
+JetSample::JetSample(const std::string &filename, const dataType &T)
+: Z_prefactor(1)
+{
+  std::ifstream infile(filename.c_str());
+  infile >> Lx >> Ly;
+  xbonds.assign(Lx*Ly, jet(0));
+  ybonds.assign(Lx*Ly, jet(0));
+  exp_log EL;
+  int x, y;
+  std::string direction, Jchars;
+  while (infile >> x)
+  {
+    infile >> y >> direction >> Jchars;
+    dataType J(Jchars.c_str());
+    jet weight = exp_beta(EL.exp(-2*J/T), -2*J);
+    Z_prefactor = Z_prefactor * exp_beta(EL.exp(J/T), J);
+    switch(direction[0])               // as Sample::add_weight
+    {
+      case 'N': case '0': ybonds[x*Ly + (y+Ly-1)%Ly] = weight; break;
+      case 'E': case '1': xbonds[x*Ly + y] = weight; break;
+      case 'S': case '2': ybonds[x*Ly + y] = weight; break;
+      case 'W': case '3': xbonds[((x+Lx-1)%Lx)*Ly + y] = weight; break;
+    }
+  }
+}
+
+int JetSample::get_Lx()
+{
+  return Lx;
+}
+
+int JetSample::get_Ly()
+{
+  return Ly;
+}
+
+const jet &JetSample::get_Z_prefactor()
+{
+  return Z_prefactor;
+}
+
+// as Sample::get_p_bond
+jet JetSample::get_p_bond(int px, int py, Dir dir)
+{
+  switch(dir)
+  {
+    case N:
+      return -xbonds[px*Ly + py];
+    case E:
+      return ybonds[(px+1)*Ly + py];
+    case S:
+      return xbonds[px*Ly + py+1];
+    case W:
+      return -ybonds[px*Ly + py];
+    default:
+      return jet(0);
+  }
+}
+
+FINDjet::FINDjet(JetSample* _S)
+: offx(0), offy(0), S(_S)
+{
+  Lx = S->get_Lx();
+  Ly = S->get_Ly();
+  initialize();
+}
+
+FINDjet::FINDjet(FINDjet& other)
+: Lx(other.Lx), Ly(other.Ly), offx(other.offx), offy(other.offy),
+  mtx_L(other.mtx_L), S(other.S), A(NULL), B(NULL), prefactor(other.prefactor)
+{
+  copy_matrix(other.mat,&mat,mtx_L);
+}
+
+FINDjet::FINDjet(int _Lx, int _Ly, int _offx, int _offy, JetSample* _S)
+: Lx(_Lx), Ly(_Ly), offx(_offx), offy(_offy), S(_S)
+{
+  initialize();
+}
+
+void FINDjet::initialize()
+{
+  prefactor = jet(1);
+  if (Lx == 1 && Ly == 1)              // Base case: Kasteleyn city
+  {
+    A = NULL;
+    B = NULL;
+    mtx_L = 4;
+    allocate_matrix(&mat,mtx_L);
+    mat[0][0] = mat[0][1] = mat[0][2] = jet(1);
+    mat[1][0] = mat[1][1] = jet(1);
+    mat[2][0] = jet(1);
+    return;
+  }
+  if (Lx > Ly)                         // Recursion with a vertical separator
+  {
+    A = new FINDjet(Lx/2,Ly,offx,offy,S);
+    B = new FINDjet(Lx-Lx/2,Ly,offx+Lx/2,offy,S);
+    prefactor = combine_vertical();
+  }
+  else                                 // Recursion with a horizontal separator
+  {
+    A = new FINDjet(Lx,Ly/2,offx,offy,S);
+    B = new FINDjet(Lx,Ly-Ly/2,offx,offy+Ly/2,S);
+    prefactor = combine_horizontal();
+  }
+  delete A; A = NULL;
+  delete B; B = NULL;
+}
+
+FINDjet::~FINDjet()
+{
+  if (A != NULL)
+    delete A;
+  if (B != NULL)
+    delete B;
+  if (mat != NULL)
+    delete_matrix(&mat,mtx_L);
+  mat = NULL;
+}
+
+void FINDjet::allocate_matrix(jet*** mtx, int L)
+{
+  (*mtx) = new jet*[L-1];
+  for (int i=0; i<L-1; i++)
+    (*mtx)[i] = new jet[L-1-i];
+}
+
+void FINDjet::copy_matrix(jet** mtx1, jet*** mtx2, int L)
+{
+  (*mtx2) = new jet*[L-1];
+  for (int i=0; i<L-1; i++)
+  {
+    (*mtx2)[i] = new jet[L-1-i];
+    for (int j=0; j<L-1-i; j++)
+      (*mtx2)[i][j] = mtx1[i][j];
+  }
+}
+
+void FINDjet::delete_matrix(jet*** mtx, int L)
+{
+  for (int i=0; i<L-1; i++)
+    delete[] (*mtx)[i];
+  delete[] (*mtx);
+}
+
+// presume wrapHorz already done
+jet FINDjet::Zvert(int vsep)
+{
+  for (int i=0; i<Ly; i++)
+    mat[i][2*Ly-2*i-2] -= vsep*S->get_p_bond(offx,offy+i,W);
+  return prefactor * Pf_eliminate(Ly);
+}
+
+void FINDjet::wrapHorz(int hsep)
+{
+  for (int i=0; i<Lx; i++)
+    mat[i][2*Lx+Ly-2*i-2] += hsep*S->get_p_bond(offx+i,offy,N);
+  int* perm = new int[mtx_L];
+  for (int i = 0; i < mtx_L; ++i)
+    perm[i] = i;
+  int xchgfactor = 1;
+  for (int i = 0; i < Ly/2; ++i) {
+    std::swap(perm[Lx+i], perm[Lx+Ly-1-i]);
+    xchgfactor = -xchgfactor;
+  }
+  for (int i = 0; i < Lx/2; ++i) {
+    std::swap(perm[Lx+Ly+i], perm[Lx+Ly+Lx-1-i]);
+    xchgfactor = -xchgfactor;
+  }
+  for (int i = 0; i < (Lx+Ly)/2; ++i) {
+    std::swap(perm[Lx+i], perm[Lx+Ly+Lx-1-i]);
+    xchgfactor = -xchgfactor;
+  }
+  permute(perm);
+  delete[] perm;
+  prefactor = xchgfactor * (prefactor * Pf_eliminate(Lx));
+}
+
+jet FINDjet::combine_vertical()
+{
+  mtx_L = A->mtx_L + B->mtx_L;
+  allocate_matrix(&mat,mtx_L);
+
+  int* Aordering = new int[A->mtx_L];
+  int* Bordering = new int[B->mtx_L];
+  int counter = 0;
+  for (int i=0; i<Ly; i++)             // interleaving part
+  {
+    Bordering[2*B->Lx+2*Ly-1-i] = counter++;
+    Aordering[A->Lx+i] = counter++;
+    mat[counter-2][0] = -S->get_p_bond(B->offx,offy+i,W);
+  }
+  for (int i=0; i<A->Lx; i++)
+    Aordering[i] = counter++;
+  for (int i=0; i<2*B->Lx+Ly; i++)
+    Bordering[i] = counter++;
+  for (int i=0; i<A->Lx+Ly; i++)
+    Aordering[A->Lx+Ly+i] = counter++;
+
+  fill_mat(A,Aordering);
+  fill_mat(B,Bordering);
+
+  delete[] Aordering;
+  delete[] Bordering;
+
+  return A->prefactor * B->prefactor * Pf_eliminate(Ly);
+}
+
+jet FINDjet::combine_horizontal()
+{
+  mtx_L = A->mtx_L + B->mtx_L;
+  allocate_matrix(&mat,mtx_L);
+
+  int* Aordering = new int[A->mtx_L];
+  int* Bordering = new int[B->mtx_L];
+  int counter = 0;
+  for (int i=0; i<Lx; i++)             // interleaving part
+  {
+    Aordering[Lx+A->Ly+i] = counter++;
+    Bordering[Lx-1-i] = counter++;
+    mat[counter-2][0] = S->get_p_bond(offx+Lx-1-i,B->offy,N);
+  }
+  for (int i=0; i<Lx+A->Ly; i++)
+    Aordering[i] = counter++;
+  for (int i=0; i<Lx+2*B->Ly; i++)
+    Bordering[Lx+i] = counter++;
+  for (int i=0; i<A->Ly; i++)
+    Aordering[2*Lx+A->Ly+i] = counter++;
+
+  fill_mat(A,Aordering);
+  fill_mat(B,Bordering);
+
+  delete[] Aordering;
+  delete[] Bordering;
+
+  return A->prefactor * B->prefactor * Pf_eliminate(Lx);
+}
+
+// the submatrices are deleted afterwards, so their entries are moved
+void FINDjet::fill_mat(FINDjet* from, int* ordering)
+{
+  for (int i=0; i<from->mtx_L; i++)
+  {
+    int newi = ordering[i];
+    for (int j=0; j<from->mtx_L-1-i; j++)
+    {
+      int newj = ordering[j+1+i];
+      if (newi > newj)
+        mat[newj][newi-newj-1] = -from->mat[i][j];
+      else
+        std::swap(mat[newi][newj-newi-1], from->mat[i][j]);
+    }
+  }
+}
+
+// Semi-pivoted elimination as in FINDmatrix::Pf_eliminate, pivoting on
+// the values; the derivatives follow.
+jet FINDjet::Pf_eliminate(int numEvenRows)
+{
+  int pivotfactor = 1;
+  for (int i = 0; i < numEvenRows*2; i += 2)
+  {
+    dataType maxMag = 0;
+    int pivotrow = 0;
+    for (int j = 0; j < numEvenRows*2-i-1; j++)
+      if (abs(mat[i][j].v) > maxMag)
+      {
+        pivotrow = j;
+        maxMag = abs(mat[i][j].v);
+      }
+    if (pivotrow != 0)
+    {
+      pivotfactor = -pivotfactor;
+      pivotrows(i, pivotrow);
+    }
+    if (mat[i][0].v == 0)
+    {
+      std::cerr << "zero superdiag error\n";
+      exit(1);
+    }
+    for (int j = 1; j < mtx_L - i - 1; j++)
+      if (!mat[i][j].is_zero())
+        crossOp(i, j);
+  }
+
+  jet superDiagProd(pivotfactor);
+  for (int i = 0; i < numEvenRows * 2; i += 2)
+    superDiagProd = superDiagProd * mat[i][0];
+
+  if (2*numEvenRows < mtx_L)
+  {
+    for (int i=0; i<2*numEvenRows; i++)
+      delete[] mat[i];
+    mtx_L -= 2*numEvenRows;
+    jet** newmat = new jet*[mtx_L-1];
+    for (int i=0; i<mtx_L-1; i++)
+      newmat[i] = mat[i+2*numEvenRows];
+    delete[] mat;
+    mat = newmat;
+  }
+  return superDiagProd;
+}
+
+// as FINDmatrix::permute: the new entry (a,b) is the old entry
+// (perm[a],perm[b]), moved along the cycles of the upper triangle
+void FINDjet::permute(const int* perm)
+{
+  std::vector<long> start(mtx_L);      // linear index of (a,a+1)
+  for (int a = 0, n = 0; a < mtx_L; n += mtx_L-1-a, a++)
+    start[a] = n;
+  std::vector<bool> done((long)mtx_L*(mtx_L-1)/2, false);
+  for (int a = 0; a < mtx_L-1; a++)
+    for (int b = a+1; b < mtx_L; b++)
+    {
+      if (done[start[a]+b-a-1])
+        continue;
+      int ca = a, cb = b;              // cycle through (a,b)
+      while (true)
+      {
+        done[start[ca]+cb-ca-1] = true;
+        int sa = std::min(perm[ca], perm[cb]), sb = std::max(perm[ca], perm[cb]);
+        if (sa == a && sb == b)
+          break;
+        std::swap(mat[ca][cb-ca-1], mat[sa][sb-sa-1]);
+        if (perm[ca] > perm[cb])
+          mat[ca][cb-ca-1] = -mat[ca][cb-ca-1];
+        ca = sa;
+        cb = sb;
+      }
+      if (perm[ca] > perm[cb])
+        mat[ca][cb-ca-1] = -mat[ca][cb-ca-1];
+    }
+}
+
+// same as FINDmatrix::pivotrows
+void FINDjet::pivotrows(int i, int j)
+{
+  // i) - swap x,y
+  std::swap(mat[i][0], mat[i][j]);
+
+  // ii) - swap 1,c, with negation
+  for (int k = 0; k < j-1; ++k)
+  {
+    jet tmp = -mat[i+1][k];
+    mat[i+1][k] = -mat[i+2+k][j-k-2];
+    mat[i+2+k][j-k-2] = tmp;
+  }
+
+  // iii) negate intersection
+  mat[i+1][j-1] = -mat[i+1][j-1];
+
+  // iv) swap end of row i with end of row i+j
+  for (int k = 0; j + k < mtx_L-i-2; k++)
+    std::swap(mat[i+1][j+k], mat[i+j+1][k]);
+}
+
+void FINDjet::crossOp(int i, int j)
+{
+  jet scaleFactor = -mat[i][j]/mat[i][0];
+  jet negScaleFactor = -scaleFactor;
+  mat[i][j] = jet(0);
+  for (int k = 0; k < j - 1; ++k)
+    if (!mat[i+1][k].is_zero())
+      mat[i+2+k][j-k-2].addmul(negScaleFactor, mat[i+1][k]);
+  for (int k = 0; j + k < mtx_L-i-2; k++)
+    if (!mat[i+1][j+k].is_zero())
+      mat[i+j+1][k].addmul(scaleFactor, mat[i+1][j+k]);
+}
+
+void findPartitionJet(JetSample* S, jet Z[4])
+{
+  FINDjet X(S);
+
+  FINDjet Ypls1(X);
+  FINDjet Yneg1(X);
+
+  Ypls1.wrapHorz(1);
+  Yneg1.wrapHorz(-1);
+
+  FINDjet Ypls2(Ypls1);
+  FINDjet Yneg2(Yneg1);
+
+  jet y[4] = {Ypls1.Zvert(1), Yneg1.Zvert(1), Ypls2.Zvert(-1), Yneg2.Zvert(-1)};
+  static const int sign[4][4] = {{ 1,  1,  1,  1},   // ZPP
+                                 {-1, -1,  1,  1},   // ZPA
+                                 {-1,  1, -1,  1},   // ZAP
+                                 {-1,  1,  1, -1}};  // ZAA
+
+  // as combineSectors, with |f| taken on the value
+  for (int s = 0; s < 4; s++)
+  {
+    jet sum(0);
+    for (int k = 0; k < 4; k++)
+      sum += sign[s][k] * y[k];
+    Z[s] = S->get_Z_prefactor() * sum;
+    Z[s].v /= 2;
+    Z[s].d1 /= 2;
+    Z[s].d2 /= 2;
+    if (Z[s].v < 0)
+      Z[s] = -Z[s];
+  }
+}
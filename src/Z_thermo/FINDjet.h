@@ -0,0 +1,75 @@
+// FINDjet.h
+//
+// FINDmatrix on jets (Jet.h): runs the nested dissection once and
+// returns, for each sector, Z together with its first and second
+// derivative with respect to beta = 1/T.  These give the internal energy
+//   U = -d log Z/dbeta = -Z'/Z
+// and the specific heat
+//   C = beta^2 d2 log Z/dbeta2 = beta^2 (Z''/Z - (Z'/Z)^2)
+// without finite differences of runs at neighbouring temperatures.
+// Precision is that of the run; the derivatives of the elimination are
+// exact up to rounding, like Z itself.
+
+#ifndef FIND_JET_H
+#define FIND_JET_H
+
+#include "Jet.h"
+#include <string>
+#include <vector>
+
+// Sample with bond weights exp(-2J beta) and prefactor prod exp(J beta)
+// as jets in beta.
+class JetSample
+{
+  public:
+    JetSample(const std::string &filename, const dataType &T);
+    int get_Lx();
+    int get_Ly();
+    const jet &get_Z_prefactor();
+    jet get_p_bond(int px, int py, Dir dir);
+  private:
+    int Lx, Ly;
+    jet Z_prefactor;
+    std::vector<jet> xbonds, ybonds;   // E and S bond of (x,y), at x*Ly+y
+};
+
+class FINDjet
+{
+  public:
+    FINDjet(JetSample* S);
+    FINDjet(int _Lx, int _Ly, int _offx, int _offy, JetSample* _S);
+    FINDjet(FINDjet& other);           // copy constructor (does not copy
+				       // .. submatrices)
+    ~FINDjet();
+    jet Zvert(int vsep);
+    void wrapHorz(int hsep);
+
+  private:
+    int Lx, Ly;
+    int offx, offy;
+    int mtx_L;
+    JetSample* S;
+    FINDjet* A;
+    FINDjet* B;
+    jet** mat;
+    jet   prefactor;
+
+    void initialize();
+
+    jet combine_vertical();
+    jet combine_horizontal();
+    jet Pf_eliminate(int numEvenRows);
+    void permute(const int* perm);
+    void pivotrows(int i, int j);
+    void crossOp(int i, int j);
+    void fill_mat(FINDjet* from, int* ordering);
+    void allocate_matrix(jet*** mtx, int L);
+    void copy_matrix(jet** mtx1, jet*** mtx2, int L);
+    void delete_matrix(jet*** mtx, int L);
+};
+
+// The four sector partition functions (in the order of Sector) with
+// their derivatives.
+void findPartitionJet(JetSample* S, jet Z[4]);
+
+#endif // FIND_JET_H
@@ -0,0 +1,77 @@
+// Jet.h
+//
+// Second order jet of a function of beta = 1/T: its value and first two
+// derivatives, carried through the arithmetic of the elimination by the
+// chain rule (forward mode automatic differentiation).  Every quantity
+// of FINDjet is a jet, so one run yields Z, dZ/dbeta and d2Z/dbeta2.
+// A product costs six multiplications instead of one; addmul() forms
+// x += a*b in place.
+
+#ifndef JET_H
+#define JET_H
+
+#include "../Z_to_txt/dataType.h"
+
+struct jet
+{
+  dataType v, d1, d2;                  // f, df/dbeta, d2f/dbeta2
+
+  jet() : v(0), d1(0), d2(0) {}
+  jet(const dataType &_v, const dataType &_d1, const dataType &_d2)
+  : v(_v), d1(_d1), d2(_d2) {}
+  explicit jet(int c) : v(c), d1(0), d2(0) {}
+
+  jet operator-() const { return jet(-v, -d1, -d2); }
+  jet& operator+=(const jet &a) { v += a.v; d1 += a.d1; d2 += a.d2; return *this; }
+  jet& operator-=(const jet &a) { v -= a.v; d1 -= a.d1; d2 -= a.d2; return *this; }
+
+  void addmul(const jet &a, const jet &b)
+  {
+    static dataType t;                 // no temporaries in the inner loop
+    mpf_mul(t.get_mpf_t(), a.d2.get_mpf_t(), b.v.get_mpf_t());
+    mpf_add(d2.get_mpf_t(), d2.get_mpf_t(), t.get_mpf_t());
+    mpf_mul(t.get_mpf_t(), a.v.get_mpf_t(), b.d2.get_mpf_t());
+    mpf_add(d2.get_mpf_t(), d2.get_mpf_t(), t.get_mpf_t());
+    mpf_mul(t.get_mpf_t(), a.d1.get_mpf_t(), b.d1.get_mpf_t());
+    mpf_mul_2exp(t.get_mpf_t(), t.get_mpf_t(), 1);
+    mpf_add(d2.get_mpf_t(), d2.get_mpf_t(), t.get_mpf_t());
+    mpf_mul(t.get_mpf_t(), a.d1.get_mpf_t(), b.v.get_mpf_t());
+    mpf_add(d1.get_mpf_t(), d1.get_mpf_t(), t.get_mpf_t());
+    mpf_mul(t.get_mpf_t(), a.v.get_mpf_t(), b.d1.get_mpf_t());
+    mpf_add(d1.get_mpf_t(), d1.get_mpf_t(), t.get_mpf_t());
+    mpf_mul(t.get_mpf_t(), a.v.get_mpf_t(), b.v.get_mpf_t());
+    mpf_add(v.get_mpf_t(), v.get_mpf_t(), t.get_mpf_t());
+  }
+
+  bool is_zero() const { return v == 0 && d1 == 0 && d2 == 0; }
+};
+
+inline jet operator+(jet a, const jet &b) { return a += b; }
+inline jet operator-(jet a, const jet &b) { return a -= b; }
+
+inline jet operator*(const jet &a, const jet &b)
+{
+  return jet(a.v*b.v, a.d1*b.v + a.v*b.d1,
+             a.d2*b.v + 2*a.d1*b.d1 + a.v*b.d2);
+}
+
+inline jet operator*(int c, const jet &a)
+{
+  return jet(c*a.v, c*a.d1, c*a.d2);
+}
+
+inline jet operator/(const jet &a, const jet &b)
+{
+  dataType q = a.v/b.v;
+  dataType q1 = (a.d1 - q*b.d1)/b.v;
+  return jet(q, q1, (a.d2 - 2*q1*b.d1 - q*b.d2)/b.v);
+}
+
+// jet of exp(c*beta), given its value at the current beta; bond weights
+// (c = -2J) and prefactor factors (c = J)
+inline jet exp_beta(const dataType &value, const dataType &c)
+{
+  return jet(value, c*value, c*c*value);
+}
+
+#endif // JET_H
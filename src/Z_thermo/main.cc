@@ -0,0 +1,101 @@
+// main.cc
+// Thermodynamics of the four boundary sectors (see FINDjet.h): takes the
+// arguments of isingZToTxt and writes, next to the same Z.txt, thermo.txt
+// with one line per sector (in the order of Z.txt): its name, Z,
+// dZ/dbeta, d2Z/dbeta2, the internal energy U and the specific heat C.
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <cmath>
+#include <cstdlib>
+#include "FINDjet.h"
+
+void createDirectory(const std::string &path) {
+    std::string command = "mkdir -p " + path;
+    int status = system(command.c_str());
+    if (status != 0) {
+        std::cerr << "Error creating directory: " << path << std::endl;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+  if (argc < 8 || argc > 9)
+  {
+    std::cout << "FIND2DIsing thermo: partition functions of a 2D Ising model with their temperature derivatives\n";
+    std::cout << "usage: " << argv[0] << " bitsOfPrecision Lx Ly seed probability temperature directory [std dev] \n";
+    return 1;
+  }
+
+  int prec = atoi(argv[1]);
+  mpf_set_default_prec(prec);
+
+  int x   = atoi(argv[2]);
+  int y   = atoi(argv[3]);
+  int seed = atoi(argv[4]);
+  double prob = atof(argv[5]);
+  double T_frac = atof(argv[6]);
+
+  bool useGaussian = (argc == 9);
+  double stddev = 0.0;
+  dataType T_nish = 1.0;               // as in isingZToTxt
+  if (prob!=0){
+    T_nish = 2/std::log((1-prob)/prob);
+  }
+  if (useGaussian) {
+    T_nish = 1.0;
+    stddev = std::atof(argv[8]);
+    if (stddev <= 0) {
+      std::cerr << "Error: Std dev must be positive.\n";
+      return 1;
+    }
+  }
+  dataType T = T_frac*T_nish;
+
+  std::string directory = argv[7];
+
+  std::string input =   directory + "/interactionsGaussian/" +
+                            std::to_string(prob) + "/" +
+                            std::to_string(x) + "/" +
+                            std::to_string(y) + "/" +
+                            std::to_string(stddev) + "/" +
+                            std::to_string(seed) + "/interaction_lattice.txt";
+
+  std::string outputDir =   directory + "/resultsGaussian/" +
+                            std::to_string(prob) + "/" +
+                            std::to_string(stddev) + "/" +
+                            std::to_string(x) + "/" +
+                            std::to_string(y) + "/" +
+                            std::to_string(T_frac) + "/" +
+                            std::to_string(prec) + "/" +
+                            std::to_string(seed);
+
+  createDirectory(outputDir);
+
+  JetSample S(input, T);
+  jet Z[4];
+  findPartitionJet(&S, Z);
+
+  std::ofstream zFile((outputDir + "/Z.txt").c_str());
+  zFile.precision(int(prec*0.301));
+  zFile << std::scientific;
+  for (int s = 0; s < 4; s++)
+    zFile << Z[s].v << "\t";
+
+  std::ofstream outFile((outputDir + "/thermo.txt").c_str());
+  outFile.precision(int(prec*0.301));
+  outFile << std::scientific;
+  static const char* name[4] = {"PP", "PA", "AP", "AA"};
+  dataType beta = 1/T;
+  for (int s = 0; s < 4; s++)
+  {
+    dataType r1 = Z[s].d1/Z[s].v, r2 = Z[s].d2/Z[s].v;
+    dataType U = -r1;
+    dataType C = beta*beta*(r2 - r1*r1);
+    outFile << name[s] << "\t" << Z[s].v << "\t" << Z[s].d1 << "\t"
+            << Z[s].d2 << "\t" << U << "\t" << C << "\n";
+  }
+  std::cout << "Z and thermodynamics written to: " << outputDir << std::endl;
+  return 0;
+}
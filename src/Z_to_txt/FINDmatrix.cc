@@ -26,12 +26,19 @@
 // FINDmatrix.cc
 
 #include "FINDmatrix.h"
+#include "Profile.h"
 #include <iostream>
 #include <cstdlib> // for exit
+#include <new>     // for placement new
+#include <cstring> // for memcpy
+#include <algorithm>
+#include <atomic>
 
 
-FINDmatrix::FINDmatrix(Sample* _S)
-: offx(0), offy(0), S(_S)
+FINDmatrix::FINDmatrix(Sample* _S, bool _keepTree)
+: offx(0), offy(0), S(_S),
+  prec(_S->get_prec(_S->get_Lx(), _S->get_Ly())), keepTree(_keepTree),
+  store(NULL), prefactor(0, prec)
 {
   Lx = S->get_Lx();
   Ly = S->get_Ly();
@@ -44,7 +51,9 @@ FINDmatrix::FINDmatrix(Sample* _S)
  */
 FINDmatrix::FINDmatrix(FINDmatrix& other)
 : Lx(other.Lx), Ly(other.Ly), offx(other.offx), offy(other.offy),
-  mtx_L(other.mtx_L), S(other.S), A(NULL), B(NULL), prefactor(other.prefactor)
+  mtx_L(other.mtx_L), S(other.S), prec(other.prec), keepTree(false),
+  A(NULL), B(NULL), store(NULL),
+  prefactor(other.prefactor)
 {
   copy_matrix(other.mat,&mat,mtx_L);
 }
@@ -52,16 +61,37 @@ FINDmatrix::FINDmatrix(FINDmatrix& other)
 /*
  * FINDmatrix constructor with fixed boundaries
  */
-FINDmatrix::FINDmatrix(int _Lx, int _Ly, int _offx, int _offy, Sample* _S)
-: Lx(_Lx), Ly(_Ly), offx(_offx), offy(_offy), S(_S)
+FINDmatrix::FINDmatrix(int _Lx, int _Ly, int _offx, int _offy, Sample* _S,
+                       bool _keepTree)
+: Lx(_Lx), Ly(_Ly), offx(_offx), offy(_offy), S(_S),
+  prec(_S->get_prec(_Lx, _Ly)), keepTree(_keepTree), store(NULL),
+  prefactor(0, prec)
 {
   initialize();
 }
 
 void FINDmatrix::initialize()
+{
+  PROF_LEVEL();
+  A = NULL;
+  B = NULL;
+  mat = NULL;
+  try
+  {
+    dissect();
+  }
+  catch (...)                          // see fail(): free what was built
+  {
+    release();
+    throw;
+  }
+}
+
+void FINDmatrix::dissect()
 {
   if (Lx == 1 && Ly == 1)              // Base case: build a Kasteleyn city,
   {                                    // ..  K matrix    ->  Pfaffian storage
+    PROF_NODE_TIMER();
     A = NULL;                          // ..  0  1  1  1      1  1  1
     B = NULL;                          // .. -1  0  1  1  ->  1  1
     mtx_L = 4;                         // .. -1 -1  0  1      1
@@ -75,56 +105,327 @@ void FINDmatrix::initialize()
     mat[1][1]=1;                       // 1->3, E to W
     mat[2][0]=1;                       // 2->3, S to W
     prefactor = 1;
+    PROF_NODE(mtx_L);
+  }
+  else if (Lx*Ly == 2 && !keepTree)    // Two cities: closed form (below)
+  {
+    PROF_NODE_TIMER();
+    A = NULL;
+    B = NULL;
+    prefactor = domino();
+    PROF_NODE(mtx_L + 2);
   }
   else if (Lx > Ly)                    // Recursion with a vertical separator
   {                                    // A=left sublattice, B=right sublattice
-    A = new FINDmatrix(Lx/2,Ly,offx,offy,S);
-    B = new FINDmatrix(Lx-Lx/2,Ly,offx+Lx/2,offy,S);
-    prefactor = combine_vertical();
-    delete A; A = NULL;
-    delete B; B = NULL;
+    A = new FINDmatrix(Lx/2,Ly,offx,offy,S,keepTree);
+    B = new FINDmatrix(Lx-Lx/2,Ly,offx+Lx/2,offy,S,keepTree);
+    PROF_NODE_TIMER();
+    prefactor = combine();
+    PROF_NODE(mtx_L + 2*Ly);           // rows of A and B, deleted by combine
   }
   else                                 // Recursion with a horizontal separator
   {                                    // A=top sublattice, B=bottom sublattice
-    A = new FINDmatrix(Lx,Ly/2,offx,offy,S);
-    B = new FINDmatrix(Lx,Ly-Ly/2,offx,offy+Ly/2,S);
-    prefactor = combine_horizontal();
+    A = new FINDmatrix(Lx,Ly/2,offx,offy,S,keepTree);
+    B = new FINDmatrix(Lx,Ly-Ly/2,offx,offy+Ly/2,S,keepTree);
+    PROF_NODE_TIMER();
+    prefactor = combine();
+    PROF_NODE(mtx_L + 2*Lx);           // rows of A and B, deleted by combine
+  }
+}
+
+/*
+ * A 2x1 or 1x2 block, what combine() makes of two cities joined by the
+ * bond b: the separator pair has no pivot choice, and eliminating it
+ * leaves 1 between the boundary rows of the same city and 1/b between
+ * rows of different cities (all above the diagonal), with Pfaffian b.
+ * The entries are computed as combine() does, so they agree to the last
+ * bit, without the two cities, the 8x8 matrix and the elimination.
+ * Rows as in orderings(): 2x1 = A.N B.N B.E B.S A.S A.W,
+ *                         1x2 = A.N A.E B.E B.S B.W A.W.
+ */
+dataType FINDmatrix::domino()
+{
+  static const bool inA[2][6] = {{true, false, false, false, true, true},
+                                 {true, true, false, false, false, true}};
+  const bool* city = inA[Lx > Ly ? 0 : 1];
+  dataType bond(0, prec);
+  if (Lx > Ly)
+    bond = -S->get_p_bond(offx+1,offy,W);
+  else
+    bond = S->get_p_bond(offx,offy+1,N);
+  if (bond == 0)
+    fail("zero superdiag error");
+  dataType one(1, prec), inv(0, prec);
+  mpf_div(inv.get_mpf_t(), one.get_mpf_t(), bond.get_mpf_t());
+
+  mtx_L = 6;
+  allocate_matrix(&mat,mtx_L);
+  for (int i=0; i<mtx_L-1; i++)
+    for (int j=i+1; j<mtx_L; j++)
+      mat[i][j-i-1] = (city[i] == city[j]) ? one : inv;
+  return bond;
+}
+
+/*
+ * Combine the two children.  Unless the tree is kept for update(), the
+ * children are not needed anymore once their matrices are merged.
+ */
+dataType FINDmatrix::combine()
+{
+  dataType pf = (Lx > Ly) ? combine_vertical() : combine_horizontal();
+  if (!keepTree)
+  {
     delete A; A = NULL;
     delete B; B = NULL;
   }
+  return pf;
+}
+
+/*
+ * Incremental recomputation after a bond weight has changed:
+ * a bond is used by the combine step of the one node whose separator
+ * it crosses, so only that node and its ancestors are recombined.
+ * (x,y,dir) are spin coordinates as in the input file.  Bonds on the
+ * outer boundary of the full lattice enter only in wrapHorz and Zvert,
+ * which work on copies, so nothing needs to be redone for them here.
+ * Returns true if this node was recombined.
+ */
+bool FINDmatrix::update(int x, int y, Dir dir)
+{
+  if (!keepTree)
+    fail("update() needs a dissection tree built with keepTree");
+  S->bond_index(x, y, dir);
+  bool inside;
+  if (dir == E)                        // N bond of plaquette (x,y)
+    inside = x >= offx && x < offx+Lx && y > offy && y < offy+Ly;
+  else                                 // W bond of plaquette (x,y)
+    inside = y >= offy && y < offy+Ly && x > offx && x < offx+Lx;
+  if (!inside)
+    return false;
+  PROF_LEVEL();
+  A->update(x, y, dir);
+  B->update(x, y, dir);
+  delete_matrix(&mat,mtx_L);
+  PROF_NODE_TIMER();
+  prefactor = combine();
+  PROF_NODE(A->mtx_L + B->mtx_L);
+  return true;
+}
+
+/*
+ * Constructor from two children that have already been dissected, e.g.
+ * by other processes (see Z_dist).  A and B must be the halves that
+ * initialize() would build for this geometry.
+ */
+FINDmatrix::FINDmatrix(int _Lx, int _Ly, int _offx, int _offy, Sample* _S,
+                       FINDmatrix* _A, FINDmatrix* _B)
+: Lx(_Lx), Ly(_Ly), offx(_offx), offy(_offy), S(_S),
+  prec(_S->get_prec(_Lx, _Ly)), keepTree(false), A(_A), B(_B), mat(NULL),
+  store(NULL), prefactor(0, prec)
+{
+  PROF_NODE_TIMER();
+  try
+  {
+    prefactor = combine();
+  }
+  catch (...)
+  {
+    release();
+    throw;
+  }
+  PROF_NODE(mtx_L);
+}
+
+/*
+ * Strip mode (see Strip.h).  wrapSides closes the x direction of a node
+ * that spans the full width: the E and W rows are joined by the bonds
+ * that wrap around the rows, as in Z(vsep,hsep), brought to the front
+ * and eliminated.  What is left is a cylinder whose rows are the N side
+ * (left to right) and the S side (right to left), recorded as Ly = 0, so
+ * that orderings() lays out a stack of two cylinders like a horizontal
+ * separator with empty sides.
+ */
+void FINDmatrix::wrapSides(int vsep)
+{
+  for (int i=0; i<Ly; i++)
+    mat[Lx+i][Lx+2*Ly-2*i-2] -= vsep*S->get_p_bond(offx,offy+i,W);
+  int* perm = new int[mtx_L];          // new -> old: E, W, N, S
+  int k = 0;
+  for (int i=0; i<Ly; i++)
+    perm[k++] = Lx+i;
+  for (int i=0; i<Ly; i++)
+    perm[k++] = 2*Lx+Ly+i;
+  for (int i=0; i<Lx; i++)
+    perm[k++] = i;
+  for (int i=0; i<Lx; i++)
+    perm[k++] = Lx+Ly+i;
+  int xchgfactor = 1;                  // sign: parity of the cycles
+  std::vector<bool> seen(mtx_L, false);
+  for (int i=0; i<mtx_L; i++)
+  {
+    if (seen[i])
+      continue;
+    seen[i] = true;
+    for (int j=perm[i]; j != i; j=perm[j])
+    {
+      seen[j] = true;
+      xchgfactor = -xchgfactor;
+    }
+  }
+  permute(perm);
+  delete[] perm;
+  prefactor *= Pf_eliminate(Ly) * xchgfactor;
+  Ly = 0;
+}
+
+/*
+ * Cylinder _B (wrapSides done) stacked below cylinder _A: the bonds
+ * between the S side of A and the N side of B are those of B's sample,
+ * the N side of the result that of A.  Takes ownership of both.
+ */
+FINDmatrix::FINDmatrix(FINDmatrix* _A, FINDmatrix* _B)
+: Lx(_A->Lx), Ly(0), offx(_A->offx), offy(_A->offy), S(_B->S),
+  prec(_A->prec), keepTree(false), A(_A), B(_B), mat(NULL), store(NULL),
+  prefactor(0, prec)
+{
+  Sample* top = A->S;
+  PROF_NODE_TIMER();
+  try
+  {
+    prefactor = combine_horizontal();
+  }
+  catch (...)
+  {
+    release();
+    throw;
+  }
+  PROF_NODE(mtx_L);
+  delete A; A = NULL;
+  delete B; B = NULL;
+  S = top;
+}
+
+// close the y direction of a cylinder: N side to S side
+dataType FINDmatrix::Zcylinder(int hsep)
+{
+  for (int i=0; i<Lx; i++)
+    mat[i][2*Lx-2*i-2] += hsep*S->get_p_bond(offx+i,offy,N);
+  return prefactor * Pf_eliminate(Lx);
+}
+
+/*
+ * Serialization for sending matrices between processes: five ints of
+ * geometry, then the prefactor and the entries as raw mpf limbs.  Both
+ * sides must use the same precision and limb layout (same GMP build).
+ */
+void FINDmatrix::pack(std::vector<char> &buf)
+{
+  int geometry[5] = {Lx, Ly, offx, offy, mtx_L};
+  buf.insert(buf.end(), (char*)geometry, (char*)(geometry+5));
+  pack(buf, prefactor);
+  for (int i=0; i<mtx_L-1; i++)
+    for (int j=0; j<mtx_L-1-i; j++)
+      pack(buf, mat[i][j]);
+}
+
+FINDmatrix::FINDmatrix(const char* &buf, Sample* _S)
+: S(_S), prec(_S->get_prec()), keepTree(false), A(NULL), B(NULL),
+  store(NULL), prefactor(0, prec)
+{
+  int geometry[5];
+  memcpy(geometry, buf, sizeof(geometry));
+  buf += sizeof(geometry);
+  Lx = geometry[0]; Ly = geometry[1];
+  offx = geometry[2]; offy = geometry[3];
+  mtx_L = geometry[4];
+  unpack(buf, prefactor);
+  allocate_matrix(&mat,mtx_L);
+  try
+  {
+    for (int i=0; i<mtx_L-1; i++)
+      for (int j=0; j<mtx_L-1-i; j++)
+        unpack(buf, mat[i][j]);
+  }
+  catch (...)
+  {
+    release();
+    throw;
+  }
+}
+
+void FINDmatrix::pack(std::vector<char> &buf, const dataType &x)
+{
+  mpf_srcptr f = x.get_mpf_t();
+  int size = f->_mp_size;
+  long exp = f->_mp_exp;
+  buf.insert(buf.end(), (char*)&size, (char*)(&size+1));
+  buf.insert(buf.end(), (char*)&exp, (char*)(&exp+1));
+  buf.insert(buf.end(), (char*)f->_mp_d, (char*)(f->_mp_d + abs(size)));
+}
+
+void FINDmatrix::unpack(const char* &buf, dataType &x)
+{
+  mpf_ptr f = x.get_mpf_t();
+  int size;
+  long exp;
+  memcpy(&size, buf, sizeof(size));
+  buf += sizeof(size);
+  memcpy(&exp, buf, sizeof(exp));
+  buf += sizeof(exp);
+  if (abs(size) > f->_mp_prec+1)
+    fail("unpack: value exceeds the precision of the target");
+  memcpy(f->_mp_d, buf, abs(size)*sizeof(mp_limb_t));
+  buf += abs(size)*sizeof(mp_limb_t);
+  f->_mp_size = size;
+  f->_mp_exp = exp;
 }
 
 FINDmatrix::FINDmatrix(int _mtx_L, dataType** input_matrix)
+: S(NULL), prec(input_matrix[0][0].get_prec()), store(NULL),
+  prefactor(0, prec)
 {
+  keepTree = false;
   A = NULL;
   B = NULL;
 
   mtx_L = _mtx_L;
-  mat = new dataType*[mtx_L-1];
-  for (int i=0; i<mtx_L; i++)
-    mat[i] = new dataType[mtx_L-1-i];
   for (int i=0; i<mtx_L; i++)
   {
     if (input_matrix[i][i] != 0)
-    {
-      std::cerr << "non-skew-symmetric matrix provided, aborting\n";
-      exit(1);
-    }
+      fail("non-skew-symmetric matrix provided, aborting");
     for (int j=i+1; j<mtx_L; j++)
-    {
       if (input_matrix[i][j] != -input_matrix[j][i])
-      {
-	std::cerr << "non-skew-symmetric matrix provided, aborting\n";
-	exit(1);
-      }
-      mat[i][j-i-1] = input_matrix[i][j];
-    }
+	fail("non-skew-symmetric matrix provided, aborting");
   }
+  allocate_matrix(&mat,mtx_L);
+  for (int i=0; i<mtx_L; i++)
+    for (int j=i+1; j<mtx_L; j++)
+      mat[i][j-i-1] = input_matrix[i][j];
 
   prefactor = 1;
 }
 
+static std::atomic<bool> throwErrors(false);
+
+void FINDmatrix::throw_errors()
+{
+  throwErrors = true;
+}
+
+void FINDmatrix::fail(const std::string &message)
+{
+  if (throwErrors)
+    throw FINDerror(message);
+  std::cerr << message << "\n";
+  exit(1);
+}
+
 FINDmatrix::~FINDmatrix()
+{
+  release();
+}
+
+void FINDmatrix::release()
 {
   if (A != NULL)
     delete A;
@@ -137,23 +438,54 @@ FINDmatrix::~FINDmatrix()
   mat = NULL;
 }
 
+/*
+ * Rows are constructed entry by entry at the precision of the sample
+ * (new dataType[n] would use the process-wide default precision), or
+ * taken from the out-of-core store if the matrix has one.
+ */
+dataType* FINDmatrix::allocate_row(int n)
+{
+  if (store != NULL)
+  {
+    dataType* row = store->allocate_row(n);
+    if (row != NULL)
+      return row;
+  }
+  dataType* row = static_cast<dataType*>(::operator new[](n*sizeof(dataType)));
+  for (int j=0; j<n; j++)
+    new (&row[j]) dataType(0, prec);
+  return row;
+}
+
+void FINDmatrix::delete_row(dataType* row, int n)
+{
+  if (store != NULL && store->contains(row))
+  {
+    store->release_row(row, n);
+    return;
+  }
+  for (int j=0; j<n; j++)
+    row[j].~dataType();
+  ::operator delete[](row);
+}
+
 void FINDmatrix::allocate_matrix(dataType*** mtx, int L)
 {
+  PROF_COUNT(ALLOCATED, (long)L*(L-1)/2);
+  store = MappedStore::create(L, prec);
   (*mtx) = new dataType*[L-1];
   for (int i=0; i<L-1; i++)
-  {
-    (*mtx)[i] = new dataType[L-1-i];
-    for (int j=0; j<L-1-i; j++)
-      (*mtx)[i][j] = 0;
-  }
+    (*mtx)[i] = allocate_row(L-1-i);
 }
 
 void FINDmatrix::copy_matrix(dataType** mtx1, dataType*** mtx2, int L)
 {
+  PROF_COUNT(ALLOCATED, (long)L*(L-1)/2);
+  store = MappedStore::create(L, prec);
   (*mtx2) = new dataType*[L-1];
   for (int i=0; i<L-1; i++)
   {
-    (*mtx2)[i] = new dataType[L-1-i];
+    (*mtx2)[i] = allocate_row(L-1-i);
     for (int j=0; j<L-1-i; j++)
       (*mtx2)[i][j] = mtx1[i][j];
   }
@@ -162,8 +494,10 @@ void FINDmatrix::copy_matrix(dataType** mtx1, dataType*** mtx2, int L)
 void FINDmatrix::delete_matrix(dataType*** mtx, int L)
 {
   for (int i=0; i<L-1; i++)
-    delete[] (*mtx)[i];
+    delete_row((*mtx)[i], L-1-i);
   delete[] (*mtx);
+  delete store;
+  store = NULL;
 }
 
 void FINDmatrix::allocate_transpose_matrix(dataType*** mtx, int L)
@@ -171,7 +505,7 @@ void FINDmatrix::allocate_transpose_matrix(dataType*** mtx, int L)
   (*mtx) = new dataType*[L];
   for (int i=0; i<L; i++)
   {
-    (*mtx)[i] = new dataType[1+i];
+    (*mtx)[i] = allocate_row(1+i);
     for (int j=0; j<1+i; j++)
       (*mtx)[i][j] = (i==j);
   }
@@ -207,26 +541,39 @@ dataType FINDmatrix::wrapHorz(int hsep)
     mat[i][2*Lx+Ly-2*i-2] += hsep*S->get_p_bond(offx+i,offy,N);
   // reorder self so that the horizontal bonds, those that
   // cross the vertical axis, are up front, to be eliminated.
-  // (4 groups of bonds: bottom, right, top, left, traversed ccw.)
-  // (reverse right group, top group, then right through top)
+  // The row swaps are only composed here, as a map from new to old
+  // index, and applied in one pass by permute().
+  int* perm = new int[mtx_L];
+  int xchgfactor = wrapPermutation(perm);
+  PROF_COUNT(SWAPROW, Ly/2 + Lx/2 + (Lx+Ly)/2);
+  permute(perm);
+  delete[] perm;
+  prefactor *= Pf_eliminate(Lx) * xchgfactor;
+  return prefactor;
+}
+
+// The row order of wrapHorz as a map from new to old index (4 groups of
+// bonds: bottom, right, top, left, traversed ccw; reverse right group,
+// top group, then right through top).  Returns the sign of the
+// permutation.
+int FINDmatrix::wrapPermutation(int* perm)
+{
+  for (int i = 0; i < mtx_L; ++i)
+    perm[i] = i;
   int xchgfactor = 1;
   for (int i = 0; i < Ly/2; ++i) {
-    swaprows(Lx+i, Lx+Ly-1-i);
-    //std::cout << Lx+i << " <-> " << Lx+Ly-1-i-(Lx+i+1) << "\n";
+    std::swap(perm[Lx+i], perm[Lx+Ly-1-i]);
     xchgfactor = -xchgfactor;
   }
   for (int i = 0; i < Lx/2; ++i) {
-    swaprows(Lx+Ly+i, Lx+Ly+Lx-1-i);
-    //std::cout << Lx+Ly+i << " <-> " << Lx+Ly+Lx-1-i-(Lx+Ly+i+1) << "\n";
+    std::swap(perm[Lx+Ly+i], perm[Lx+Ly+Lx-1-i]);
     xchgfactor = -xchgfactor;
   }
   for (int i = 0; i < (Lx+Ly)/2; ++i) {
-    swaprows(Lx+i, Lx+Ly+Lx-1-i);
-    //std::cout << Lx+i << " <-> " << Lx+Ly+Lx-1-i-(Lx+i+1) << "\n";
+    std::swap(perm[Lx+i], perm[Lx+Ly+Lx-1-i]);
     xchgfactor = -xchgfactor;
   }
-  prefactor *= Pf_eliminate(Lx) * xchgfactor;
-  return prefactor;
+  return xchgfactor;
 }
 
 void FINDmatrix::output()
@@ -250,6 +597,45 @@ void FINDmatrix::output()
 }
 
 
+/*
+ * Rows of the combined matrix: first the pairs of rows across the
+ * separator, interleaved from A and B (these are eliminated), then the
+ * remaining boundary of A and B, counterclockwise.  Aordering and
+ * Bordering map the rows of A and B to their new positions.
+ */
+void FINDmatrix::orderings(int* Aordering, int* Bordering, bool vertical)
+{
+  int counter = 0;
+  if (vertical)                        // vertical separator
+  {
+    for (int i=0; i<Ly; i++)           // interleaving part
+    {
+      Bordering[2*B->Lx+2*Ly-1-i] = counter++;
+      Aordering[A->Lx+i] = counter++;
+    }
+    for (int i=0; i<A->Lx; i++)
+      Aordering[i] = counter++;
+    for (int i=0; i<2*B->Lx+Ly; i++)
+      Bordering[i] = counter++;
+    for (int i=0; i<A->Lx+Ly; i++)
+      Aordering[A->Lx+Ly+i] = counter++;
+  }
+  else                                 // horizontal separator
+  {
+    for (int i=0; i<Lx; i++)           // interleaving part
+    {
+      Aordering[Lx+A->Ly+i] = counter++;
+      Bordering[Lx-1-i] = counter++;
+    }
+    for (int i=0; i<Lx+A->Ly; i++)
+      Aordering[i] = counter++;
+    for (int i=0; i<Lx+2*B->Ly; i++)
+      Bordering[Lx+i] = counter++;
+    for (int i=0; i<A->Ly; i++)
+      Aordering[2*Lx+A->Ly+i] = counter++;
+  }
+}
+
 dataType FINDmatrix::combine_vertical()
 {
   mtx_L = A->mtx_L + B->mtx_L;
@@ -257,20 +643,10 @@ dataType FINDmatrix::combine_vertical()
 
   int* Aordering = new int[A->mtx_L];
   int* Bordering = new int[B->mtx_L];
-  int counter = 0;
-  for (int i=0; i<Ly; i++)             // interleaving part
-  {
-    Bordering[2*B->Lx+2*Ly-1-i] = counter++;
-    Aordering[A->Lx+i] = counter++;
-    mat[counter-2][0] = -S->get_p_bond(B->offx,offy+i,W);
-  }
-  for (int i=0; i<A->Lx; i++)
-    Aordering[i] = counter++;
-  for (int i=0; i<2*B->Lx+Ly; i++)
-    Bordering[i] = counter++;
-  for (int i=0; i<A->Lx+Ly; i++)
-    Aordering[A->Lx+Ly+i] = counter++;
-  
+  orderings(Aordering, Bordering, true);
+  for (int i=0; i<Ly; i++)             // bonds across the separator
+    mat[2*i][0] = -S->get_p_bond(B->offx,offy+i,W);
+
   fill_mat(A,Aordering);
   fill_mat(B,Bordering);
 
@@ -288,19 +664,12 @@ dataType FINDmatrix::combine_horizontal()
 
   int* Aordering = new int[A->mtx_L];
   int* Bordering = new int[B->mtx_L];
-  int counter = 0;
-  for (int i=0; i<Lx; i++)             // interleaving part
+  orderings(Aordering, Bordering, false);
+  for (int i=0; i<Lx; i++)             // bonds across the separator
   {
-    Aordering[Lx+A->Ly+i] = counter++;
-    Bordering[Lx-1-i] = counter++;
-    mat[counter-2][0] = S->get_p_bond(offx+Lx-1-i,B->offy,N);
+    const dataType bond = S->get_p_bond(offx+Lx-1-i,B->offy,N);
+    mat[2*i][0] = bond;                // copied, not moved (MappedStore.h)
   }
-  for (int i=0; i<Lx+A->Ly; i++)
-    Aordering[i] = counter++;
-  for (int i=0; i<Lx+2*B->Ly; i++)
-    Bordering[Lx+i] = counter++;
-  for (int i=0; i<A->Ly; i++)
-    Aordering[2*Lx+A->Ly+i] = counter++;
 
   fill_mat(A,Aordering);
   fill_mat(B,Bordering);
@@ -313,16 +682,23 @@ dataType FINDmatrix::combine_horizontal()
 
 void FINDmatrix::fill_mat(FINDmatrix* from, int* ordering)
 {
+  PROF_COUNT(FILLED, (long)from->mtx_L*(from->mtx_L-1)/2);
   for (int i=0; i<from->mtx_L; i++)
   {
     int newi = ordering[i];
     for (int j=0; j<from->mtx_L-1-i; j++)
     {
       int newj = ordering[j+1+i];
+      dataType &to = (newi > newj) ? mat[newj][newi-newj-1]
+                                   : mat[newi][newj-newi-1];
+      if (keepTree || store != NULL || from->store != NULL ||
+          from->prec != prec)
+        to = from->mat[i][j];          // children kept, limbs mapped or
+                                       // .. promoted to this precision
+      else                             // .. else move the limbs over
+        mpf_swap(to.get_mpf_t(), from->mat[i][j].get_mpf_t());
       if (newi > newj)
-        mat[newj][newi-newj-1] = -from->mat[i][j];
-      else
-        mat[newi][newj-newi-1] = from->mat[i][j];
+        mpf_neg(to.get_mpf_t(), to.get_mpf_t());
     }
   }
 }
@@ -332,50 +708,43 @@ void FINDmatrix::fill_mat(FINDmatrix* from, int* ordering)
 // rest of the matrix is unchanged by this
 dataType FINDmatrix::Pf_eliminate(int numEvenRows)
 {
+  PROF_COUNT(ELIMINATED, 2*numEvenRows);
   int pivotfactor = 1;
+  std::vector<dataType> scale(mtx_L, dataType(0, prec));
+  dataType maxMag(0, prec), tmp(0, prec);
   for (int i = 0; i < numEvenRows*2; i += 2)
   {
-    dataType maxMag = 0;
+    maxMag = 0;
     int pivotrow = 0;
 //  for (int j = 0; j < numEvenRows*2-i; j += 2)
     for (int j = 0; j < numEvenRows*2-i-1; j++)
     {
-      if (mat[i][j] > maxMag)
+      mpf_abs(tmp.get_mpf_t(), mat[i][j].get_mpf_t());
+      if (tmp > maxMag)
       {
 	pivotrow = j;
-	maxMag = mat[i][j];
-      }
-      if (mat[i][j] < -maxMag)
-      {
-	pivotrow = j;
-	maxMag = -mat[i][j];
+	mpf_swap(maxMag.get_mpf_t(), tmp.get_mpf_t());
       }
     }
     if (pivotrow != 0)
     {
+      PROF_COUNT(PIVOT, 1);
       pivotfactor = -pivotfactor;
       pivotrows(i, pivotrow);
     }
     if (mat[i][0] == 0)
-    {
-      std::cerr << "zero superdiag error\n";
-      exit(1);
-    }
-    for (int j = 1; j < mtx_L - i - 1; j++)
-    {				       // do the cross operation
-      if (mat[i][j] != 0)
-	crossOp(i, j);
-    }
+      fail("zero superdiag error");
+    crossOps(i, &scale[0], tmp);
   }
 
-  dataType superDiagProd = 1.;
+  dataType superDiagProd(1, prec);
   for (int i = 0; i < numEvenRows * 2; i += 2)
     superDiagProd *= mat[i][0];
 
   if (2*numEvenRows < mtx_L)
   {
     for (int i=0; i<2*numEvenRows; i++)
-      delete[] mat[i];
+      delete_row(mat[i], mtx_L-1-i);
     mtx_L -= 2*numEvenRows;
     dataType** newmat = new dataType*[mtx_L-1];
     for (int i=0; i<mtx_L-1; i++)
@@ -386,44 +755,54 @@ dataType FINDmatrix::Pf_eliminate(int numEvenRows)
   return pivotfactor * superDiagProd;
 }
 
-// i and j are both row indices, not offsets
-// does not assume zeros in previous rows, see pivotrows() for pivoting op
-void FINDmatrix::swaprows(int i, int j) { // swap rows i and j; true row indices, not offset for j
-        if (j < i) {int tmpr = i; i = j; j = tmpr;}  // order the two arguments so that i is smaller
-        dataType tmp;
-        int rowA, offA, rowB, offB, flag;
-        mat[i][j-i-1] = -mat[i][j-i-1];
-        for (int k = 0; k < mtx_L; ++k) {  // swap rows k
-                if (k == i || k == j) continue; // skips two elements: zero (diag) and negated
-                if (k < i) {
-                        rowA = k;
-                        offA = i - k - 1;
-                        flag = 1;
-                } else {
-                        rowA = i;
-                        offA = k - i - 1;
-                        flag = -1;
-                }
-                if (k < j) {
-                        rowB = k;
-                        offB = j - k - 1;
-                        //flag = flag;
-                } else {
-                        rowB = j;
-                        offB = k - j - 1;
-                        flag = -flag;
-                }
-                tmp = flag * mat[rowA][offA];
-                mat[rowA][offA] = flag * mat[rowB][offB];
-                mat[rowB][offB] = tmp;
+// Reorder rows and columns: the new entry (a,b) is the old entry
+// (perm[a],perm[b]).  Entries are moved along the cycles of the induced
+// permutation of the upper triangle with mpf_swap, which exchanges limb
+// pointers only (values are copied for an out-of-core matrix, whose rows
+// release their own limbs), and negated in place where perm reverses the
+// order of a pair.  The sign of the Pfaffian is left to the caller.
+void FINDmatrix::permute(const int* perm)
+{
+  std::vector<long> start(mtx_L);      // linear index of (a,a+1)
+  for (int a = 0, n = 0; a < mtx_L; n += mtx_L-1-a, a++)
+    start[a] = n;
+  std::vector<bool> done((long)mtx_L*(mtx_L-1)/2, false);
+  dataType tmp(0, prec);
+  for (int a = 0; a < mtx_L-1; a++)
+    for (int b = a+1; b < mtx_L; b++)
+    {
+      if (done[start[a]+b-a-1])
+        continue;
+      int ca = a, cb = b;              // cycle through (a,b)
+      while (true)
+      {
+        done[start[ca]+cb-ca-1] = true;
+        int sa = std::min(perm[ca], perm[cb]), sb = std::max(perm[ca], perm[cb]);
+        if (sa == a && sb == b)
+          break;
+        if (store == NULL)
+          mpf_swap(mat[ca][cb-ca-1].get_mpf_t(), mat[sa][sb-sa-1].get_mpf_t());
+        else                           // limbs stay with their row, see
+        {                              // .. MappedStore::release_row
+          tmp = mat[ca][cb-ca-1];
+          mat[ca][cb-ca-1] = mat[sa][sb-sa-1];
+          mat[sa][sb-sa-1] = tmp;
         }
+        if (perm[ca] > perm[cb])
+          mpf_neg(mat[ca][cb-ca-1].get_mpf_t(), mat[ca][cb-ca-1].get_mpf_t());
+        ca = sa;
+        cb = sb;
+      }
+      if (perm[ca] > perm[cb])
+        mpf_neg(mat[ca][cb-ca-1].get_mpf_t(), mat[ca][cb-ca-1].get_mpf_t());
+    }
 }
 
 // i is native row - swap with row i+j (j is the offset)
 // assumes zeros in previous rows, see swaprows() for full pre-elimination swap
 void FINDmatrix::pivotrows(int i, int j)
 {
-  dataType tmp;
+  dataType tmp(0, prec);
   // see diagram for cross op: i) swap x and y, ii) -1 with c, iii) : with -: iv) 2 with d
   // i) - swap x,y 
   tmp = mat[i][0];
@@ -450,14 +829,55 @@ void FINDmatrix::pivotrows(int i, int j)
   }
 }
 
-void FINDmatrix::crossOp(int i, int j)
-{ // already tested that [i][0] != 0 and [i][j] != 0
-  dataType scaleFactor = -mat[i][j]/mat[i][0]; // j >= 1
-  mat[i][j] = 0;                      // zap [i][j] exactly
-  for (int k = 0; k < j - 1; ++k)     // add column i+1 to col j - from -transpose:
-    if (mat[i+1][k] != 0)           // items 1 to c in diagram above
-      mat[i+2+k][j-k-2] -= scaleFactor * mat[i+1][k];
-  for (int k = 0; j + k < mtx_L-i-2; k++) // add rows: adding 2 entries to d entries
-    if (mat[i+1][j+k] != 0)
-      mat[i+j+1][k] += scaleFactor * mat[i+1][j+k];
+/*
+ * All cross operations of pivot row i.  Operation j (for each nonzero
+ * [i][j], j >= 1) zaps [i][j] by adding multiples of row/column i+1:
+ *   [i+2+k][j-k-2] -= s_j [i+1][k]     for k < j-1
+ *   [i+j+1][k]     += s_j [i+1][j+k]
+ * with s_j = -[i][j]/[i][0].  Rows i and i+1 are only read, so the s_j
+ * are computed first and the updates then applied row by row: row r
+ * takes the second kind from j = r-i-1, then the first kind from all
+ * j > r-i-1, the order in which one operation after the other would
+ * apply them.  Each row of the trailing matrix is thus swept once per
+ * pivot, which keeps an out-of-core matrix streaming.  Products go
+ * through tmp (at the precision of the matrix, as the temporaries of
+ * gmpxx would), so the sweep does not allocate.
+ */
+void FINDmatrix::crossOps(int i, dataType* scale, dataType &tmp)
+{
+  int n = mtx_L - i - 1;               // length of row i
+  mpf_ptr t = tmp.get_mpf_t();
+  for (int j = 1; j < n; j++)
+  {
+    if (mat[i][j] != 0)
+    {
+      PROF_COUNT(CROSSOP, 1);
+      mpf_div(scale[j].get_mpf_t(), mat[i][j].get_mpf_t(), mat[i][0].get_mpf_t());
+      mpf_neg(scale[j].get_mpf_t(), scale[j].get_mpf_t());
+      mat[i][j] = 0;                   // zap [i][j] exactly
+    }
+    else
+      scale[j] = 0;
+  }
+  for (int r = i+2; r < mtx_L-1; r++)
+  {
+    if (store != NULL && r + 4 < mtx_L-1)
+      store->prefetch(mat[r+4], mtx_L-1-(r+4));
+    int j = r - i - 1;
+    if (scale[j] != 0)
+      for (int k = 0; j + k < n-1; k++)
+        if (mat[i+1][j+k] != 0)
+        {
+          mpf_mul(t, scale[j].get_mpf_t(), mat[i+1][j+k].get_mpf_t());
+          mpf_add(mat[r][k].get_mpf_t(), mat[r][k].get_mpf_t(), t);
+        }
+    const dataType &c = mat[i+1][r-i-2];
+    if (c != 0)
+      for (j = r-i; j < n; j++)
+        if (scale[j] != 0)
+        {
+          mpf_mul(t, scale[j].get_mpf_t(), c.get_mpf_t());
+          mpf_sub(mat[r][j-(r-i)].get_mpf_t(), mat[r][j-(r-i)].get_mpf_t(), t);
+        }
+  }
 }
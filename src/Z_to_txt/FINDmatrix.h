@@ -30,16 +30,45 @@
 
 #include "dataType.h"
 #include "Sample.h"
+#include "MappedStore.h"
 #include <cstdlib>  // for exit()
+#include <vector>
+#include <string>
+#include <stdexcept>
+
+class BondGradient;
+
+// A failed elimination (zero pivot) or malformed input to the matrix
+// code.  The command line tools print the message and exit(1); callers
+// that must survive it (libfkt, isingZServer) call
+// FINDmatrix::throw_errors() and get a FINDerror instead.
+class FINDerror : public std::runtime_error
+{
+  public:
+    explicit FINDerror(const std::string &what) : std::runtime_error(what) {}
+};
 
 class FINDmatrix
 {
   public:
-    FINDmatrix(Sample* S);             // Use full spin sample to initialize
-				       // .. the matrix.
-    FINDmatrix(int _Lx, int _Ly, int _offx, int _offy, Sample* _S);
+    FINDmatrix(Sample* S, bool _keepTree = false);
+				       // Use full spin sample to initialize
+				       // .. the matrix; keepTree retains the
+				       // .. dissection tree for update()
+    FINDmatrix(int _Lx, int _Ly, int _offx, int _offy, Sample* _S,
+               bool _keepTree = false);
 				       // initialize matrix from spin sample
 				       // .. (submatrices defined recursively)
+    FINDmatrix(int _Lx, int _Ly, int _offx, int _offy, Sample* _S,
+               FINDmatrix* _A, FINDmatrix* _B);
+				       // combine two dissected halves (built
+				       // .. as initialize() would, e.g. on
+				       // .. other processes); takes ownership
+    FINDmatrix(FINDmatrix* _A, FINDmatrix* _B);
+				       // cylinder B stacked below cylinder A
+				       // .. (strip mode); takes ownership
+    FINDmatrix(const char* &buf, Sample* _S);
+				       // unpack a matrix stored by pack()
     FINDmatrix(int _mtx_L, dataType** input_matrix);
 				       // intialize matrix directly; does NOT
 				       // .. use nested dissection
@@ -50,27 +79,68 @@ class FINDmatrix
     dataType Z(int vsep, int hsep);    // one periodic BC partition function
     dataType Zvert(int hsep);
     dataType wrapHorz(int vsep);       // probably don't use return value
+    void wrapSides(int vsep);          // strip mode: close x, leaving the
+				       // .. N and S sides (Ly becomes 0)
+    dataType Zcylinder(int hsep);      // strip mode: close y of a cylinder
+    bool update(int x, int y, Dir dir);// recombine the nodes that use bond
+				       // .. (x,y,dir) after Sample::set_bond
+    void pack(std::vector<char> &buf); // append geometry, prefactor, matrix
+    static void pack(std::vector<char> &buf, const dataType &x);
+    static void unpack(const char* &buf, dataType &x);
+				       // raw limbs; x must have the precision
+				       // .. of the packed value
+    static void throw_errors();        // fail() throws from now on
+    static void fail(const std::string &message);
+				       // exit(1), or throw FINDerror
+
+    // adjoint pass for the bond correlations, see Marginals.h;
+    // matrices are full and row major, one per sector
+    typedef std::vector<dataType> Dense;
+    void backprop(std::vector<Dense> &G, BondGradient &grad);
+				       // G = d log Z_k/d mat of this node
+				       // .. (tree built with keepTree)
+    void backpropWrap(int hsep, const dataType* c, std::vector<Dense> &G,
+                      BondGradient &grad);
+				       // through wrapHorz(hsep) of this
+				       // .. matrix; G is replaced by the
+				       // .. derivative before wrapping
+    void backpropVert(int vsep, const dataType* c, std::vector<Dense> &G,
+                      BondGradient &grad);
+				       // adds the derivative of c[k] log
+				       // .. Zvert(vsep) to G
 
   private:
     int Lx, Ly;
     int offx, offy;
     int mtx_L;
     Sample* S;
+    mp_bitcnt_t prec;                  // of every entry; S->get_prec(Lx,Ly)
+    bool keepTree;
     FINDmatrix* A;
     FINDmatrix* B;
     dataType**  mat;
+    MappedStore* store;                // rows of mat if out of core, or NULL
     dataType    prefactor;
 
     void initialize();
+    void dissect();
+    void release();                    // children and matrix
+    dataType combine();
+    dataType domino();                 // 2x1 or 1x2 block in closed form
 
     dataType combine_vertical();
     dataType combine_horizontal();
+    void orderings(int* Aordering, int* Bordering, bool vertical);
+    int wrapPermutation(int* perm);
+    void dense(Dense &K);
     dataType Pf_eliminate(int numEvenRows);
-    void swaprows(int i, int j);
+    void permute(const int* perm);
     void pivotrows(int i, int j);
-    void crossOp(int i, int j);
+    void crossOps(int i, dataType* scale, dataType &tmp);
     void fill_mat(FINDmatrix* from, int* ordering);
     void output();
+    dataType* allocate_row(int n);
+    void delete_row(dataType* row, int n);
     void allocate_matrix(dataType*** mtx, int L);
     void copy_matrix(dataType** mtx1, dataType*** mtx2, int L);
     void delete_matrix(dataType*** mtx, int L);
@@ -0,0 +1,88 @@
+// Gauge.cc
+//
+// See Gauge.h.
+
+#include "Gauge.h"
+#include <fstream>
+#include <cstdlib>
+
+bool readCouplings(const std::string &interactionFile, int &Lx, int &Ly,
+                   std::vector<std::string> &bonds)
+{
+  std::ifstream infile(interactionFile.c_str());
+  Lx = Ly = 0;
+  if (!(infile >> Lx >> Ly) || Lx <= 0 || Ly <= 0)
+    return false;
+  bonds.assign(2*Lx*Ly, "");
+  int x, y;
+  std::string direction, J;
+  while (infile >> x >> y >> direction >> J)
+  {
+    if (x < 0 || x >= Lx || y < 0 || y >= Ly)
+      continue;
+    switch (direction[0])              // as Sample::add_bond
+    {
+      case 'N': case '0': bonds[2*(((y+Ly-1)%Ly)*Lx + x) + 1] = J; break;
+      case 'E': case '1': bonds[2*(y*Lx + x)] = J; break;
+      case 'S': case '2': bonds[2*(y*Lx + x) + 1] = J; break;
+      case 'W': case '3': bonds[2*(y*Lx + (x+Lx-1)%Lx)] = J; break;
+    }
+  }
+  return true;
+}
+
+// -1, 0 or 1; absent bonds count as zero
+static int sign(const std::string &J)
+{
+  if (J.empty() || strtod(J.c_str(), NULL) == 0)
+    return 0;
+  return J[0] == '-' ? -1 : 1;
+}
+
+static void flip(std::string &J)
+{
+  if (sign(J) == 0)
+    return;
+  if (J[0] == '-')
+    J.erase(0, 1);
+  else if (J[0] == '+')
+    J[0] = '-';
+  else
+    J.insert(0, 1, '-');
+}
+
+int gaugeCanonicalize(int Lx, int Ly, std::vector<std::string> &bonds)
+{
+  // spins making the tree bonds positive (zero bonds leave them free)
+  std::vector<int> s(Lx*Ly, 1);
+  for (int y = 1; y < Ly; y++)
+    s[y*Lx] = sign(bonds[2*((y-1)*Lx) + 1]) < 0 ? -s[(y-1)*Lx] : s[(y-1)*Lx];
+  for (int y = 0; y < Ly; y++)
+    for (int x = 1; x < Lx; x++)
+      s[y*Lx + x] = sign(bonds[2*(y*Lx + x-1)]) < 0 ? -s[y*Lx + x-1] : s[y*Lx + x-1];
+
+  for (int y = 0; y < Ly; y++)
+    for (int x = 0; x < Lx; x++)
+    {
+      int i = y*Lx + x;
+      if (s[i] * s[y*Lx + (x+1)%Lx] < 0)
+        flip(bonds[2*i]);
+      if (s[i] * s[((y+1)%Ly)*Lx + x] < 0)
+        flip(bonds[2*i + 1]);
+    }
+
+  int mask = 0;
+  if (sign(bonds[2*(Lx-1)]) < 0)
+  {
+    for (int y = 0; y < Ly; y++)
+      flip(bonds[2*(y*Lx + Lx-1)]);
+    mask |= 2;
+  }
+  if (sign(bonds[2*((Ly-1)*Lx) + 1]) < 0)
+  {
+    for (int x = 0; x < Lx; x++)
+      flip(bonds[2*((Ly-1)*Lx + x) + 1]);
+    mask |= 1;
+  }
+  return mask;
+}
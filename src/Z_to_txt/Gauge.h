@@ -0,0 +1,33 @@
+// Gauge.h
+//
+// Canonical form of the couplings of a sample up to gauge and logical
+// transformations, used to key the result cache (ResultCache.h).
+//
+// Flipping all bonds around a spin leaves every sector Z unchanged, so
+// the couplings are first gauge fixed: the spins are chosen such that
+// the bonds of a spanning tree (the E bonds x = 0..Lx-2 of every row and
+// the S bonds y = 0..Ly-2 of column 0) become positive.  This fixes all
+// signs except those of a logical operator, i.e. the signs of a whole
+// seam: flipping the E bonds of column Lx-1 exchanges the periodic and
+// antiperiodic sectors in x (Z index k -> k^2), flipping the S bonds of
+// row Ly-1 those in y (k -> k^1).  The seams are then flipped such that
+// the bonds E(Lx-1,0) and S(0,Ly-1) are positive.  Two samples with the
+// same syndrome and coupling magnitudes thus have the same canonical
+// couplings and differ only by the returned sector permutation.
+
+#ifndef GAUGE_H
+#define GAUGE_H
+
+#include <string>
+#include <vector>
+
+// Couplings of an interaction file as text, bonds[2*(y*Lx+x)] the E and
+// bonds[2*(y*Lx+x)+1] the S bond of spin (x,y), "" if absent.
+bool readCouplings(const std::string &interactionFile, int &Lx, int &Ly,
+                   std::vector<std::string> &bonds);
+
+// Replaces bonds by its canonical form; returns the mask m such that
+// Z[k] of the canonical couplings is Z[k^m] of the original ones.
+int gaugeCanonicalize(int Lx, int Ly, std::vector<std::string> &bonds);
+
+#endif // GAUGE_H
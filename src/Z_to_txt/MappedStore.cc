@@ -0,0 +1,120 @@
+// MappedStore.cc
+//
+// See MappedStore.h.
+
+#include "MappedStore.h"
+#include <iostream>
+#include <cstdlib>
+#include <unistd.h>
+#include <sys/mman.h>
+
+std::string MappedStore::directory;
+size_t MappedStore::minBytes = 0;
+
+void MappedStore::configure(const std::string &_directory, size_t _minBytes)
+{
+  directory = _directory;
+  minBytes = _minBytes;
+}
+
+MappedStore* MappedStore::create(int L, mp_bitcnt_t prec)
+{
+  if (directory.empty() || L < 2)
+    return NULL;
+  dataType probe(0, prec);
+  int limbs = probe.get_mpf_t()->_mp_prec + 1;
+  MappedStore dims(-1, NULL, 0, limbs);
+  size_t size = 0;
+  for (int i=0; i<L-1; i++)
+    size += dims.row_bytes(L-1-i);
+  if (size < minBytes)
+    return NULL;
+
+  std::string name = directory + "/fktmatXXXXXX";
+  int fd = mkstemp(&name[0]);
+  if (fd < 0)
+  {
+    std::cerr << "MappedStore: cannot create a file in " << directory << "\n";
+    return NULL;
+  }
+  unlink(name.c_str());                // freed when closed
+  void* base = MAP_FAILED;
+  if (ftruncate(fd, size) == 0)
+    base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (base == MAP_FAILED)
+  {
+    std::cerr << "MappedStore: cannot map " << size << " bytes\n";
+    close(fd);
+    return NULL;
+  }
+  madvise(base, size, MADV_SEQUENTIAL);
+  return new MappedStore(fd, static_cast<char*>(base), size, limbs);
+}
+
+MappedStore::MappedStore(int _fd, char* _base, size_t _size, int _limbs)
+: fd(_fd), base(_base), size(_size), used(0), limbs(_limbs)
+{
+}
+
+MappedStore::~MappedStore()
+{
+  if (base != NULL)
+    munmap(base, size);
+  if (fd >= 0)
+    close(fd);
+}
+
+size_t MappedStore::row_bytes(int n) const
+{
+  size_t bytes = n * (sizeof(dataType) + limbs*sizeof(mp_limb_t));
+  return (bytes + 63) & ~size_t(63);
+}
+
+bool MappedStore::contains(const void* p) const
+{
+  return p >= base && p < base + size;
+}
+
+/*
+ * The entries are set up as mpf_init2 would, with the limbs in the
+ * mapping; no constructor is run, so GMP allocates nothing.
+ */
+dataType* MappedStore::allocate_row(int n)
+{
+  size_t bytes = row_bytes(n);
+  if (used + bytes > size)
+    return NULL;
+  dataType* row = reinterpret_cast<dataType*>(base + used);
+  mp_limb_t* limb = reinterpret_cast<mp_limb_t*>(row + n);
+  for (int j=0; j<n; j++)
+  {
+    mpf_ptr f = row[j].get_mpf_t();
+    f->_mp_prec = limbs - 1;
+    f->_mp_size = 0;
+    f->_mp_exp = 0;
+    f->_mp_d = limb + (size_t)j*limbs;
+  }
+  used += bytes;
+  return row;
+}
+
+// whole pages inside the row only; neighbouring rows stay in place
+void MappedStore::release_row(dataType* row, int n)
+{
+  size_t page = sysconf(_SC_PAGESIZE);
+  size_t begin = reinterpret_cast<char*>(row) - base;
+  size_t end = begin + row_bytes(n);
+  begin = (begin + page - 1) / page * page;
+  end = end / page * page;
+  if (end > begin)
+    madvise(base + begin, end - begin, MADV_REMOVE);
+}
+
+void MappedStore::prefetch(const dataType* row, int n)
+{
+  size_t page = sysconf(_SC_PAGESIZE);
+  size_t begin = reinterpret_cast<const char*>(row) - base;
+  size_t end = begin + row_bytes(n);
+  begin = begin / page * page;
+  madvise(base + begin, end - begin, MADV_WILLNEED);
+}
@@ -0,0 +1,53 @@
+// MappedStore.h
+//
+// Out-of-core storage for the large matrices of FINDmatrix.  Once a
+// scratch directory is configured, a matrix whose entries take at least
+// minBytes is placed in an unlinked file mapped into memory instead of on
+// the heap, so the lattice size is bounded by disk rather than RAM and
+// the kernel pages rows in and out.
+//
+// A row is laid out as its n mpf_t headers followed by their limbs, and
+// rows follow each other in order, matching the row by row sweep of
+// Pf_eliminate.  Rows about to be swept are prefetched explicitly
+// (MADV_WILLNEED), rows that have been eliminated are released
+// (MADV_REMOVE) so their disk blocks are freed.
+//
+// Entries in a store own no heap memory: they must not be destroyed,
+// swapped with other entries (this includes move assignment from a
+// temporary, which gmpxx implements as a swap) or given a new precision.
+
+#ifndef MAPPED_STORE_H
+#define MAPPED_STORE_H
+
+#include "dataType.h"
+#include <string>
+#include <cstddef>
+
+class MappedStore
+{
+  public:
+    static void configure(const std::string &_directory, size_t _minBytes);
+    static MappedStore* create(int L, mp_bitcnt_t prec);
+				       // store for an L x L matrix; NULL if
+				       // .. not configured, below minBytes
+				       // .. or the file cannot be mapped
+    ~MappedStore();
+    dataType* allocate_row(int n);     // NULL if the store is full
+    void release_row(dataType* row, int n);
+    void prefetch(const dataType* row, int n);
+    bool contains(const void* p) const;
+
+  private:
+    MappedStore(int _fd, char* _base, size_t _size, int _limbs);
+    size_t row_bytes(int n) const;
+
+    int fd;
+    char* base;
+    size_t size, used;
+    int limbs;                         // per entry, as mpf_init2 allocates
+
+    static std::string directory;
+    static size_t minBytes;
+};
+
+#endif // MAPPED_STORE_H
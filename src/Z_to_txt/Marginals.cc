@@ -0,0 +1,418 @@
+// Marginals.cc
+//
+// See Marginals.h.  The FINDmatrix members of the adjoint pass are
+// defined here as well.
+
+#include "Marginals.h"
+#include "FINDmatrix.h"
+#include "Partition.h"
+#include "Profile.h"
+#include <iostream>
+#include <fstream>
+#include <cstdlib>
+
+typedef FINDmatrix::Dense Dense;
+
+static const Dir bondDir[2] = {E, S};  // stored weights of a spin
+
+// Bonds of the seams that the A boundary conditions flip: E bonds of
+// the last column in AP and AA, S bonds of the last row in PA and AA.
+static bool flipped(int k, int x, int y, int d, int Lx, int Ly)
+{
+  if (d == 0)
+    return x == Lx-1 && (k == AP || k == AA);
+  return y == Ly-1 && (k == PA || k == AA);
+}
+
+BondGradient::BondGradient(Sample &S)
+: Lx(S.get_Lx()), Ly(S.get_Ly())
+{
+  for (int k = PP; k <= AA; k++)
+    g[k].assign(2*Lx*Ly, dataType(0, S.get_prec()));
+}
+
+// as Sample::get_p_bond
+void BondGradient::add_p_bond(int k, int px, int py, Dir dir, const dataType &d)
+{
+  switch(dir)
+  {
+    case N:
+      g[k][2*(px*Ly+py)] -= d;
+      break;
+    case E:
+      g[k][2*((px+1)*Ly+py)+1] += d;
+      break;
+    case S:
+      g[k][2*(px*Ly+py+1)] += d;
+      break;
+    case W:
+      g[k][2*(px*Ly+py)+1] -= d;
+      break;
+  }
+}
+
+const dataType &BondGradient::get(int k, int x, int y, Dir dir)
+{
+  return g[k][2*(x*Ly+y) + (dir == S)];
+}
+
+// x += a*b without temporaries
+static inline void addmul(dataType &x, const dataType &a, const dataType &b,
+                          dataType &t)
+{
+  mpf_mul(t.get_mpf_t(), a.get_mpf_t(), b.get_mpf_t());
+  mpf_add(x.get_mpf_t(), x.get_mpf_t(), t.get_mpf_t());
+}
+
+/*
+ * One node of the adjoint pass (formulas in Marginals.h).  K holds the
+ * first n rows [A B] of the node's M x M matrix, G[k] the derivative of
+ * log Z_k with respect to S (m x m, m = M-n) and c[k] the weight of
+ * log Pf(A) in log Z_k.  G[k] is replaced by the derivative with respect
+ * to the whole matrix.
+ */
+static void adjointStep(const Dense &K, int n, int M, const dataType* c,
+                        std::vector<Dense> &G)
+{
+  int m = M - n, W = M + n;
+  mp_bitcnt_t prec = K[0].get_prec();
+  dataType zero(0, prec), t(0, prec), f(0, prec);
+
+  // [A B | I] -> [I X | A^-1] by Gauss-Jordan elimination with partial
+  // pivoting; A is sparse at first (interleaved separator rows)
+  Dense R((long)n*W, zero);
+  for (int i = 0; i < n; i++)
+  {
+    for (int j = 0; j < M; j++)
+      R[(long)i*W+j] = K[(long)i*M+j];
+    R[(long)i*W+M+i] = 1;
+  }
+  for (int j = 0; j < n; j++)
+  {
+    int p = j;
+    for (int i = j+1; i < n; i++)
+      if (abs(R[(long)i*W+j]) > abs(R[(long)p*W+j]))
+        p = i;
+    if (R[(long)p*W+j] == 0)
+      FINDmatrix::fail("zero superdiag error");
+    dataType* rj = &R[(long)j*W];
+    if (p != j)
+      for (int l = 0; l < W; l++)
+        mpf_swap(R[(long)p*W+l].get_mpf_t(), rj[l].get_mpf_t());
+    f = 1/rj[j];
+    for (int l = j+1; l < W; l++)
+      if (rj[l] != 0)
+        rj[l] *= f;
+    rj[j] = 1;
+    for (int i = 0; i < n; i++)
+    {
+      dataType* ri = &R[(long)i*W];
+      if (i == j || ri[j] == 0)
+        continue;
+      f = ri[j];
+      for (int l = j+1; l < W; l++)
+        if (rj[l] != 0)
+        {
+          mpf_mul(t.get_mpf_t(), f.get_mpf_t(), rj[l].get_mpf_t());
+          mpf_sub(ri[l].get_mpf_t(), ri[l].get_mpf_t(), t.get_mpf_t());
+        }
+      ri[j] = 0;
+    }
+  }
+
+  Dense Y((long)n*m, zero);            // X G
+  for (int k = 0; k < 4; k++)
+  {
+    Dense &Gk = G[k];
+    for (long e = 0; e < (long)n*m; e++)
+      Y[e] = 0;
+    for (int i = 0; i < n; i++)
+      for (int a = 0; a < m; a++)
+      {
+        const dataType &x = R[(long)i*W+n+a];
+        if (x == 0)
+          continue;
+        for (int b = 0; b < m; b++)
+          if (Gk[(long)a*m+b] != 0)
+            addmul(Y[(long)i*m+b], x, Gk[(long)a*m+b], t);
+      }
+
+    Dense D((long)M*M, zero);
+    for (int i = 0; i < n; i++)        // d/dA = -c A^-1 + X G X^T
+      for (int j = i+1; j < n; j++)
+      {
+        dataType &e = D[(long)i*M+j];
+        mpf_mul(e.get_mpf_t(), c[k].get_mpf_t(), R[(long)i*W+M+j].get_mpf_t());
+        mpf_neg(e.get_mpf_t(), e.get_mpf_t());
+        for (int b = 0; b < m; b++)
+          addmul(e, Y[(long)i*m+b], R[(long)j*W+n+b], t);
+        mpf_neg(D[(long)j*M+i].get_mpf_t(), e.get_mpf_t());
+      }
+    for (int i = 0; i < n; i++)        // d/dB = -X G
+      for (int b = 0; b < m; b++)
+      {
+        mpf_neg(D[(long)i*M+n+b].get_mpf_t(), Y[(long)i*m+b].get_mpf_t());
+        D[(long)(n+b)*M+i] = Y[(long)i*m+b];
+      }
+    for (int a = 0; a < m; a++)        // d/dC = G
+      for (int b = 0; b < m; b++)
+        mpf_swap(D[(long)(n+a)*M+n+b].get_mpf_t(), Gk[(long)a*m+b].get_mpf_t());
+    Gk.swap(D);
+  }
+}
+
+// the matrix of this node as a full skew matrix, at the precision of the
+// sample
+void FINDmatrix::dense(Dense &K)
+{
+  K.assign((long)mtx_L*mtx_L, dataType(0, S->get_prec()));
+  for (int i=0; i<mtx_L-1; i++)
+    for (int j=0; j<mtx_L-1-i; j++)
+    {
+      K[(long)i*mtx_L+i+1+j] = mat[i][j];
+      K[(long)(i+1+j)*mtx_L+i] = -mat[i][j];
+    }
+}
+
+/*
+ * Adjoint of combine(): the rows eliminated there are rebuilt from the
+ * children's matrices and the separator bonds, the derivative with
+ * respect to the combined matrix is split into those of the children.
+ */
+void FINDmatrix::backprop(std::vector<Dense> &G, BondGradient &grad)
+{
+  if (A == NULL)                       // Kasteleyn city: no bonds
+    return;
+  if (!keepTree)
+    fail("backprop() needs a dissection tree built with keepTree");
+  bool vertical = Lx > Ly;
+  int n = 2*(vertical ? Ly : Lx);
+  int M = A->mtx_L + B->mtx_L;
+  std::vector<int> Aordering(A->mtx_L), Bordering(B->mtx_L);
+  orderings(&Aordering[0], &Bordering[0], vertical);
+
+  Dense K((long)n*M, dataType(0, S->get_prec()));
+  FINDmatrix* child[2] = {A, B};
+  int* ordering[2] = {&Aordering[0], &Bordering[0]};
+  for (int h = 0; h < 2; h++)
+    for (int i=0; i<child[h]->mtx_L-1; i++)
+      for (int j=0; j<child[h]->mtx_L-1-i; j++)
+      {
+        int a = ordering[h][i], b = ordering[h][i+1+j];
+        if (a < n)
+          K[(long)a*M+b] = child[h]->mat[i][j];
+        if (b < n)
+          K[(long)b*M+a] = -child[h]->mat[i][j];
+      }
+  for (int i=0; i<n/2; i++)            // as combine_vertical/horizontal
+  {
+    if (vertical)
+      K[(long)2*i*M+2*i+1] = -S->get_p_bond(B->offx,offy+i,W);
+    else
+      K[(long)2*i*M+2*i+1] = S->get_p_bond(offx+Lx-1-i,B->offy,N);
+    K[(long)(2*i+1)*M+2*i] = -K[(long)2*i*M+2*i+1];
+  }
+
+  std::vector<dataType> one(4, dataType(1, S->get_prec()));
+  adjointStep(K, n, M, &one[0], G);
+
+  std::vector<Dense> GA(4), GB(4);
+  for (int k = PP; k <= AA; k++)
+  {
+    for (int i=0; i<n/2; i++)
+    {
+      const dataType &g = G[k][(long)2*i*M+2*i+1];
+      if (vertical)
+        grad.add_p_bond(k, B->offx, offy+i, W, -g);
+      else
+        grad.add_p_bond(k, offx+Lx-1-i, B->offy, N, g);
+    }
+    std::vector<Dense>* to[2] = {&GA, &GB};
+    for (int h = 0; h < 2; h++)
+    {
+      int L = child[h]->mtx_L;
+      Dense &D = (*to[h])[k];
+      D.resize((long)L*L);
+      for (int i=0; i<L; i++)
+        for (int j=0; j<L; j++)
+          mpf_swap(D[(long)i*L+j].get_mpf_t(),
+                   G[k][(long)ordering[h][i]*M+ordering[h][j]].get_mpf_t());
+    }
+    Dense().swap(G[k]);
+  }
+  A->backprop(GA, grad);
+  B->backprop(GB, grad);
+}
+
+/*
+ * Adjoint of wrapHorz(hsep) on this (unwrapped) matrix: G is over the
+ * rows left by wrapHorz and becomes the derivative with respect to this
+ * matrix; c[k] is the weight of the eliminated block in log Z_k.
+ */
+void FINDmatrix::backpropWrap(int hsep, const dataType* c,
+                              std::vector<Dense> &G, BondGradient &grad)
+{
+  Dense K0;
+  dense(K0);
+  int L = mtx_L, n = 2*Lx;
+  for (int i=0; i<Lx; i++)             // as wrapHorz
+  {
+    int j = 2*Lx+Ly-i-1;
+    K0[(long)i*L+j] += hsep*S->get_p_bond(offx+i,offy,N);
+    K0[(long)j*L+i] = -K0[(long)i*L+j];
+  }
+  std::vector<int> perm(L);
+  wrapPermutation(&perm[0]);
+  Dense K((long)n*L, dataType(0, S->get_prec()));
+  for (int a=0; a<n; a++)
+    for (int b=0; b<L; b++)
+      K[(long)a*L+b] = K0[(long)perm[a]*L+perm[b]];
+  Dense().swap(K0);
+
+  adjointStep(K, n, L, c, G);
+
+  for (int k = PP; k <= AA; k++)
+  {
+    Dense D((long)L*L);
+    for (int a=0; a<L; a++)
+      for (int b=0; b<L; b++)
+        mpf_swap(D[(long)perm[a]*L+perm[b]].get_mpf_t(),
+                 G[k][(long)a*L+b].get_mpf_t());
+    for (int i=0; i<Lx; i++)
+      grad.add_p_bond(k, offx+i, offy, N, hsep*D[(long)i*L+2*Lx+Ly-i-1]);
+    G[k].swap(D);
+  }
+}
+
+// Adjoint of Zvert(vsep) on this wrapped matrix, added to G.
+void FINDmatrix::backpropVert(int vsep, const dataType* c,
+                              std::vector<Dense> &G, BondGradient &grad)
+{
+  Dense K;
+  dense(K);
+  int L = mtx_L;
+  for (int i=0; i<Ly; i++)             // as Zvert
+  {
+    int j = 2*Ly-i-1;
+    K[(long)i*L+j] -= vsep*S->get_p_bond(offx,offy+i,W);
+    K[(long)j*L+i] = -K[(long)i*L+j];
+  }
+  std::vector<Dense> D(4);
+  adjointStep(K, L, L, c, D);
+  for (int k = PP; k <= AA; k++)
+  {
+    for (int i=0; i<Ly; i++)
+      grad.add_p_bond(k, offx, offy+i, W, -vsep*D[k][(long)i*L+2*Ly-i-1]);
+    if (G[k].empty())
+      G[k].swap(D[k]);
+    else
+      for (long e = 0; e < (long)L*L; e++)
+        G[k][e] += D[k][e];
+  }
+}
+
+void findMarginals(Sample &S, dataType Z[4], std::vector<dataType> corr[4])
+{
+  PROF_PHASE(DISSECTION);
+  FINDmatrix X(&S, true);
+  PROF_PHASE_END(DISSECTION);
+
+  PROF_PHASE(WRAP);
+  FINDmatrix Ypls(X);
+  FINDmatrix Yneg(X);
+  Ypls.wrapHorz(1);
+  Yneg.wrapHorz(-1);
+  FINDmatrix Ypls1(Ypls);              // Zvert eliminates in place, the
+  FINDmatrix Yneg1(Yneg);              // .. wrapped matrices are kept for
+  FINDmatrix Ypls2(Ypls);              // .. the adjoint pass
+  FINDmatrix Yneg2(Yneg);
+  PROF_PHASE_END(WRAP);
+
+  PROF_PHASE(ELIMINATION);
+  dataType y[4] = {Ypls1.Zvert(1), Yneg1.Zvert(1), Ypls2.Zvert(-1), Yneg2.Zvert(-1)};
+  PROF_PHASE_END(ELIMINATION);
+
+  combineSectors(S, y, Z);
+
+  PROF_PHASE(ADJOINT);
+  // weight of log |y[j]| in log Z_k, signs as in combineSectors
+  static const int sign[4][4] = {{ 1,  1,  1,  1},   // ZPP
+                                 {-1, -1,  1,  1},   // ZPA
+                                 {-1,  1, -1,  1},   // ZAP
+                                 {-1,  1,  1, -1}};  // ZAA
+  std::vector<dataType> c[4];
+  for (int j = 0; j < 4; j++)
+    c[j].assign(4, dataType(0, S.get_prec()));
+  for (int k = PP; k <= AA; k++)
+  {
+    dataType sum(0, S.get_prec());
+    for (int j = 0; j < 4; j++)
+      sum += sign[k][j]*y[j];
+    for (int j = 0; j < 4; j++)
+      c[j][k] = sign[k][j]*y[j]/sum;
+  }
+
+  BondGradient grad(S);
+  std::vector<Dense> GX(4);
+  for (int h = 0; h < 2; h++)          // y[h] and y[h+2] share wrapHorz
+  {
+    FINDmatrix &Y = (h == 0) ? Ypls : Yneg;
+    std::vector<Dense> G(4);
+    Y.backpropVert(1, &c[h][0], G, grad);
+    Y.backpropVert(-1, &c[h+2][0], G, grad);
+    std::vector<dataType> cw(4, dataType(0, S.get_prec()));
+    for (int k = PP; k <= AA; k++)
+      cw[k] = c[h][k] + c[h+2][k];
+    X.backpropWrap(h == 0 ? 1 : -1, &cw[0], G, grad);
+    for (int k = PP; k <= AA; k++)
+      if (GX[k].empty())
+        GX[k].swap(G[k]);
+      else
+        for (size_t e = 0; e < GX[k].size(); e++)
+          GX[k][e] += G[k][e];
+  }
+  X.backprop(GX, grad);
+
+  int Lx = S.get_Lx(), Ly = S.get_Ly();
+  for (int k = PP; k <= AA; k++)
+  {
+    corr[k].assign(2*Lx*Ly, dataType(0, S.get_prec()));
+    for (int x = 0; x < Lx; x++)
+      for (int y = 0; y < Ly; y++)
+        for (int d = 0; d < 2; d++)
+        {
+          // T d log Z_k/dJ, the correlation up to the sign of the seams
+          dataType &c = corr[k][2*(x*Ly+y)+d];
+          c = 1 - 2*S.get_weight(x, y, bondDir[d])*grad.get(k, x, y, bondDir[d]);
+          if (flipped(k, x, y, d, Lx, Ly))
+            c = -c;
+        }
+  }
+  PROF_PHASE_END(ADJOINT);
+}
+
+void writeMarginals(Sample &S, const std::vector<dataType> corr[4],
+                    const std::string &outputFile, const int precision)
+{
+  PROF_PHASE(OUTPUT);
+  std::ofstream out(outputFile.c_str());
+  out.precision(int(precision * 0.301));
+  out << std::scientific;
+  int Lx = S.get_Lx(), Ly = S.get_Ly();
+  for (int y = 0; y < Ly; y++)
+    for (int x = 0; x < Lx; x++)
+      for (int d = 0; d < 2; d++)
+      {
+        out << x << "\t" << y << "\t" << (d ? "S" : "E");
+        for (int k = PP; k <= AA; k++)
+          out << "\t" << corr[k][2*(x*Ly+y)+d];
+        // J >= 0 iff w <= 1
+        int sgn = (S.get_weight(x, y, bondDir[d]) <= 1) ? 1 : -1;
+        for (int k = PP; k <= AA; k++)
+        {
+          int sgnk = flipped(k, x, y, d, Lx, Ly) ? -sgn : sgn;
+          out << "\t" << dataType((1 - sgnk*corr[k][2*(x*Ly+y)+d])/2);
+        }
+        out << "\n";
+      }
+}
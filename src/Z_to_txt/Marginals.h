@@ -0,0 +1,58 @@
+// Marginals.h
+//
+// Correlations <s_i s_j> of all bonds in each of the four sectors from
+// one nested dissection, by an adjoint pass down the dissection tree in
+// the manner of selected inversion.
+//
+// log |Pf| of a sector's matrix is the sum of log |Pf(A)| over the
+// blocks eliminated at the nodes: a node with matrix K = [A B; -B^T C]
+// (A the separator rows) passes S = C + B^T A^-1 B to its parent.  Given
+// G = d log Z_k/dS from the parent, the derivative with respect to K is
+//   d/dA = -c A^-1 + X G X^T,  d/dB = -X G,  d/dC = G,  X = A^-1 B,
+// with c the weight of log Pf(A) in log Z_k (matrices full and skew, the
+// derivative with respect to an entry above the diagonal is the entry of
+// d/dK there).  Its entries at the separator bonds give d log Z_k/dw,
+// the rest is split among the children.  The children's matrices are
+// needed for K, so X is built with keepTree.  Per node and sector this
+// costs a few times the elimination of the node.
+//
+// With w = exp(-2J/T) the correlation of a bond in sector k is
+//   <s_i s_j> = T d log Z_k/dJ = 1 - 2 w d log Z_k/dw,
+// negated for the seam bonds that sector k flips (their coupling there
+// is -J), and the probability that the bond is frustrated
+// (J s_i s_j < 0, with the coupling J of the sector) is
+// (1 - sign(J) <s_i s_j>)/2.
+
+#ifndef MARGINALS_H
+#define MARGINALS_H
+
+#include "dataType.h"
+#include "Sample.h"
+#include <string>
+#include <vector>
+
+// d log Z_k/dw for the stored weights of a sample, k a Sector
+class BondGradient
+{
+  public:
+    BondGradient(Sample &S);
+    void add_p_bond(int k, int px, int py, Dir dir, const dataType &g);
+				       // g = d log Z_k/d get_p_bond(px,py,dir)
+    const dataType &get(int k, int x, int y, Dir dir);
+				       // of the bond (x,y,E) or (x,y,S)
+  private:
+    int Lx, Ly;
+    std::vector<dataType> g[4];        // E and S bond of (x,y) at
+				       // .. 2*(x*Ly+y) and 2*(x*Ly+y)+1
+};
+
+// Z as findPartition, and corr[k] the correlations of the bonds in
+// sector k, indexed as in BondGradient.
+void findMarginals(Sample &S, dataType Z[4], std::vector<dataType> corr[4]);
+// marginals.txt: one line per bond, in the order of the interaction
+// file: x, y, E or S, <s_i s_j> in the four sectors, then the four
+// probabilities that the bond is frustrated.
+void writeMarginals(Sample &S, const std::vector<dataType> corr[4],
+                    const std::string &outputFile, const int precision);
+
+#endif // MARGINALS_H
@@ -0,0 +1,70 @@
+// Partition.cc
+
+#include "Partition.h"
+#include "Profile.h"
+#include <fstream>
+
+void findPartition(Sample &S, dataType Z[4]) {
+  PROF_PHASE(DISSECTION);
+  FINDmatrix X(&S);
+  PROF_PHASE_END(DISSECTION);
+
+  findPartition(S, X, Z);
+}
+
+// X is the dissected matrix of S; it is left unchanged.
+void findPartition(Sample &S, FINDmatrix &X, dataType Z[4]) {
+  PROF_PHASE(WRAP);
+  FINDmatrix Ypls1(X);
+  FINDmatrix Yneg1(X);
+
+  Ypls1.wrapHorz(1);
+  Yneg1.wrapHorz(-1);
+
+  FINDmatrix Ypls2(Ypls1);
+  FINDmatrix Yneg2(Yneg1);
+  PROF_PHASE_END(WRAP);
+
+  PROF_PHASE(ELIMINATION);
+  dataType y[4] = {Ypls1.Zvert(1), Yneg1.Zvert(1), Ypls2.Zvert(-1), Yneg2.Zvert(-1)};
+  PROF_PHASE_END(ELIMINATION);
+
+  combineSectors(S, y, Z);
+}
+
+void combineSectors(Sample &S, const dataType y[4], dataType Z[4]) {
+  combineSectors(S.get_Z_prefactor(), S.get_prec(), y, Z);
+}
+
+// prefactor: product of exp(J/T) over all bonds
+void combineSectors(const dataType &prefactor, mp_bitcnt_t prec,
+                    const dataType y[4], dataType Z[4]) {
+  const dataType &y1 = y[0], &y2 = y[1], &y3 = y[2], &y4 = y[3];
+  for (int k = PP; k <= AA; k++)
+    Z[k].set_prec(prec);
+
+  Z[PP] = abs(prefactor*0.5*( y1+y2+y3+y4));
+  Z[PA] = abs(prefactor*0.5*(-y1-y2+y3+y4));
+  Z[AP] = abs(prefactor*0.5*(-y1+y2-y3+y4));
+  Z[AA] = abs(prefactor*0.5*(-y1+y2+y3-y4));
+}
+
+void writePartition(const dataType Z[4], const std::string &outputFile, const int precision) {
+  PROF_PHASE(OUTPUT);
+  std::ofstream outFile(outputFile.c_str());
+  writePartition(Z, outFile, precision);
+  outFile << "\t";
+  outFile.close();
+}
+
+// The four values, tab separated, without trailing separator.
+void writePartition(const dataType Z[4], std::ostream &out, const int precision) {
+  // Set precision based on the input precision parameter
+  out.precision(int(precision * 0.301)); // Convert bits to decimal digits
+  out << std::scientific;               // Use scientific notation
+
+  out << Z[PP] << "\t"
+      << Z[PA] << "\t"
+      << Z[AP] << "\t"
+      << Z[AA];
+}
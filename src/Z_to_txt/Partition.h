@@ -0,0 +1,34 @@
+// Partition.h
+//
+// Partition functions of a sample on the torus for the four combinations
+// of periodic (P) and anti periodic (A) boundary conditions.  The
+// nested dissection of the sample is done once; the sectors differ only
+// in the signs of the bonds wrapping around the lattice, which are added
+// to copies of the dissected matrix.
+// Passing a dissection built with keepTree lets callers change single
+// couplings (Sample::set_bond, FINDmatrix::update) and recompute the
+// sectors without redoing the whole dissection.
+// Z is set to the precision of the sample.
+
+#ifndef PARTITION_H
+#define PARTITION_H
+
+#include "dataType.h"
+#include "Sample.h"
+#include "FINDmatrix.h"
+#include <string>
+#include <ostream>
+
+enum Sector {PP, PA, AP, AA};
+
+void findPartition(Sample &S, dataType Z[4]);
+void findPartition(Sample &S, FINDmatrix &X, dataType Z[4]);
+// Z from the Pfaffians y[k] of X wrapped with the horizontal and vertical
+// signs (+,+), (-,+), (+,-), (-,-); for callers that eliminate elsewhere.
+void combineSectors(Sample &S, const dataType y[4], dataType Z[4]);
+void combineSectors(const dataType &prefactor, mp_bitcnt_t prec,
+                    const dataType y[4], dataType Z[4]);
+void writePartition(const dataType Z[4], const std::string &outputFile, const int precision);
+void writePartition(const dataType Z[4], std::ostream &out, const int precision);
+
+#endif // PARTITION_H
@@ -0,0 +1,189 @@
+// Profile.cc
+//
+// See Profile.h.  Everything here is compiled only with FKT_PROFILE.
+
+#include "Profile.h"
+
+#ifdef FKT_PROFILE
+
+#include <gmp.h>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+
+#ifdef FKT_PERF
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cstring>
+#endif
+
+thread_local int Profile::level = 0;
+std::vector<Profile::Level> Profile::levels;
+
+static const char* counterNames[Profile::NUM_COUNTERS] =
+  {"crossOp", "pivots", "eliminatedRows", "filledEntries", "swappedRows",
+   "allocatedEntries"};
+static const char* phaseNames[Profile::NUM_PHASES] =
+  {"sample", "dissection", "wrap", "elimination", "adjoint", "output"};
+
+static double phaseSeconds[Profile::NUM_PHASES];
+
+// GMP allocation counts; mpf limbs are allocated through these hooks once
+// Profile::start() has run.
+static long gmpAllocs = 0, gmpReallocs = 0, gmpFrees = 0;
+static long gmpBytes = 0;
+
+static void* countingAlloc(size_t n)
+{
+  gmpAllocs++;
+  gmpBytes += n;
+  return malloc(n);
+}
+
+static void* countingRealloc(void* p, size_t, size_t n)
+{
+  gmpReallocs++;
+  return realloc(p, n);
+}
+
+static void countingFree(void* p, size_t)
+{
+  gmpFrees++;
+  free(p);
+}
+
+#ifdef FKT_PERF
+// Hardware counters, one file descriptor each; -1 if the kernel refused.
+#define NUM_PERF 3
+static const char* perfNames[NUM_PERF] = {"cycles", "instructions", "cacheMisses"};
+static const unsigned long perfConfigs[NUM_PERF] =
+  {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES};
+static int perfFd[NUM_PERF] = {-1, -1, -1};
+static long long perfPhase[Profile::NUM_PHASES][NUM_PERF];
+
+static void perfOpen()
+{
+  for (int i = 0; i < NUM_PERF; i++)
+  {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = perfConfigs[i];
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    perfFd[i] = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+    if (perfFd[i] < 0)
+      std::cerr << "perf_event_open failed for " << perfNames[i] << "\n";
+  }
+}
+
+static long long perfRead(int i)
+{
+  long long value = 0;
+  if (perfFd[i] < 0 || read(perfFd[i], &value, sizeof(value)) != sizeof(value))
+    return 0;
+  return value;
+}
+#endif // FKT_PERF
+
+void Profile::start()
+{
+  mp_set_memory_functions(countingAlloc, countingRealloc, countingFree);
+#ifdef FKT_PERF
+  perfOpen();
+#endif
+}
+
+Profile::Level& Profile::at(int l)
+{
+  if ((int)levels.size() <= l)
+    levels.resize(l+1);
+  return levels[l];
+}
+
+void Profile::count(Counter c, long n)
+{
+  at(level).counts[c] += n;
+}
+
+void Profile::node(int mtx_L, double seconds)
+{
+  Level& L = at(level);
+  L.nodes++;
+  L.matrixDim += mtx_L;
+  if (mtx_L > L.maxMatrixDim)
+    L.maxMatrixDim = mtx_L;
+  L.seconds += seconds;
+}
+
+void Profile::phase(Phase p, double seconds)
+{
+  phaseSeconds[p] += seconds;
+}
+
+double Profile::Timer::seconds() const
+{
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+Profile::PhaseScope::PhaseScope(Phase _p)
+: p(_p), running(true)
+{
+#ifdef FKT_PERF
+  for (int i = 0; i < NUM_PERF; i++)
+    perfPhase[p][i] -= perfRead(i);
+#endif
+}
+
+void Profile::PhaseScope::stop()
+{
+  if (!running)
+    return;
+  running = false;
+  phase(p, t.seconds());
+#ifdef FKT_PERF
+  for (int i = 0; i < NUM_PERF; i++)
+    perfPhase[p][i] += perfRead(i);
+#endif
+}
+
+void Profile::write(const std::string &filename)
+{
+  std::ofstream out(filename.c_str());
+  out << "{\n  \"phases\": {";
+  for (int p = 0; p < NUM_PHASES; p++)
+  {
+    out << (p ? ",\n" : "\n") << "    \"" << phaseNames[p] << "\": {\"seconds\": "
+        << phaseSeconds[p];
+#ifdef FKT_PERF
+    for (int i = 0; i < NUM_PERF; i++)
+      if (perfFd[i] >= 0)
+        out << ", \"" << perfNames[i] << "\": " << perfPhase[p][i];
+#endif
+    out << "}";
+  }
+  out << "\n  },\n";
+  out << "  \"gmp\": {\"allocations\": " << gmpAllocs
+      << ", \"reallocations\": " << gmpReallocs
+      << ", \"frees\": " << gmpFrees
+      << ", \"allocatedBytes\": " << gmpBytes << "},\n";
+  out << "  \"levels\": [";
+  for (size_t l = 0; l < levels.size(); l++)
+  {
+    const Level& L = levels[l];
+    out << (l ? ",\n" : "\n") << "    {\"depth\": " << (int)l-1
+        << ", \"nodes\": " << L.nodes
+        << ", \"matrixDim\": " << L.matrixDim
+        << ", \"maxMatrixDim\": " << L.maxMatrixDim
+        << ", \"seconds\": " << L.seconds;
+    for (int c = 0; c < NUM_COUNTERS; c++)
+      out << ", \"" << counterNames[c] << "\": " << L.counts[c];
+    out << "}";
+  }
+  out << "\n  ]\n}\n";
+}
+
+#endif // FKT_PROFILE
@@ -0,0 +1,108 @@
+// Profile.h
+//
+// Optional instrumentation of the partition function calculation.
+// Building with PROFILE=1 defines FKT_PROFILE, which enables
+//  - per-level timers and operation counters in FINDmatrix (crossOp calls,
+//    pivot swaps, eliminated rows, fill_mat entries, row swaps, allocated
+//    matrix entries), indexed by recursion depth of the nested dissection,
+//  - phase timers in main (Sample setup, dissection, boundary wrapping,
+//    sector elimination, adjoint pass for bond marginals, decimal output),
+//  - counts of GMP allocations, taken through mp_set_memory_functions,
+//  - and, with PERF=1 (FKT_PERF), hardware counters per phase read via
+//    perf_event_open.
+// Profile::write() stores everything as profile.json next to Z.txt.
+// Without FKT_PROFILE every PROF_* macro expands to nothing, so the hot
+// loops are the same as in an uninstrumented build.
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#ifdef FKT_PROFILE
+
+#include <string>
+#include <vector>
+#include <chrono>
+
+class Profile
+{
+  public:
+    enum Counter {CROSSOP, PIVOT, ELIMINATED, FILLED, SWAPROW, ALLOCATED,
+                  NUM_COUNTERS};
+    enum Phase {SAMPLE, DISSECTION, WRAP, ELIMINATION, ADJOINT, OUTPUT,
+                NUM_PHASES};
+
+    struct Level
+    {
+      long nodes = 0;
+      long matrixDim = 0;              // sum of mtx_L over the level's nodes
+      long maxMatrixDim = 0;
+      double seconds = 0;              // time in combine_*, children excluded
+      long counts[NUM_COUNTERS] = {};
+    };
+
+    // Level 0 collects the work done on the full lattice after the
+    // dissection (wrapHorz, Zvert); level d+1 is recursion depth d.
+    static thread_local int level;
+
+    static void start();               // install GMP hooks, open counters
+    static void count(Counter c, long n = 1);
+    static void node(int mtx_L, double seconds);
+    static void phase(Phase p, double seconds);
+    static void write(const std::string &filename);
+
+    class LevelScope                   // descend one recursion level
+    {
+      public:
+        LevelScope() { ++level; }
+        ~LevelScope() { --level; }
+    };
+
+    class Timer                        // wall clock of a phase or node
+    {
+      public:
+        Timer() : t0(std::chrono::steady_clock::now()) {}
+        double seconds() const;
+      private:
+        std::chrono::steady_clock::time_point t0;
+    };
+
+    class PhaseScope                   // runs until stop() or end of scope
+    {
+      public:
+        PhaseScope(Phase _p);
+        ~PhaseScope() { stop(); }
+        void stop();
+      private:
+        Phase p;
+        bool running;
+        Timer t;
+    };
+
+  private:
+    static std::vector<Level> levels;
+    static Level& at(int l);
+};
+
+#define PROF_START()         Profile::start()
+#define PROF_COUNT(c, n)     Profile::count(Profile::c, n)
+#define PROF_LEVEL()         Profile::LevelScope prof_level_scope
+#define PROF_NODE_TIMER()    Profile::Timer prof_node_timer
+#define PROF_NODE(mtx_L)     Profile::node(mtx_L, prof_node_timer.seconds())
+#define PROF_PHASE(p)        Profile::PhaseScope prof_phase_##p(Profile::p)
+#define PROF_PHASE_END(p)    prof_phase_##p.stop()
+#define PROF_WRITE(file)     Profile::write(file)
+
+#else
+
+#define PROF_START()
+#define PROF_COUNT(c, n)
+#define PROF_LEVEL()
+#define PROF_NODE_TIMER()
+#define PROF_NODE(mtx_L)
+#define PROF_PHASE(p)
+#define PROF_PHASE_END(p)
+#define PROF_WRITE(file)
+
+#endif // FKT_PROFILE
+
+#endif // PROFILE_H
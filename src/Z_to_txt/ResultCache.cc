@@ -0,0 +1,160 @@
+// ResultCache.cc
+//
+// See ResultCache.h.
+
+#include "ResultCache.h"
+#include "Gauge.h"
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+
+// Two independent 64-bit hashes (FNV-1a and a multiply-xorshift mix)
+// give the 128-bit key.
+static void hash128(const std::string &s, uint64_t &h1, uint64_t &h2)
+{
+  h1 = 0xcbf29ce484222325ULL;
+  h2 = 0x9E3779B97F4A7C15ULL;
+  for (size_t i = 0; i < s.size(); i++)
+  {
+    unsigned char c = s[i];
+    h1 = (h1 ^ c) * 0x100000001b3ULL;
+    h2 = (h2 + c) * 0xbf58476d1ce4e5b9ULL;
+    h2 ^= h2 >> 31;
+  }
+  h2 ^= s.size();
+  h2 = (h2 ^ (h2 >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  h2 = (h2 ^ (h2 >> 27)) * 0x94d049bb133111ebULL;
+  h2 ^= h2 >> 31;
+}
+
+ResultCache::ResultCache(const std::string &_directory)
+: directory(_directory)
+{
+  mkdir(directory.c_str(), 0777);
+  struct stat st;
+  usable = stat(directory.c_str(), &st) == 0 && S_ISDIR(st.st_mode) &&
+           access(directory.c_str(), W_OK) == 0;
+}
+
+bool ResultCache::good()
+{
+  return usable;
+}
+
+std::string ResultCache::key(const std::string &interactionFile,
+                             const dataType &T, int prec, int targetBits,
+                             int &mask)
+{
+  int Lx, Ly;
+  std::vector<std::string> bonds;
+  readCouplings(interactionFile, Lx, Ly, bonds);
+  mask = gaugeCanonicalize(Lx, Ly, bonds);
+
+  std::ostringstream canonical;
+  canonical << Lx << " " << Ly;
+  for (size_t i = 0; i < bonds.size(); i++)
+    canonical << " " << bonds[i];
+  mp_exp_t exp;
+  char* digits = mpf_get_str(NULL, &exp, 16, 0, T.get_mpf_t());
+  canonical << " T " << digits << "@" << exp << " prec " << prec;
+  if (targetBits > 0)
+    canonical << " target " << targetBits;
+  void (*freefunc)(void*, size_t);
+  mp_get_memory_functions(NULL, NULL, &freefunc);
+  freefunc(digits, strlen(digits)+1);
+
+  uint64_t h1, h2;
+  hash128(canonical.str(), h1, h2);
+  char hex[33];
+  snprintf(hex, sizeof(hex), "%016llx%016llx", (unsigned long long)h1,
+           (unsigned long long)h2);
+  return hex;
+}
+
+std::string ResultCache::permute(const std::string &value, int mask)
+{
+  std::vector<std::string> Z;
+  size_t begin = 0, end;
+  while ((end = value.find('\t', begin)) != std::string::npos)
+  {
+    Z.push_back(value.substr(begin, end - begin));
+    begin = end + 1;
+  }
+  if (Z.size() != 4)
+    return value;
+  std::string permuted;
+  for (int k = 0; k < 4; k++)
+    permuted += Z[k ^ mask] + "\t";
+  return permuted;
+}
+
+std::string ResultCache::shard(const std::string &key)
+{
+  return directory + "/" + key.substr(0, 3) + ".txt";
+}
+
+bool ResultCache::lookup(const std::string &key, std::string &value)
+{
+  FILE* file = fopen(shard(key).c_str(), "r");
+  if (file == NULL)
+    return false;
+  flock(fileno(file), LOCK_SH);
+  char* line = NULL;
+  size_t n = 0;
+  ssize_t len;
+  bool found = false;
+  while (!found && (len = getline(&line, &n, file)) > 0)
+  {
+    if (key.compare(0, key.size(), line, std::min((size_t)len, key.size())) == 0 &&
+        line[key.size()] == '\t' && line[len-1] == '\n')
+    {
+      value.assign(line + key.size() + 1, len - key.size() - 2);
+      found = true;
+    }
+  }
+  free(line);
+  flock(fileno(file), LOCK_UN);
+  fclose(file);
+  return found;
+}
+
+void ResultCache::store(const std::string &key, const std::string &value)
+{
+  int fd = open(shard(key).c_str(), O_WRONLY | O_APPEND | O_CREAT, 0666);
+  if (fd < 0)
+    return;
+  flock(fd, LOCK_EX);
+  std::string line = key + "\t" + value + "\n";
+  if (write(fd, line.data(), line.size()) != (ssize_t)line.size())
+    perror("ResultCache::store");
+  flock(fd, LOCK_UN);
+  close(fd);
+}
+
+void ResultCache::count(bool hit)
+{
+  std::string name = directory + "/stats.txt";
+  int fd = open(name.c_str(), O_RDWR | O_CREAT, 0666);
+  if (fd < 0)
+    return;
+  flock(fd, LOCK_EX);
+  char buf[128] = {0};
+  long hits = 0, misses = 0;
+  if (read(fd, buf, sizeof(buf)-1) > 0)
+    sscanf(buf, "hits %ld misses %ld", &hits, &misses);
+  (hit ? hits : misses)++;
+  int len = snprintf(buf, sizeof(buf), "hits %ld misses %ld\n", hits, misses);
+  if (pwrite(fd, buf, len, 0) != len || ftruncate(fd, len) != 0)
+    perror("ResultCache::count");
+  flock(fd, LOCK_UN);
+  close(fd);
+}
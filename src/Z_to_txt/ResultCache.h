@@ -0,0 +1,46 @@
+// ResultCache.h
+//
+// On-disk cache of Z.txt contents, addressed by a 128-bit hash of the
+// couplings of a sample, the temperature and the precision.  Samples
+// that occur more than once (e.g. all couplings +1 at small p and L, or
+// overlapping sweeps) are then computed only once.
+//
+// The couplings are hashed in the canonical form of Gauge.h, in the text
+// of the interaction file, so the key does not depend on the order or
+// direction the bonds are listed in, nor on gauge and logical sign
+// flips.  The latter permute the sectors: key() returns the mask, and
+// entries are stored in the sector order of the canonical couplings.
+// T enters with all bits of its mantissa, the precision together with
+// the target bits of a per-level precision schedule (0 if none).
+//
+// The store is a directory of 4096 append-only text files, selected by
+// the first three hex digits of the key, with lines "key<TAB>Z.txt"
+// (tabs kept).  Files are locked with flock, so any number of processes
+// may share one cache.  stats.txt counts hits and misses.
+
+#ifndef RESULT_CACHE_H
+#define RESULT_CACHE_H
+
+#include "dataType.h"
+#include <string>
+
+class ResultCache
+{
+  public:
+    ResultCache(const std::string &_directory);
+    static std::string key(const std::string &interactionFile,
+                           const dataType &T, int prec, int targetBits,
+                           int &mask);
+    // Z.txt with sector k replaced by sector k^mask
+    static std::string permute(const std::string &value, int mask);
+    bool lookup(const std::string &key, std::string &value);
+    void store(const std::string &key, const std::string &value);
+    void count(bool hit);              // adds to stats.txt
+    bool good();                       // directory usable
+  private:
+    std::string directory;
+    bool usable;
+    std::string shard(const std::string &key);
+};
+
+#endif // RESULT_CACHE_H
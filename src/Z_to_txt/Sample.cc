@@ -30,6 +30,8 @@
 #include <string_view>
 #include <string>
 #include <iostream>
+#include <cmath>
+#include <algorithm>
 #include "exp_log.h"
 
 // Constructor takes a filename and temperature: reads in J_{ij}
@@ -56,10 +58,78 @@
 //      S(2)
 
 Sample::Sample(std::string_view filename, dataType T)
+: Lx(0), Ly(0), prec(T.get_prec()), targetBits(0), cancelBits(0)
 {
-  Z_prefactor = 1;
   std::ifstream infile(filename.data(), std::ifstream::in);
-  infile >> Lx >> Ly;
+  complete = bool(infile >> Lx >> Ly) && Lx > 0 && Ly > 0;
+  if (!complete)
+    Lx = Ly = 0;
+  allocate_bonds();
+  int nextx;
+  int nexty;
+  std::string direction;
+  std::string Jchars;
+  long bonds = 0;
+  while (complete && infile >> nextx)
+  {
+    if (!(infile >> nexty >> direction >> Jchars) || nextx < 0 ||
+        nextx >= Lx || nexty < 0 || nexty >= Ly)
+    {
+      complete = false;
+      break;
+    }
+    dataType J(Jchars.c_str(), prec);
+    add_bond(nextx, nexty, direction[0], J, T);
+    bonds++;
+  }
+  if (bonds != 2*long(Lx)*Ly)
+    complete = false;
+}
+
+// Couplings given in memory, in the order of the generator's output:
+// spins row by row (x fastest), for each spin its E bond, then its S bond.
+Sample::Sample(int _Lx, int _Ly, const double* J, dataType T)
+: Lx(_Lx), Ly(_Ly), prec(T.get_prec()), targetBits(0), cancelBits(0),
+  complete(true)
+{
+  allocate_bonds();
+  for (int y=0; y<Ly; y++)
+    for (int x=0; x<Lx; x++)
+    {
+      add_bond(x, y, 'E', dataType(J[2*(y*Lx+x)], prec), T);
+      add_bond(x, y, 'S', dataType(J[2*(y*Lx+x)+1], prec), T);
+    }
+}
+
+// Same couplings, weights taken from (and added to) a cache.
+Sample::Sample(int _Lx, int _Ly, const double* J, WeightCache &cache)
+: Lx(_Lx), Ly(_Ly), prec(cache.get_T().get_prec()), targetBits(0),
+  cancelBits(0), complete(true)
+{
+  allocate_bonds();
+  for (int y=0; y<Ly; y++)
+    for (int x=0; x<Lx; x++)
+    {
+      const std::pair<dataType, dataType> &e = cache.get(J[2*(y*Lx+x)]);
+      add_weight(x, y, 'E', e.first, e.second);
+      const std::pair<dataType, dataType> &s = cache.get(J[2*(y*Lx+x)+1]);
+      add_weight(x, y, 'S', s.first, s.second);
+    }
+}
+
+// Bonds added one by one with add_weight, e.g. by a reader that computes
+// the Boltzmann factors itself (see Strip.h).
+Sample::Sample(int _Lx, int _Ly, mp_bitcnt_t _prec)
+: Lx(_Lx), Ly(_Ly), prec(_prec), targetBits(0), cancelBits(0),
+  complete(true)
+{
+  allocate_bonds();
+}
+
+void Sample::allocate_bonds()
+{
+  Z_prefactor.set_prec(prec);
+  Z_prefactor = 1;
   xbonds = new dataType*[Lx];
   ybonds = new dataType*[Lx];
   for (int i=0; i<Lx; i++)
@@ -68,40 +138,42 @@ Sample::Sample(std::string_view filename, dataType T)
     ybonds[i] = new dataType[Ly];
     for (int j=0; j<Ly; j++)
     {
+      xbonds[i][j].set_prec(prec);
+      ybonds[i][j].set_prec(prec);
       xbonds[i][j] = 0;
       ybonds[i][j] = 0;
     }
   }
-  int nextx;
-  int nexty;
-  std::string direction;
-  std::string Jchars;
-  dataType J;
-  while (infile >> nextx)
-  {
-    infile >> nexty >> direction >> Jchars;
-    dataType J = ((dataType)Jchars.c_str());
+}
 
-    exp_log EL;
-    Z_prefactor *= EL.exp(J/T);
-    switch(direction[0])
-    {
-      case 'N':
-      case '0':
-	ybonds[ nextx         ][(nexty+Ly-1)%Ly] = EL.exp(-2*J/T);
-	break;
-      case 'E':
-      case '1':
-	xbonds[ nextx         ][ nexty         ] = EL.exp(-2*J/T);
-	break;
-      case 'S':
-      case '2':
-	ybonds[ nextx         ][ nexty         ] = EL.exp(-2*J/T);
-	break;
-      case 'W':
-      case '3':
-	xbonds[(nextx+Lx-1)%Lx][ nexty         ] = EL.exp(-2*J/T);
-    }
+void Sample::add_bond(int nextx, int nexty, char direction, const dataType &J, const dataType &T)
+{
+  exp_log EL;
+  add_weight(nextx, nexty, direction, EL.exp(J/T), EL.exp(-2*J/T));
+}
+
+// factor = exp(J/T) enters Z_prefactor, weight = exp(-2J/T) is stored
+void Sample::add_weight(int nextx, int nexty, char direction,
+                        const dataType &factor, const dataType &weight)
+{
+  Z_prefactor *= factor;
+  switch(direction)
+  {
+    case 'N':
+    case '0':
+      ybonds[ nextx         ][(nexty+Ly-1)%Ly] = weight;
+      break;
+    case 'E':
+    case '1':
+      xbonds[ nextx         ][ nexty         ] = weight;
+      break;
+    case 'S':
+    case '2':
+      ybonds[ nextx         ][ nexty         ] = weight;
+      break;
+    case 'W':
+    case '3':
+      xbonds[(nextx+Lx-1)%Lx][ nexty         ] = weight;
   }
 }
 
@@ -131,10 +203,22 @@ dataType Sample::get_p_bond(int px, int py, Dir dir)
     case W:
       return -ybonds[px][py];
     default:
-      return 0;
+      return dataType(0, prec);
   }
 }
 
+dataType Sample::get_weight(int x, int y, Dir dir)
+{
+  return (dir == E) ? xbonds[x][y] : ybonds[x][y];
+}
+
+// false if the file could not be opened, had no size, a bond outside
+// the lattice or not 2*Lx*Ly bonds
+bool Sample::good()
+{
+  return complete;
+}
+
 int Sample::get_Lx()
 {
   return Lx;
@@ -150,6 +234,104 @@ dataType Sample::get_Z_prefactor()
   return Z_prefactor;
 }
 
+mp_bitcnt_t Sample::get_prec()
+{
+  return prec;
+}
+
+// |log2 w| of a positive weight, from its exponent and leading bits
+static double log2abs(const dataType &w)
+{
+  if (w <= 0)
+    return 0;
+  long e;
+  double d = mpf_get_d_2exp(&e, w.get_mpf_t());
+  return std::fabs(e + std::log2(d));
+}
+
+void Sample::set_target_bits(mp_bitcnt_t bits)
+{
+  targetBits = bits;
+  double Sx = 0, Sy = 0;               // |log2 w| = 2|J|/T log2(e)
+  for (int x=0; x<Lx; x++)
+  {
+    double sum = 0;
+    for (int y=0; y<Ly; y++)
+      sum += log2abs(xbonds[x][y]);
+    if (x == 0 || sum < Sx)
+      Sx = sum;
+  }
+  for (int y=0; y<Ly; y++)
+  {
+    double sum = 0;
+    for (int x=0; x<Lx; x++)
+      sum += log2abs(ybonds[x][y]);
+    if (y == 0 || sum < Sy)
+      Sy = sum;
+  }
+  cancelBits = mp_bitcnt_t(std::ceil(Sx + Sy)) + 2; // |y_k| <= 4 Zmax
+  schedule.clear();
+}
+
+/*
+ * A node of nodeLx x nodeLy spins has about log2 of the area ratio levels
+ * above it; each elimination of a boundary matrix of size 2(Lx+Ly)
+ * costs up to log2 of that size in rounding error growth.
+ */
+mp_bitcnt_t Sample::get_prec(int nodeLx, int nodeLy)
+{
+  if (targetBits == 0)
+    return prec;
+  double levels = std::ceil(std::log2(double(Lx)*Ly / (double(nodeLx)*nodeLy)));
+  double perLevel = std::ceil(std::log2(4.0*(Lx+Ly)));
+  double bits = targetBits + cancelBits + 32 + (std::max(levels, 0.0) + 1)*perLevel;
+  mp_bitcnt_t nodePrec = std::min(prec, (mp_bitcnt_t(bits) + 63) / 64 * 64);
+  schedule[std::make_pair(nodeLx, nodeLy)] = nodePrec;
+  return nodePrec;
+}
+
+void Sample::printSchedule(std::ostream &out)
+{
+  if (targetBits == 0)
+    return;
+  out << "precision schedule: target " << targetBits << " bits, sector "
+      << "cancellation " << cancelBits << " bits, full " << prec << " bits\n";
+  std::map<std::pair<int, int>, mp_bitcnt_t>::reverse_iterator it;
+  for (it = schedule.rbegin(); it != schedule.rend(); ++it)
+    out << "  " << it->first.first << "x" << it->first.second << ": "
+        << it->second << "\n";
+}
+
+// Bring a bond given by spin coordinates and any of the four directions
+// to the (x,y,E) or (x,y,S) form under which its weight is stored.
+void Sample::bond_index(int &x, int &y, Dir &dir)
+{
+  if (dir == W)
+  {
+    x = (x+Lx-1)%Lx;
+    dir = E;
+  }
+  else if (dir == N)
+  {
+    y = (y+Ly-1)%Ly;
+    dir = S;
+  }
+}
+
+// Replace the coupling of one bond (spin coordinates as in the input
+// file) and adjust Z_prefactor, which holds exp(J/T) = 1/sqrt(weight)
+// for every bond read in.
+void Sample::set_bond(int x, int y, Dir dir, dataType J, dataType T)
+{
+  bond_index(x, y, dir);
+  dataType &weight = (dir == E) ? xbonds[x][y] : ybonds[x][y];
+  exp_log EL;
+  if (weight != 0)
+    Z_prefactor *= sqrt(weight);
+  Z_prefactor *= EL.exp(J/T);
+  weight = EL.exp(-2*J/T);
+}
+
 void Sample::printMe(dataType T) {
   std::cout << "#Sample of size " << Lx << " x " << Ly << " prefactor " << Z_prefactor << "\n";
   std::cout << Lx << " " << Ly << "\n";
@@ -163,3 +345,31 @@ void Sample::printMe(dataType T) {
       std::cout << i << " " << j << " 2 " << Jy << "\n";
     }
 }
+
+WeightCache::WeightCache(dataType _T)
+: T(_T)
+{
+}
+
+const std::pair<dataType, dataType>& WeightCache::get(double J)
+{
+  std::map<double, std::pair<dataType, dataType> >::iterator it = weights.find(J);
+  if (it == weights.end())
+  {
+    exp_log EL;
+    dataType Jp(J, T.get_prec());
+    it = weights.insert(std::make_pair(J,
+           std::make_pair(EL.exp(Jp/T), EL.exp(-2*Jp/T)))).first;
+  }
+  return it->second;
+}
+
+dataType WeightCache::get_T()
+{
+  return T;
+}
+
+size_t WeightCache::size()
+{
+  return weights.size();
+}
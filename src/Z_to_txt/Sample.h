@@ -30,29 +30,85 @@
 // which is the weight of the all up spin configuration.
 // The bonds are stored here
 // as relative Boltzmann weights, exp(-2 beta J), not as the energy J.
-// Methods are provided for construction (from a filename; can write a
-// random constructor for a given distribution) and for
-// querying size and weights.
+// Methods are provided for construction (from a filename or from
+// couplings in memory, e.g. drawn by the generator's drawCouplings), for
+// querying size and weights and for changing single couplings.
+// All weights are kept at the precision of the temperature T passed to
+// the constructor, so samples of different precision can coexist in one
+// process (mpf_set_default_prec is not consulted).
+//
+// With set_target_bits(G), the nodes of the nested dissection run at a
+// precision matched to their size, get_prec(Lx, Ly), instead of the full
+// precision: G bits for the result, plus the bits lost in the sector
+// combination at the root, plus a guard for the rounding error growth in
+// the eliminations above the node.  The sector loss is bounded from the
+// couplings: flipping the bonds of one seam changes every energy by at
+// most 2 sum |J| over the seam, so Zmin/Zmax >= exp(-2 (Sx + Sy)/T) with
+// Sx, Sy the smallest sums of |J| over a column and a row of bonds.
 
 #ifndef SAMPLE_H
 #define SAMPLE_H
 
 #include "dataType.h"
 #include <fstream>
+#include <ostream>
 #include <string_view>
+#include <map>
+#include <utility>
+
+// Boltzmann factors exp(J/T) and exp(-2J/T) of the couplings seen so far,
+// at the temperature and precision of T.  Long running callers that build
+// many samples (isingZServer) thereby evaluate the exponentials only once
+// per distinct coupling.
+class WeightCache
+{
+  public:
+    WeightCache(dataType _T);
+    const std::pair<dataType, dataType>& get(double J);
+    dataType get_T();
+    size_t size();
+  private:
+    dataType T;
+    std::map<double, std::pair<dataType, dataType> > weights;
+};
 
 class Sample
 {
   public:
     Sample(std::string_view filename, dataType T);
+    Sample(int _Lx, int _Ly, const double* J, dataType T);
+    Sample(int _Lx, int _Ly, const double* J, WeightCache &cache);
+    Sample(int _Lx, int _Ly, mp_bitcnt_t _prec);
+				       // no bonds yet, see add_weight
     ~Sample();
     dataType get_p_bond(int px, int py, Dir dir);
+    dataType get_weight(int x, int y, Dir dir);
+				       // weight of the bond (x,y,E) or (x,y,S)
+    bool     good();                   // the input file was read fully
     int      get_Lx();
     int      get_Ly();
     dataType get_Z_prefactor();
+    mp_bitcnt_t get_prec();
+    mp_bitcnt_t get_prec(int nodeLx, int nodeLy);
+				       // precision of a dissection node
+    void set_target_bits(mp_bitcnt_t bits);
+    void printSchedule(std::ostream &out);
+    void bond_index(int &x, int &y, Dir &dir);
+    void set_bond(int x, int y, Dir dir, dataType J, dataType T);
     void printMe(dataType T);
+    void add_weight(int nextx, int nexty, char direction,
+                    const dataType &factor, const dataType &weight);
+    void add_bond(int nextx, int nexty, char direction, const dataType &J, const dataType &T);
+				       // coupling J, weights as for a line
+				       // .. of the interaction file
   private:
+    void allocate_bonds();
     int Lx, Ly;
+    mp_bitcnt_t prec;
+    mp_bitcnt_t targetBits;            // 0: prec at every node
+    mp_bitcnt_t cancelBits;
+    std::map<std::pair<int, int>, mp_bitcnt_t> schedule;
+    bool complete;
     dataType** xbonds;
     dataType** ybonds;
     dataType Z_prefactor;
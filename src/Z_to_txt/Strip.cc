@@ -0,0 +1,154 @@
+// Strip.cc
+//
+// See Strip.h.
+
+#include "Strip.h"
+#include "Sample.h"
+#include "FINDmatrix.h"
+#include "Partition.h"
+#include "exp_log.h"
+#include <iostream>
+#include <fstream>
+#include <future>
+#include <map>
+#include <utility>
+#include <algorithm>
+
+namespace {
+
+// The interaction file, read strip by strip.  The Boltzmann factors are
+// computed once per distinct coupling text, and the prefactor collects
+// exp(J/T) in the order of the file, as the Sample constructor does.
+class StripReader
+{
+  public:
+    StripReader(const std::string &file, const dataType &_T)
+    : in(file.c_str()), T(_T), prec(_T.get_prec()), Lx(0), Ly(0),
+      prefactor(1, prec), pending(false), error(!in)
+    {
+      if (!error && !(in >> Lx >> Ly && Lx > 0 && Ly > 0))
+        error = true;
+    }
+
+    // bonds of the spin rows [y0, y0+h), to be deleted by the caller
+    Sample* next(int y0, int h)
+    {
+      Sample* strip = new Sample(Lx, h, prec);
+      while (!error)
+      {
+        if (!pending && !(in >> x >> y >> direction >> Jchars))
+          break;
+        pending = false;
+        if (y >= y0 + h)               // first bond of the next strip
+        {
+          pending = true;
+          break;
+        }
+        char d = direction[0];
+        if (y < y0 || x < 0 || x >= Lx ||
+            !(d == 'E' || d == 'S' || d == '1' || d == '2'))
+        {
+          error = true;
+          break;
+        }
+        const std::pair<dataType, dataType> &w = weight(Jchars);
+        strip->add_weight(x, y - y0, d, w.first, w.second);
+        prefactor *= w.first;
+      }
+      return strip;
+    }
+
+    std::ifstream in;
+    dataType T;
+    mp_bitcnt_t prec;
+    int Lx, Ly;
+    dataType prefactor;                // product of exp(J/T) so far
+    bool pending;                      // x, y, direction, Jchars not used yet
+    bool error;
+
+  private:
+    const std::pair<dataType, dataType>& weight(const std::string &text)
+    {
+      std::map<std::string, std::pair<dataType, dataType> >::iterator it
+        = weights.find(text);
+      if (it == weights.end())
+      {
+        exp_log EL;
+        dataType J(text.c_str(), prec);
+        it = weights.insert(std::make_pair(text,
+               std::make_pair(EL.exp(J/T), EL.exp(-2*J/T)))).first;
+      }
+      return it->second;
+    }
+
+    int x, y;
+    std::string direction, Jchars;
+    std::map<std::string, std::pair<dataType, dataType> > weights;
+};
+
+}
+
+bool findPartitionStrips(const std::string &interactionFile, dataType T,
+                         int rows, dataType Z[4])
+{
+  StripReader reader(interactionFile, T);
+  if (reader.error)
+    return false;
+  const int Lx = reader.Lx, Ly = reader.Ly;
+  if (rows <= 0)
+    rows = Lx;
+
+  std::future<Sample*> ahead = std::async(std::launch::async,
+    [&reader, rows, Ly]() { return reader.next(0, std::min(rows, Ly)); });
+  Sample* first = NULL;                // its N bonds close y
+  FINDmatrix* cylinder[2] = {NULL, NULL}; // x closed with vsep = +1, -1
+  for (int y0 = 0; y0 < Ly; y0 += rows)
+  {
+    const int h = std::min(rows, Ly - y0);
+    Sample* S = ahead.get();
+    if (reader.error)
+    {
+      delete S;
+      break;
+    }
+    if (y0 + h < Ly)
+      ahead = std::async(std::launch::async, [&reader, rows, Ly, y0, h]() {
+        return reader.next(y0 + h, std::min(rows, Ly - y0 - h)); });
+
+    FINDmatrix* plus = new FINDmatrix(Lx, h, 0, 0, S);
+    FINDmatrix* minus = new FINDmatrix(*plus);
+    plus->wrapSides(1);
+    minus->wrapSides(-1);
+    if (first == NULL)
+    {
+      first = S;
+      cylinder[0] = plus;
+      cylinder[1] = minus;
+    }
+    else
+    {
+      cylinder[0] = new FINDmatrix(cylinder[0], plus);
+      cylinder[1] = new FINDmatrix(cylinder[1], minus);
+      delete S;
+    }
+  }
+  // a trailing bond outside the lattice is an error as well
+  if (!reader.error && reader.pending)
+    reader.error = true;
+  if (reader.error)
+  {
+    delete cylinder[0];
+    delete cylinder[1];
+    delete first;
+    return false;
+  }
+
+  FINDmatrix plus(*cylinder[0]), minus(*cylinder[1]);
+  dataType y[4] = {plus.Zcylinder(1), cylinder[0]->Zcylinder(-1),
+                   minus.Zcylinder(1), cylinder[1]->Zcylinder(-1)};
+  combineSectors(reader.prefactor, reader.prec, y, Z);
+  delete cylinder[0];
+  delete cylinder[1];
+  delete first;
+  return true;
+}
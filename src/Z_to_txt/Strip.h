@@ -0,0 +1,30 @@
+// Strip.h
+//
+// Partition functions of long lattices (Ly >> Lx) without holding the
+// whole lattice.  The interaction file lists the spins row by row, so it
+// is read one strip of spin rows at a time: each strip becomes a Sample
+// of its own bonds, is dissected, closed in x with both signs of the
+// wrapping bonds (FINDmatrix::wrapSides) and stacked below the cylinders
+// of the rows above it.  After the last strip the two cylinders are
+// closed in y with both signs, which gives the same four y values as
+// findPartition.  The next strip is read while the current one is
+// dissected.
+//
+// At any time two strips of couplings (the first one is kept for the
+// bonds that close y) and matrices of O(Lx + rows) rows are held, so the
+// memory does not grow with Ly.  The interactions must be E and S bonds
+// with nondecreasing y, as the generator writes them.  Strips of Lx rows
+// (rows = 0) cost about as much per row as the full dissection.
+
+#ifndef STRIP_H
+#define STRIP_H
+
+#include "dataType.h"
+#include <string>
+
+// Z[PP..AA] of the interaction file at temperature T (and its precision);
+// false if the file cannot be read or is not in generator order
+bool findPartitionStrips(const std::string &interactionFile, dataType T,
+                         int rows, dataType Z[4]);
+
+#endif // STRIP_H
@@ -28,6 +28,7 @@
 #include "exp_log.h"
 #include <iostream>
 #include <cstdlib> // for exit()
+#include <algorithm> // for max()
 
 dataType  exp_log::pi("3.1415926535897932384626433832795028841971693993751058209749445923078164062862089986280348253421170679821480865132823066470938446095505822317253594081284811174502841027019385211055596446229489549303819644288109756659334461284756482337867831652712019091456485669234603486104543266482133936072602491412737245870066063155881748815209209628292540917153643678925903600113305305488204665213841469519415116094330572703657595919530921861173819326117931051185480744623799627495673518857527248912279381830119491298336733624406566430860213949463952247371907021798609437027705392171762931767523846748184676694051320005681271452635608277857713427577896091736371787214684409012249534301465495853710507922796892589235420199561121290219608640344181598136297747713099605187072113499999983729780499510597317328160963185950244594553469083026425223082533446850352619311881710100031378387528865875332083814206171776691473035982534904287554687311595628638823537875937519577818577805321712268066130019278766111959092164201989380952572010654858632788659361533818279682303019520353018529689957736225994138912497217752834791315155748572424541506959508295331168617278558890750983817546374649393192550604009277016711390098488240128583616035637076601047101819429555961989467678374494482553797747268471040475346462080466842590694912933136770289891521047521620569660240580381501935112533824300355876402474964732639141992726042699227967823547816360093417216412199245863150302861829745557067498385054945885869269956909272107975093029553211653449872027559602364806654991198818347977535663698074265425278625518184175746728909777727938000816470600161452491921732172147723501414419735685481613611573525521334757418494684385233239073941433345477624168625189835694855620992192221842725502542568876717904946016534668049886272327917860857843838279679766814541009538837863609506800642251252051173929848960841284886269456042419652850222106611863067442786220391949450471237137869609563643719172874677646575739624138908658326459958133904780275901",5120);  // to 2000 digits
 //dataType  exp_log::cutoff("26881171418161354484126255515800135873611118.773741922415191608615280287034909564914158871097219845710811670879190576068697597709761868233548459638929871966089629133626120029380957276534032962269865668016917743514451846065162804442237756762296960284731911402129862281040057911593878790384974173340084912432828126815454426051808828625966509400466909061913524438639583841122043462819154207236890854072607324573056121191956563061586837963987473981118520972596579623700832132946484765326938028548010330841221938884256148024505761068512936611323088094816524174698942447852066586364885647903608017886718884752296369046506574772965737784770742124701455491350397981671399956789869946372196199563429086748183882144256575051854305478968111655024258358000923013493720349842661807049197483416041388719053731440684143813192220471115258836851737585307465440313681612976430832569794563460948174680788271322898526056311817137593447744424308982958463985133222455424311465407701679834598619594591622838745385531521325971233888340981842858179202904184873352541736338696823628360671897209471789305037450068843728126040724464269914428534148661653680570192308869700359343682493378336755358629136792426672394987100275140183146093087554977303109782372762237021270132015807552274641579485116714671562692663681086288731527076512296219519984509365334628597245667862994538497607682112199899784966814823582714526365214247897044461682774881703514784736503229211389158396332048953680861434956162422055093119820899901011293773152282820010161175205494987962524968951399514396958144156360641001071759521595140104980669095670187705170959629892547253198709254955841071746737554998707969478120410286583225510792695745331397899778203721496852646321851422868441359465912620633498367001776249151104088141461436268006246612342593899735170064210298874307794785385220851406971131388655499230608418396182098209489175611283447398533996544917135260269420189006477015409447111927460941414850738156996229655517315820009326496289302981914549740075704",5120);  // e^100 to 2000 digits, 2**(5120/36) approx e^98, so this should be sufficient
@@ -47,6 +48,7 @@ dataType exp_log::exponentiate(dataType x) {
   dataType xn[MAXPOW];
   int bincount[MAXPOW];
   for (int i = 0; i < MAXPOW; ++i) bincount[i] = 0;
+  for (int i = 0; i < MAXPOW; ++i) xn[i].set_prec(x.get_prec());
   xn[0] = 1;
   xn[1] = x;
   int maxpow2 = 1;
@@ -68,13 +70,13 @@ dataType exp_log::exponentiate(dataType x) {
       }
     }
   }
-  dataType fac = 1;
+  dataType fac(1, x.get_prec());
   for (int i = 2; i < MAXPOW; ++i) {
     fac *= i;
 //    std::cout << i << " " << xn[i] << "\n";
     xn[i] /= fac;
   }
-  dataType val = 1;
+  dataType val(1, x.get_prec());
   for (int i = 1; i < MAXPOW; ++i) {
 //    std::cout << i << " " << xn[i] << "\n";
     val += xn[i];
@@ -90,7 +92,7 @@ void exp_log::resquare(dataType &xhalved, int n) {
 dataType exp_log::agm(const dataType &ain, const dataType &bin) {
   dataType a = ain;
   dataType b = bin;
-  dataType at;
+  dataType at(0, a.get_prec());
   for (int i = 0; i < 24; ++i) {
     at = (a+b)/2;
     b = sqrt(a*b);
@@ -103,7 +105,7 @@ dataType exp_log::find_log(const dataType &x) {
   int prec = x.get_prec();
   if (prec > 5120) { std::cerr << "Need to build code with more precision.\n"; exit(-1);}
   int invflag = 0;
-  dataType q; 
+  dataType q(0, prec);
   if (x < 1) {
     invflag = 1;
     q = x;
@@ -116,7 +118,7 @@ dataType exp_log::find_log(const dataType &x) {
     shiftexp = 100;
     q *= icutoff;
   }
-  dataType t2_4, t3_4;
+  dataType t2_4(0, prec), t3_4(0, prec);
 
   dataType two = q * q;
   dataType four = two * two;
@@ -137,7 +139,7 @@ bool exp_log::close(const dataType &a, const dataType &b, int threshold) {
   if (b == 0 || a == 0) return false;  // this must follow the equality check
   if (a < 0 && b > 0) return false;
   if (a > 0 && b < 0) return false;
-  dataType c;
+  dataType c(0, std::max(a.get_prec(), b.get_prec()));
   if (a > b) c = (a-b)/b;
   else c = (b-a)/a;
   dataType l = find_log(c);
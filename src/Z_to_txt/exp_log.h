@@ -54,7 +54,9 @@
 #include "dataType.h"
 
 #define MAXPOW 300 // sets precision of exponential
-// precision of calculations set in global
+// results have the precision of the argument; the constants pi and icutoff
+// are only read after static initialization, so the routines may be called
+// from several threads at once
 
 class exp_log {
     static void halve(dataType x, dataType &xh, int &n);
@@ -64,7 +66,7 @@ class exp_log {
     static dataType pi;
     static dataType icutoff;
     static dataType exp(const dataType &x) {
-      dataType xhalved;
+      dataType xhalved(0, x.get_prec());
       int n;
       halve(x, xhalved, n);
       xhalved = exponentiate(xhalved);
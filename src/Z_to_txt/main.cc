@@ -36,8 +36,14 @@
 #include <iomanip>
 #include "Sample.h"
 #include "FINDmatrix.h"
+#include "Partition.h"
 #include <cstdlib>
 #include "exp_log.h"
+#include "Profile.h"
+#include "ResultCache.h"
+#include "MappedStore.h"
+#include "Marginals.h"
+#include "Strip.h"
 
 void createDirectory(const std::string &path) {
     std::string command = "mkdir -p " + path;
@@ -47,52 +53,71 @@ void createDirectory(const std::string &path) {
     }
 }
 
-void findPartition(Sample &S, const std::string &outputFile, const int precision) {
-  FINDmatrix X(&S);
-
-  FINDmatrix Ypls1(X);
-  FINDmatrix Yneg1(X);
-
-  Ypls1.wrapHorz(1);
-  Yneg1.wrapHorz(-1);
-
-  FINDmatrix Ypls2(Ypls1);
-  FINDmatrix Yneg2(Yneg1);
-
-  dataType y1 = Ypls1.Zvert(1);
-  dataType y2 = Yneg1.Zvert(1);
-  dataType y3 = Ypls2.Zvert(-1);
-  dataType y4 = Yneg2.Zvert(-1);
-
-  dataType prefactor = S.get_Z_prefactor();
-
-  dataType ZPP = abs(prefactor*0.5*( y1+y2+y3+y4));
-  dataType ZPA = abs(prefactor*0.5*(-y1-y2+y3+y4));
-  dataType ZAP = abs(prefactor*0.5*(-y1+y2-y3+y4));
-  dataType ZAA = abs(prefactor*0.5*(-y1+y2+y3-y4));
-
-  std::ofstream outFile(outputFile.c_str());
-
-  // Set precision based on the input precision parameter
-  outFile.precision(int(precision * 0.301)); // Convert bits to decimal digits
-  outFile << std::scientific;               // Use scientific notation
-
-  outFile << ZPP << "\t"
-          << ZPA << "\t"
-          << ZAP << "\t"
-          << ZAA << "\t";
-  outFile.close();
-}
-
 int main(int argc, char* argv[])
 {
+  // optional leading "--cache cacheDirectory" (see ResultCache.h) and
+  // "--scratch directory", "--scratch-min MiB" (see MappedStore.h),
+  // "--target-bits bits" (per-level precision, see Sample.h) and
+  // "--marginals" (bond correlations and marginals, see Marginals.h) and
+  // "--strip rows" (read and solve long lattices strip by strip, see Strip.h)
+  std::string cacheDir, scratchDir;
+  double scratchMin = 256;
+  int targetBits = 0;
+  int stripRows = 0;
+  bool strip = false, marginals = false;
+  while (argc > 2 && std::string(argv[1]).compare(0, 2, "--") == 0)
+  {
+    std::string option = argv[1];
+    if (option == "--marginals")
+    {
+      marginals = true;
+      argv[1] = argv[0];
+      argv++;
+      argc--;
+      continue;
+    }
+    if (option == "--cache")
+      cacheDir = argv[2];
+    else if (option == "--scratch")
+      scratchDir = argv[2];
+    else if (option == "--scratch-min")
+      scratchMin = atof(argv[2]);
+    else if (option == "--target-bits")
+      targetBits = atoi(argv[2]);
+    else if (option == "--strip")
+    {
+      char* end;
+      long rows = strtol(argv[2], &end, 10);
+      if (*end != '\0' || end == argv[2] || rows < 0 || rows > 1000000000)
+      {
+        std::cerr << "Error: --strip needs a number of rows >= 0 (0: Lx rows), not '"
+                  << argv[2] << "'.\n";
+        return 1;
+      }
+      stripRows = int(rows);
+      strip = true;
+    }
+    else
+      break;
+    argv[2] = argv[0];
+    argv += 2;
+    argc -= 2;
+  }
+  if (!scratchDir.empty())
+    MappedStore::configure(scratchDir, size_t(scratchMin*1048576));
   if (argc < 8 || argc > 9)
   {
     std::cout << "FIND2DIsing: computes partition function of 2D Ising model on a square lattice\n";
-    std::cout << "usage: " << argv[0] << " bitsOfPrecision Lx Ly seed probability temperature directory [std dev] \n";
+    std::cout << "usage: " << argv[0] << " [--cache cacheDirectory] [--scratch directory] [--scratch-min MiB] [--target-bits bits] [--marginals] [--strip rows] bitsOfPrecision Lx Ly seed probability temperature directory [std dev] \n";
+    return 1;
+  }
+  if (strip && (!cacheDir.empty() || targetBits > 0 || marginals))
+  {
+    std::cerr << "Error: --strip cannot be combined with --cache, --target-bits or --marginals.\n";
     return 1;
   }
 
+  PROF_START();
   int prec = atoi(argv[1]);
   mpf_set_default_prec(prec);
   std::cout.precision(int(prec*0.301));
@@ -128,8 +153,6 @@ int main(int argc, char* argv[])
                             std::to_string(stddev) + "/" +
                             std::to_string(seed) + "/interaction_lattice.txt";
 
-  Sample S(input, T);
-
   std::string outputDir =   directory + "/resultsGaussian/" +
                             std::to_string(prob) + "/" +
                             std::to_string(stddev) + "/" +
@@ -143,7 +166,66 @@ int main(int argc, char* argv[])
 
   std::string outputFile = outputDir + "/Z.txt";
 
-  findPartition(S, outputFile, prec);
+  ResultCache* cache = NULL;
+  std::string key, cached;
+  int mask = 0;
+  if (!cacheDir.empty())
+  {
+    cache = new ResultCache(cacheDir);
+    if (!cache->good())
+    {
+      std::cerr << "Error: cannot use cache directory " << cacheDir << std::endl;
+      return 1;
+    }
+    key = ResultCache::key(input, T, prec, targetBits, mask);
+  }
+
+  if (strip)
+  {
+    dataType Z[4];
+    if (!findPartitionStrips(input, T, stripRows, Z))
+    {
+      std::cerr << "Error: cannot read " << input << " strip by strip (E and S bonds, rows in order)." << std::endl;
+      return 1;
+    }
+    writePartition(Z, outputFile, prec);
+  }
+  else if (cache != NULL && !marginals && cache->lookup(key, cached))
+  {
+    std::ofstream(outputFile.c_str()) << ResultCache::permute(cached, mask);
+    cache->count(true);
+    std::cout << "cache hit " << key << std::endl;
+  }
+  else
+  {
+    PROF_PHASE(SAMPLE);
+    Sample S(input, T);
+    if (targetBits > 0)
+      S.set_target_bits(targetBits);
+    PROF_PHASE_END(SAMPLE);
+
+    dataType Z[4];
+    if (marginals)
+    {
+      std::vector<dataType> corr[4];
+      findMarginals(S, Z, corr);
+      writeMarginals(S, corr, outputDir + "/marginals.txt", prec);
+    }
+    else
+      findPartition(S, Z);
+    S.printSchedule(std::cout);
+    writePartition(Z, outputFile, prec);
+    if (cache != NULL)
+    {
+      std::ifstream written(outputFile.c_str());
+      std::getline(written, cached, '\0');
+      cache->store(key, ResultCache::permute(cached, mask));
+      cache->count(false);
+      std::cout << "cache miss " << key << std::endl;
+    }
+  }
+  delete cache;
+  PROF_WRITE(outputDir + "/profile.json");
   std::cout << "Z results written to: " << outputDir << std::endl;
   return 0;
 }
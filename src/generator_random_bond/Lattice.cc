@@ -0,0 +1,76 @@
+#include "Lattice.h"
+#include "Philox.h"
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#include <gsl/gsl_randist.h>
+
+void drawVariates(gsl_rng *rng, int Lx, int Ly, bool useGaussian,
+                  double stddev, BondVariates &v) {
+  int n = 2 * Lx * Ly;
+  v.uniform.resize(n);
+  v.noise.resize(useGaussian ? n : 0);
+  for (int b = 0; b < n; b += 2) {
+    if (useGaussian) {
+      v.noise[b] = gsl_ran_gaussian(rng, stddev);
+      v.noise[b + 1] = gsl_ran_gaussian(rng, stddev);
+    }
+    v.uniform[b] = gsl_rng_uniform(rng);
+    v.uniform[b + 1] = gsl_rng_uniform(rng);
+  }
+}
+
+void thresholdCouplings(const BondVariates &v, double prob, std::vector<double> &J) {
+  int n = v.uniform.size();
+  J.resize(n);
+  for (int b = 0; b < n; b++) {
+    if (!v.noise.empty()) {
+      double p = v.noise[b] + prob;
+      p = std::min(std::max(p, 1e-4), 0.5 - 1e-10); // ensures physicality of error probabilities
+      int flip_interaction = (v.uniform[b] < p) ? -1 : 1;
+      J[b] = flip_interaction * 0.5 * std::log((1.0 - p) / p);
+    } else {
+      J[b] = (v.uniform[b] < prob) ? -1 : 1;
+    }
+  }
+}
+
+void drawCouplings(gsl_rng *rng, int Lx, int Ly, double prob, bool useGaussian,
+                   double stddev, std::vector<double> &J) {
+  BondVariates v;
+  drawVariates(rng, Lx, Ly, useGaussian, stddev, v);
+  thresholdCouplings(v, prob, J);
+}
+
+double logLikelihoodRatio(const std::vector<double> &J, double prob,
+                          double drawnProb) {
+  long flips = std::count_if(J.begin(), J.end(), [](double j) { return j < 0; });
+  long unflipped = J.size() - flips;
+  return flips * std::log(prob / drawnProb) +
+         unflipped * std::log((1.0 - prob) / (1.0 - drawnProb));
+}
+
+// Bond b = 2*(j*Lx+i) + (0 for E, 1 for S) uses counter (b, draw) under
+// the key seed: draw 0 for the uniform model and the Gaussian error
+// probability, draw 1 for the flip in the Gaussian model.
+void drawCouplingsPhilox(uint64_t seed, int Lx, int Ly, double prob,
+                         bool useGaussian, double stddev, double *J) {
+  const int n = 2 * Lx * Ly;
+  if (useGaussian) {
+    for (int b = 0; b < n; b++) {
+      double p = prob + stddev * Philox(seed, b, 0).gaussian();
+      p = std::min(std::max(p, 1e-4), 0.5 - 1e-10);
+      double flip = (Philox(seed, b, 1).uniform(0) < p) ? -0.5 : 0.5;
+      J[b] = flip * std::log((1.0 - p) / p);
+    }
+  } else {
+    for (int b = 0; b < n; b++)
+      J[b] = (Philox(seed, b, 0).uniform(0) < prob) ? -1.0 : 1.0;
+  }
+}
+
+std::string formatCoupling(double J) {
+  std::ostringstream out;
+  out << J;
+  return out.str();
+}
@@ -0,0 +1,48 @@
+// Lattice.h
+//
+// Random couplings of an Lx x Ly toric code lattice.  The couplings are
+// returned in the order of interaction_lattice.txt: spins row by row
+// (x fastest), for each spin its E bond followed by its S bond.
+// Uniform model: each coupling is -1 with probability prob and +1
+// otherwise.  Truncated Gaussian model: each bond draws its own error
+// probability from N(prob, stddev^2), clipped to [1e-4, 0.5), and the
+// coupling +-log((1-p)/p)/2 is flipped with that probability.
+// drawCouplings takes the numbers from a sequential GSL stream (the
+// original generator, mt19937 seeded with the lattice seed);
+// drawCouplingsPhilox draws every bond from its own Philox counter, so
+// lattices can be generated in any order and on any number of threads.
+// Neither stream depends on prob: the couplings of one seed at a larger
+// prob flip a superset of the bonds flipped at a smaller one (common
+// random numbers).  drawVariates draws the numbers of drawCouplings once,
+// and thresholdCouplings turns them into the couplings at any prob.
+
+#ifndef LATTICE_H
+#define LATTICE_H
+
+#include <gsl/gsl_rng.h>
+#include <vector>
+#include <string>
+#include <cstdint>
+
+// per bond (order of the couplings) the uniform deciding its flip and,
+// in the Gaussian model, the deviation of its error probability from prob
+struct BondVariates {
+  std::vector<double> uniform, noise;
+};
+
+void drawVariates(gsl_rng *rng, int Lx, int Ly, bool useGaussian,
+                  double stddev, BondVariates &v);
+void thresholdCouplings(const BondVariates &v, double prob, std::vector<double> &J);
+void drawCouplings(gsl_rng *rng, int Lx, int Ly, double prob, bool useGaussian,
+                   double stddev, std::vector<double> &J);
+// ln of the likelihood ratio P_prob(J)/P_drawnProb(J) of uniform-model
+// couplings J drawn at drawnProb, the weight of J in an estimate at prob
+double logLikelihoodRatio(const std::vector<double> &J, double prob,
+                          double drawnProb);
+void drawCouplingsPhilox(uint64_t seed, int Lx, int Ly, double prob,
+                         bool useGaussian, double stddev, double *J);
+// a coupling as written to interaction_lattice.txt: 6 significant digits,
+// the default of std::ostream, so Gaussian couplings are rounded there
+std::string formatCoupling(double J);
+
+#endif // LATTICE_H
@@ -0,0 +1,55 @@
+// Philox.h
+//
+// Philox4x32-10 counter-based random numbers (Salmon et al., "Parallel
+// random numbers: as easy as 1, 2, 3", SC 2011).  The output is a pure
+// function of a 128-bit counter and a 64-bit key, so every coupling can
+// be drawn independently of all others: the key is the lattice seed and
+// the counter holds the bond index and the number of the draw.  Lattices
+// are thereby reproducible whatever the thread or shard they end up in.
+
+#ifndef PHILOX_H
+#define PHILOX_H
+
+#include <cstdint>
+#include <cmath>
+
+struct Philox
+{
+  uint32_t v[4];
+
+  Philox(uint64_t key, uint64_t counter, uint32_t draw)
+  {
+    uint32_t k0 = (uint32_t)key, k1 = (uint32_t)(key >> 32);
+    v[0] = (uint32_t)counter;
+    v[1] = (uint32_t)(counter >> 32);
+    v[2] = draw;
+    v[3] = 0;
+    for (int r = 0; r < 10; r++)
+    {
+      uint64_t p0 = (uint64_t)0xD2511F53 * v[0];
+      uint64_t p1 = (uint64_t)0xCD9E8D57 * v[2];
+      uint32_t w0 = (uint32_t)(p1 >> 32) ^ v[1] ^ k0;
+      uint32_t w2 = (uint32_t)(p0 >> 32) ^ v[3] ^ k1;
+      v[1] = (uint32_t)p1;
+      v[3] = (uint32_t)p0;
+      v[0] = w0;
+      v[2] = w2;
+      k0 += 0x9E3779B9;
+      k1 += 0xBB67AE85;
+    }
+  }
+
+  // two uniform doubles in [0,1) with 53 random bits each
+  double uniform(int i) const
+  {
+    return ((v[2*i] >> 5) * 67108864.0 + (v[2*i+1] >> 6)) * (1.0 / 9007199254740992.0);
+  }
+
+  // standard normal deviate (Box-Muller)
+  double gaussian() const
+  {
+    return std::sqrt(-2.0 * std::log(1.0 - uniform(0))) * std::cos(2 * M_PI * uniform(1));
+  }
+};
+
+#endif // PHILOX_H
@@ -0,0 +1,55 @@
+#include "Shard.h"
+#include <cstring>
+
+ShardWriter::ShardWriter(const std::string &filename, int Lx, int Ly,
+                         int64_t firstSeed, int64_t count, double prob,
+                         double stddev)
+    : n(2 * Lx * Ly) {
+  file = fopen(filename.c_str(), "wb");
+  if (file == NULL)
+    return;
+  setvbuf(file, NULL, _IOFBF, 1 << 22);
+  ShardHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, SHARD_MAGIC, 8);
+  header.Lx = Lx;
+  header.Ly = Ly;
+  header.firstSeed = firstSeed;
+  header.count = count;
+  header.prob = prob;
+  header.stddev = stddev;
+  fwrite(&header, sizeof(header), 1, file);
+}
+
+ShardWriter::~ShardWriter() {
+  if (file != NULL)
+    fclose(file);
+}
+
+bool ShardWriter::good() { return file != NULL && !ferror(file); }
+
+void ShardWriter::write(int64_t seed, const double *J) {
+  fwrite(&seed, sizeof(seed), 1, file);
+  fwrite(J, sizeof(double), n, file);
+}
+
+bool readShard(const std::string &filename, int64_t seed, ShardHeader &header,
+               std::vector<double> &J) {
+  FILE *file = fopen(filename.c_str(), "rb");
+  if (file == NULL)
+    return false;
+  bool ok = fread(&header, sizeof(header), 1, file) == 1 &&
+            memcmp(header.magic, SHARD_MAGIC, 8) == 0 &&
+            seed >= header.firstSeed && seed < header.firstSeed + header.count;
+  if (ok) {
+    long n = 2L * header.Lx * header.Ly;
+    long offset = sizeof(header) + (seed - header.firstSeed) * (8 + 8 * n);
+    int64_t stored;
+    J.resize(n);
+    ok = fseek(file, offset, SEEK_SET) == 0 &&
+         fread(&stored, sizeof(stored), 1, file) == 1 && stored == seed &&
+         fread(J.data(), sizeof(double), n, file) == (size_t)n;
+  }
+  fclose(file);
+  return ok;
+}
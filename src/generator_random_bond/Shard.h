@@ -0,0 +1,47 @@
+// Shard.h
+//
+// Bulk storage of many lattices of one (prob, Lx, Ly, stddev) point in a
+// single binary file, instead of one directory and text file per seed.
+// Layout (native byte order):
+//   ShardHeader
+//   count records of: int64 seed, 2*Lx*Ly doubles in the order of
+//                     interaction_lattice.txt (spins row by row, E then S)
+// Seeds in a shard are consecutive, starting at firstSeed, so a lattice
+// is found by its offset alone.
+
+#ifndef SHARD_H
+#define SHARD_H
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#define SHARD_MAGIC "FKTSHRD1"
+
+struct ShardHeader
+{
+  char magic[8];
+  int32_t Lx, Ly;
+  int64_t firstSeed, count;
+  double prob, stddev;
+};
+
+class ShardWriter
+{
+  public:
+    ShardWriter(const std::string &filename, int Lx, int Ly,
+                int64_t firstSeed, int64_t count, double prob, double stddev);
+    ~ShardWriter();
+    bool good();
+    void write(int64_t seed, const double *J);  // seeds in order
+  private:
+    FILE *file;
+    int n;                             // couplings per lattice
+};
+
+// Couplings of one seed; false if the shard does not hold it.
+bool readShard(const std::string &filename, int64_t seed, ShardHeader &header,
+               std::vector<double> &J);
+
+#endif // SHARD_H
@@ -1,8 +1,12 @@
 #include <cmath>
 #include <fstream>
-#include <gsl/gsl_randist.h>
 #include <gsl/gsl_rng.h>
 #include <iostream>
+#include <cstring>
+#include <thread>
+#include <vector>
+#include "Lattice.h"
+#include "Shard.h"
 
 void createDirectory(const std::string &path) {
   std::string command = "mkdir -p " + path;
@@ -12,10 +16,165 @@ void createDirectory(const std::string &path) {
   }
 }
 
+void writeLattice(const std::string &outputDir, int Lx, int Ly,
+                  const std::vector<double> &J) {
+  std::ofstream outFile(outputDir + "/interaction_lattice.txt");
+  outFile << Lx << " " << Ly << "\n";
+  for (int j = 0; j < Ly; j++) {
+    for (int i = 0; i < Lx; i++) {
+      outFile << i << "\t" << j << "\tE\t" << formatCoupling(J[2 * (j * Lx + i)]) << "\n";
+      outFile << i << "\t" << j << "\tS\t" << formatCoupling(J[2 * (j * Lx + i) + 1]) << "\n";
+    }
+  }
+}
+
+// Ladder mode: the lattices of one seed at several probabilities from a
+// single draw of the random numbers, the same files as one run per
+// probability.  The error sets are nested, so neighbouring points of the
+// ladder are strongly correlated and their differences have a small
+// variance.
+int ladderMain(int argc, char *argv[]) {
+  if (argc < 7 || argc > 8) {
+    std::cout << "Usage: " << argv[0]
+              << " --ladder Lx Ly seed p1,p2,... directory [std deviation]\n";
+    return 1;
+  }
+
+  int Lx = atoi(argv[2]);
+  int Ly = atoi(argv[3]);
+  int seed = atoi(argv[4]);
+  std::vector<double> probs;
+  for (char *p = strtok(argv[5], ","); p != NULL; p = strtok(NULL, ","))
+    probs.push_back(atof(p));
+  std::string directory = argv[6];
+  bool useGaussian = (argc == 8);
+  double stddev = 0.0;
+  if (useGaussian) {
+    stddev = std::atof(argv[7]);
+    if (stddev <= 0) {
+      std::cerr << "Error: Std dev must be positive.\n";
+      return 1;
+    }
+  }
+  if (probs.empty()) {
+    std::cerr << "Error: no probabilities given.\n";
+    return 1;
+  }
+
+  gsl_rng *rng = gsl_rng_alloc(gsl_rng_mt19937);
+  gsl_rng_set(rng, seed);
+  BondVariates v;
+  drawVariates(rng, Lx, Ly, useGaussian, stddev, v);
+  gsl_rng_free(rng);
+
+  std::vector<double> J;
+  for (double prob : probs) {
+    std::string outputDir = directory + "/interactionsGaussian/" + std::to_string(prob) +
+                            "/" + std::to_string(Lx) + "/" + std::to_string(Ly) +
+                            "/" + std::to_string(stddev) + "/" + std::to_string(seed);
+    createDirectory(outputDir);
+    thresholdCouplings(v, prob, J);
+    writeLattice(outputDir, Lx, Ly, J);
+  }
+
+  std::cout << probs.size() << " interaction lattices of seed " << seed
+            << " written to: " << directory << "/interactionsGaussian\n";
+  return 0;
+}
+
+// Bulk mode: lattices of seeds firstSeed..lastSeed from the counter-based
+// generator, split into contiguous seed blocks, one per thread, each
+// written to its own shard file (see Shard.h).
+int philoxMain(int argc, char *argv[]) {
+  if (argc < 9 || argc > 10) {
+    std::cout << "Usage: " << argv[0]
+              << " --philox threads Lx Ly firstSeed lastSeed probability directory [std deviation]\n";
+    return 1;
+  }
+
+  int threads = atoi(argv[2]);
+  int Lx = atoi(argv[3]);
+  int Ly = atoi(argv[4]);
+  long firstSeed = atol(argv[5]);
+  long lastSeed = atol(argv[6]);
+  double prob = atof(argv[7]);
+  std::string directory = argv[8];
+  bool useGaussian = (argc == 10);
+  double stddev = 0.0;
+  if (useGaussian) {
+    stddev = std::atof(argv[9]);
+    if (stddev <= 0) {
+      std::cerr << "Error: Std dev must be positive.\n";
+      return 1;
+    }
+  }
+  long count = lastSeed - firstSeed + 1;
+  if (threads < 1 || count < 1) {
+    std::cerr << "Error: need at least one thread and firstSeed <= lastSeed.\n";
+    return 1;
+  }
+  if (threads > count)
+    threads = count;
+
+  std::string outputDir = directory + "/interactionsShards/" + std::to_string(prob) +
+                          "/" + std::to_string(Lx) + "/" + std::to_string(Ly) +
+                          "/" + std::to_string(stddev);
+  createDirectory(outputDir);
+
+  std::vector<std::thread> pool;
+  std::vector<int> failed(threads, 0);
+  for (int t = 0; t < threads; t++) {
+    pool.emplace_back([&, t]() {
+      long first = firstSeed + count * t / threads;
+      long last = firstSeed + count * (t + 1) / threads - 1;
+      std::string name = outputDir + "/shard_" + std::to_string(first) + "_" +
+                         std::to_string(last) + ".bin";
+      ShardWriter shard(name, Lx, Ly, first, last - first + 1, prob, stddev);
+      std::vector<double> J(2 * Lx * Ly);
+      for (long seed = first; seed <= last && shard.good(); seed++) {
+        drawCouplingsPhilox(seed, Lx, Ly, prob, useGaussian, stddev, J.data());
+        shard.write(seed, J.data());
+      }
+      failed[t] = !shard.good();
+    });
+  }
+  for (std::thread &t : pool)
+    t.join();
+  for (int t = 0; t < threads; t++)
+    if (failed[t]) {
+      std::cerr << "Error writing shards to: " << outputDir << "\n";
+      return 1;
+    }
+
+  std::cout << count << " interaction lattices written in " << threads
+            << " shards to: " << outputDir << "\n";
+  return 0;
+}
+
 int main(int argc, char *argv[]) {
+  if (argc > 1 && strcmp(argv[1], "--philox") == 0)
+    return philoxMain(argc, argv);
+  if (argc > 1 && strcmp(argv[1], "--ladder") == 0)
+    return ladderMain(argc, argv);
+  // importance sampling: flips drawn at bias, weight.txt holds the ln of
+  // the likelihood ratio of the lattice at probability over bias.  The
+  // lattices go to a tree of their own per bias, directory/biased/<bias>,
+  // so that a plain run of the same seed cannot leave a stale weight.
+  bool biased = (argc > 2 && strcmp(argv[1], "--bias") == 0);
+  double bias = 0.0;
+  if (biased) {
+    bias = atof(argv[2]);
+    argv[2] = argv[0];
+    argc -= 2;
+    argv += 2;
+  }
   if (argc < 6 || argc > 7) {
     std::cout << "Usage: " << argv[0]
-              << " Lx Ly seed probability directory [std deviation]\n";
+              << " [--bias drawnProbability] Lx Ly seed probability directory [std deviation]\n";
+    std::cout << "       " << argv[0]
+              << " --philox threads Lx Ly firstSeed lastSeed probability directory [std deviation]\n";
+    std::cout << "       " << argv[0]
+              << " --ladder Lx Ly seed p1,p2,... directory [std deviation]\n";
     return 1;
   }
 
@@ -34,6 +193,11 @@ int main(int argc, char *argv[]) {
     }
   }
 
+  if (biased && (useGaussian || bias <= 0 || bias >= 1)) {
+    std::cerr << "Error: --bias needs the uniform model and 0 < drawnProbability < 1.\n";
+    return 1;
+  }
+
   std::cout << "Generating interactions for:\n";
   std::cout << "   dim x = " << Lx << ", dim y = " << Ly << " , error prob = " << prob;
   if (useGaussian) std::cout << ", noise stddev = " << stddev;
@@ -43,43 +207,24 @@ int main(int argc, char *argv[]) {
   rng = gsl_rng_alloc(gsl_rng_mt19937);
   gsl_rng_set(rng, seed);
 
+  if (biased)
+    directory += "/biased/" + std::to_string(bias);
   std::string outputDir = directory + "/interactionsGaussian/" + std::to_string(prob) +
                           "/" + std::to_string(Lx) + "/" + std::to_string(Ly) +
                           "/" + std::to_string(stddev) + "/" + std::to_string(seed);
 
   createDirectory(outputDir);
 
-  std::ofstream outFile(outputDir + "/interaction_lattice.txt");
-
-  outFile << Lx << " " << Ly << "\n";
-  for (int j = 0; j < Ly; j++) {
-    for (int i = 0; i < Lx; i++) {
-      double valueE, valueS;
-
-      if (useGaussian) {
-        double probE = gsl_ran_gaussian(rng, stddev) + prob;
-        double probS = gsl_ran_gaussian(rng, stddev) + prob;
-
-        probE = std::min(std::max(probE, 1e-4), 0.5 - 1e-10); // ensures physicality of error probabilities
-        probS = std::min(std::max(probS, 1e-4), 0.5 - 1e-10);
-
-        int flip_interactionE = (gsl_rng_uniform(rng) < probE) ? -1 : 1;
-        int flip_interactionS = (gsl_rng_uniform(rng) < probS) ? -1 : 1;
-
-        valueE = flip_interactionE * 0.5 * std::log((1.0 - probE) / probE);
-        valueS = flip_interactionS * 0.5 * std::log((1.0 - probS) / probS);
-      } else {
-        valueE = (gsl_rng_uniform(rng) < prob) ? -1 : 1;
-        valueS = (gsl_rng_uniform(rng) < prob) ? -1 : 1;
-      }
-
-      outFile << i << "\t" << j << "\tE\t" << valueE << "\n";
-      outFile << i << "\t" << j << "\tS\t" << valueS << "\n";
-    }
-  }
-
-  outFile.close();
+  std::vector<double> J;
+  drawCouplings(rng, Lx, Ly, biased ? bias : prob, useGaussian, stddev, J);
+  writeLattice(outputDir, Lx, Ly, J);
   gsl_rng_free(rng);
+  if (biased) {
+    std::ofstream weightFile(outputDir + "/weight.txt");
+    weightFile.precision(17);
+    weightFile << "logWeight\t" << logLikelihoodRatio(J, prob, bias) << "\n"
+               << "drawnProbability\t" << bias << "\n";
+  }
 
   std::cout << "Interaction lattice successfully written to: " << outputDir + "/interaction_lattice.txt" << "\n";
   return 0;
@@ -0,0 +1,181 @@
+// fkt.cc
+//
+// See fkt.h.  A thin layer over Sample and findPartition (and, for a kept
+// sample, Sample::set_bond and FINDmatrix::update): the sample and
+// every intermediate value take their precision from T, so nothing here
+// depends on mpf_set_default_prec.  Errors of the solver are turned into
+// status codes (FINDmatrix::throw_errors), never into exit().
+
+#include "fkt.h"
+#include "../Z_to_txt/Partition.h"
+#include "../Z_to_txt/FINDmatrix.h"
+#include <cmath>
+#include <climits>
+#include <cstring>
+#include <new>
+#include <sstream>
+
+static bool valid(int Lx, int Ly, const double* J, double T, long prec)
+{
+  if (!(Lx >= 1 && Ly >= 1 && long(Lx)*Ly <= INT_MAX/2 && J != NULL &&
+        T > 0 && std::isfinite(T) && prec > 0))
+    return false;
+  for (long k = 0; k < 2*long(Lx)*Ly; k++)
+    if (!std::isfinite(J[k]))          // GMP traps on inf and NaN
+      return false;
+  return true;
+}
+
+// status of f(), with the errors of the solver as codes
+template <class F> static int guarded(F f)
+{
+  FINDmatrix::throw_errors();
+  try
+  {
+    return f();
+  }
+  catch (const FINDerror &)
+  {
+    return FKT_ESINGULAR;
+  }
+  catch (const std::bad_alloc &)
+  {
+    return FKT_ENOMEM;
+  }
+}
+
+static void partition(int Lx, int Ly, const double* J, double T, long prec,
+                      dataType Z[4])
+{
+  Sample S(Lx, Ly, J, dataType(T, prec));
+  findPartition(S, Z);
+}
+
+static void logs(const dataType Z[4], double logZ[4])
+{
+  for (int k = PP; k <= AA; k++)
+  {
+    if (Z[k] == 0)
+    {
+      logZ[k] = -INFINITY;
+      continue;
+    }
+    long e;
+    double m = mpf_get_d_2exp(&e, Z[k].get_mpf_t());
+    logZ[k] = std::log(m) + e * M_LN2;
+  }
+}
+
+static int print(const dataType Z[4], long prec, int digits, char* buf,
+                 size_t len)
+{
+  std::ostringstream out;
+  out.precision(digits > 0 ? digits : int(prec * 0.301));
+  out << std::scientific;
+  out << Z[PP] << "\t" << Z[PA] << "\t" << Z[AP] << "\t" << Z[AA];
+  const std::string s = out.str();
+  if (s.size() >= len)
+    return FKT_ERANGE;
+  memcpy(buf, s.c_str(), s.size()+1);
+  return FKT_OK;
+}
+
+int fkt_log_partition(int Lx, int Ly, const double* J, double T, long prec,
+                      double logZ[4])
+{
+  if (!valid(Lx, Ly, J, T, prec) || logZ == NULL)
+    return FKT_EINVAL;
+  return guarded([&]() {
+    dataType Z[4];
+    partition(Lx, Ly, J, T, prec, Z);
+    logs(Z, logZ);
+    return FKT_OK;
+  });
+}
+
+int fkt_partition(int Lx, int Ly, const double* J, double T, long prec,
+                  int digits, char* buf, size_t len)
+{
+  if (!valid(Lx, Ly, J, T, prec) || buf == NULL)
+    return FKT_EINVAL;
+  return guarded([&]() {
+    dataType Z[4];
+    partition(Lx, Ly, J, T, prec, Z);
+    return print(Z, prec, digits, buf, len);
+  });
+}
+
+// the sample and its dissection tree, kept for update(); broken after a
+// failed update, which leaves the tree half recombined
+struct fkt_sample
+{
+  fkt_sample(int Lx, int Ly, const double* J, double _T, long prec)
+  : T(_T, prec), S(Lx, Ly, J, T), X(&S, true), broken(false) {}
+  dataType T;
+  Sample S;
+  FINDmatrix X;
+  bool broken;
+};
+
+int fkt_sample_new(int Lx, int Ly, const double* J, double T, long prec,
+                   fkt_sample** s)
+{
+  if (s == NULL)
+    return FKT_EINVAL;
+  *s = NULL;
+  if (!valid(Lx, Ly, J, T, prec))
+    return FKT_EINVAL;
+  return guarded([&]() {
+    *s = new fkt_sample(Lx, Ly, J, T, prec);
+    return FKT_OK;
+  });
+}
+
+int fkt_sample_set(fkt_sample* s, int x, int y, char dir, double J)
+{
+  if (s == NULL || x < 0 || x >= s->S.get_Lx() || y < 0 ||
+      y >= s->S.get_Ly() || (dir != 'E' && dir != 'S') || !std::isfinite(J))
+    return FKT_EINVAL;
+  if (s->broken)
+    return FKT_ESINGULAR;
+  int status = guarded([&]() {
+    Dir d = (dir == 'E') ? E : S;
+    s->S.set_bond(x, y, d, dataType(J, s->T.get_prec()), s->T);
+    s->X.update(x, y, d);
+    return FKT_OK;
+  });
+  s->broken = (status != FKT_OK);
+  return status;
+}
+
+int fkt_sample_log_partition(fkt_sample* s, double logZ[4])
+{
+  if (s == NULL || logZ == NULL)
+    return FKT_EINVAL;
+  if (s->broken)
+    return FKT_ESINGULAR;
+  return guarded([&]() {
+    dataType Z[4];
+    findPartition(s->S, s->X, Z);
+    logs(Z, logZ);
+    return FKT_OK;
+  });
+}
+
+int fkt_sample_partition(fkt_sample* s, int digits, char* buf, size_t len)
+{
+  if (s == NULL || buf == NULL)
+    return FKT_EINVAL;
+  if (s->broken)
+    return FKT_ESINGULAR;
+  return guarded([&]() {
+    dataType Z[4];
+    findPartition(s->S, s->X, Z);
+    return print(Z, s->T.get_prec(), digits, buf, len);
+  });
+}
+
+void fkt_sample_free(fkt_sample* s)
+{
+  delete s;
+}
@@ -0,0 +1,71 @@
+/* fkt.h
+ *
+ * C interface of libfkt: the four sector partition functions of one
+ * sample, computed in process without interaction or result files.
+ *
+ * Couplings are passed as 2*Lx*Ly doubles in the order written by
+ * isingGeneratorRandomBond: spins row by row (x fastest), for each spin
+ * its E bond, then its S bond.  T is the temperature in units of the
+ * couplings (not of the Nishimori temperature), prec the number of bits
+ * of the mantissas.  Sectors are in the order of Z.txt: PP, PA, AP, AA.
+ *
+ * The calls share no mutable state and each runs at its own precision
+ * (the process-wide GMP default precision is neither read nor changed),
+ * so they may run concurrently from several threads.  Failures are
+ * returned as status codes; the library never ends the process.
+ */
+
+#ifndef FKT_H
+#define FKT_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define FKT_OK      0
+#define FKT_EINVAL  1                  /* invalid size, couplings, T or
+                                          precision */
+#define FKT_ERANGE  2                  /* output buffer too small */
+#define FKT_ESINGULAR 3                /* zero pivot in the elimination */
+#define FKT_ENOMEM  4                  /* out of memory */
+
+/* Natural logarithms of ZPP, ZPA, ZAP, ZAA (-inf for a vanishing sector).
+ * Only the logarithms are rounded to double, so they are accurate far
+ * beyond the range of doubles for Z itself. */
+int fkt_log_partition(int Lx, int Ly, const double* J, double T, long prec,
+                      double logZ[4]);
+
+/* The four values as in Z.txt: tab separated, scientific notation with
+ * digits significant digits (digits <= 0: prec*0.301 as isingZToTxt).
+ * len is the size of buf including the terminating zero. */
+int fkt_partition(int Lx, int Ly, const double* J, double T, long prec,
+                  int digits, char* buf, size_t len);
+
+/* A sample kept between calls, for chains that change one coupling at a
+ * time (e.g. Monte Carlo over the disorder).  The dissection tree is kept,
+ * so fkt_sample_set recomputes only the nodes whose separator the bond
+ * crosses and their ancestors (FINDmatrix::update) instead of the whole
+ * lattice.  A handle must not be used by two threads at once. */
+typedef struct fkt_sample fkt_sample;
+
+/* *s is NULL unless FKT_OK is returned */
+int fkt_sample_new(int Lx, int Ly, const double* J, double T, long prec,
+                   fkt_sample** s);
+
+/* coupling of the bond dir ('E' or 'S') of spin (x, y); after an error
+ * other than FKT_EINVAL the handle can only be freed */
+int fkt_sample_set(fkt_sample* s, int x, int y, char dir, double J);
+
+/* as fkt_log_partition and fkt_partition for the current couplings */
+int fkt_sample_log_partition(fkt_sample* s, double logZ[4]);
+int fkt_sample_partition(fkt_sample* s, int digits, char* buf, size_t len);
+
+void fkt_sample_free(fkt_sample* s);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FKT_H */
@@ -0,0 +1,142 @@
+"""Python bindings of libfkt (see fkt.h).
+
+Couplings are a float64 array of shape (Ly, Lx, 2): J[y, x, 0] is the E
+bond and J[y, x, 1] the S bond of spin (x, y), which is the memory layout
+the library reads, so C-contiguous float64 arrays are passed without a
+copy.  T is in units of the couplings; sectors are ordered PP, PA, AP, AA.
+
+ctypes releases the GIL during the calls, and the library is reentrant,
+so samples can be evaluated in parallel with threads (log_partition_many).
+A Sample keeps one lattice in the library for chains of single coupling
+changes.
+
+The library is loaded from $FKT_LIBRARY or build/libfkt/libfkt.so.
+"""
+
+import ctypes
+import os
+from concurrent.futures import ThreadPoolExecutor
+
+import mpmath
+import numpy as np
+
+_default = os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                        "..", "..", "build", "libfkt", "libfkt.so")
+_lib = ctypes.CDLL(os.environ.get("FKT_LIBRARY", _default))
+
+_couplings = np.ctypeslib.ndpointer(np.float64, ndim=3, flags="C_CONTIGUOUS")
+_lib.fkt_log_partition.argtypes = [
+    ctypes.c_int, ctypes.c_int, _couplings, ctypes.c_double, ctypes.c_long,
+    np.ctypeslib.ndpointer(np.float64, shape=(4,), flags="C_CONTIGUOUS")]
+_lib.fkt_log_partition.restype = ctypes.c_int
+_lib.fkt_partition.argtypes = [
+    ctypes.c_int, ctypes.c_int, _couplings, ctypes.c_double, ctypes.c_long,
+    ctypes.c_int, ctypes.c_char_p, ctypes.c_size_t]
+_lib.fkt_partition.restype = ctypes.c_int
+
+_lib.fkt_sample_new.argtypes = [
+    ctypes.c_int, ctypes.c_int, _couplings, ctypes.c_double, ctypes.c_long,
+    ctypes.POINTER(ctypes.c_void_p)]
+_lib.fkt_sample_new.restype = ctypes.c_int
+_lib.fkt_sample_set.argtypes = [
+    ctypes.c_void_p, ctypes.c_int, ctypes.c_int, ctypes.c_char,
+    ctypes.c_double]
+_lib.fkt_sample_set.restype = ctypes.c_int
+_lib.fkt_sample_log_partition.argtypes = [
+    ctypes.c_void_p,
+    np.ctypeslib.ndpointer(np.float64, shape=(4,), flags="C_CONTIGUOUS")]
+_lib.fkt_sample_log_partition.restype = ctypes.c_int
+_lib.fkt_sample_partition.argtypes = [
+    ctypes.c_void_p, ctypes.c_int, ctypes.c_char_p, ctypes.c_size_t]
+_lib.fkt_sample_partition.restype = ctypes.c_int
+_lib.fkt_sample_free.argtypes = [ctypes.c_void_p]
+_lib.fkt_sample_free.restype = None
+
+_errors = {1: "invalid lattice size, couplings, temperature or precision",
+           2: "output buffer too small",
+           3: "zero pivot in the elimination",
+           4: "out of memory"}
+
+
+class SolverError(ArithmeticError):
+    """The elimination met a zero pivot."""
+
+
+def _check(status):
+    if status == 3:
+        raise SolverError(_errors[3])
+    if status == 4:
+        raise MemoryError(_errors[4])
+    if status != 0:
+        raise ValueError(_errors.get(status, "libfkt error %d" % status))
+
+
+def _as_couplings(J):
+    J = np.ascontiguousarray(J, dtype=np.float64)   # no copy if already so
+    if J.ndim != 3 or J.shape[2] != 2:
+        raise ValueError("couplings must have shape (Ly, Lx, 2)")
+    return J
+
+
+def log_partition(J, T, prec=512):
+    """Natural logarithms of the four sector partition functions."""
+    J = _as_couplings(J)
+    logZ = np.empty(4)
+    _check(_lib.fkt_log_partition(J.shape[1], J.shape[0], J, T, prec, logZ))
+    return logZ
+
+
+def partition(J, T, prec=512):
+    """The four sector partition functions as mpmath numbers of prec bits."""
+    J = _as_couplings(J)
+    digits = int(prec * 0.301)
+    buf = ctypes.create_string_buffer(4 * (digits + 16))
+    _check(_lib.fkt_partition(J.shape[1], J.shape[0], J, T, prec, digits,
+                              buf, len(buf)))
+    with mpmath.workprec(prec):
+        return [mpmath.mpf(z) for z in buf.value.decode().split("\t")]
+
+
+def log_partition_many(Js, T, prec=512, threads=None):
+    """log_partition of every sample in Js, evaluated by a thread pool."""
+    with ThreadPoolExecutor(max_workers=threads) as pool:
+        return np.array(list(pool.map(lambda J: log_partition(J, T, prec), Js)))
+
+
+class Sample:
+    """One sample kept in the library: set() changes a single coupling and
+    recomputes only the dissection nodes that use it, so chains of single
+    bond changes cost far less than a log_partition per step."""
+
+    def __init__(self, J, T, prec=512):
+        J = _as_couplings(J)
+        self.prec = prec
+        self._handle = None
+        handle = ctypes.c_void_p()
+        _check(_lib.fkt_sample_new(J.shape[1], J.shape[0], J, T, prec,
+                                   ctypes.byref(handle)))
+        self._handle = handle.value
+
+    def set(self, x, y, direction, J):
+        """Coupling of the bond direction ('E' or 'S') of spin (x, y)."""
+        _check(_lib.fkt_sample_set(self._handle, x, y, direction.encode(), J))
+
+    def log_partition(self):
+        logZ = np.empty(4)
+        _check(_lib.fkt_sample_log_partition(self._handle, logZ))
+        return logZ
+
+    def partition(self):
+        digits = int(self.prec * 0.301)
+        buf = ctypes.create_string_buffer(4 * (digits + 16))
+        _check(_lib.fkt_sample_partition(self._handle, digits, buf, len(buf)))
+        with mpmath.workprec(self.prec):
+            return [mpmath.mpf(z) for z in buf.value.decode().split("\t")]
+
+    def close(self):
+        if self._handle:
+            _lib.fkt_sample_free(self._handle)
+            self._handle = None
+
+    def __del__(self):
+        self.close()
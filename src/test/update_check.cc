@@ -0,0 +1,76 @@
+// update_check.cc
+//
+// Incremental updates of a kept dissection (Sample::set_bond and
+// FINDmatrix::update) against a fresh dissection of the same couplings
+// after every change.  Bonds inside the lattice, on the separators of
+// several levels and on the wrapping boundary are changed, to values of
+// both signs.  Exits 1 on the first mismatch.
+
+#include "../Z_to_txt/Partition.h"
+#include <iostream>
+#include <fstream>
+#include <cstdio>
+
+static unsigned long state = 42;
+
+static double uniform()                // deterministic, no libc rand()
+{
+  state = state * 6364136223846793005UL + 1442695040888963407UL;
+  return (state >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static bool check(int Lx, int Ly, double T_value, long prec, int steps)
+{
+  mpf_set_default_prec(prec);
+  const char* file = "update_check_lattice.txt";
+  {
+    std::ofstream out(file);
+    out << Lx << " " << Ly << "\n";
+    for (int y = 0; y < Ly; y++)
+      for (int x = 0; x < Lx; x++)
+      {
+        out << x << " " << y << " E " << ((uniform() < 0.2) ? -1 : 1) << "\n";
+        out << x << " " << y << " S " << ((uniform() < 0.2) ? -1 : 1) << "\n";
+      }
+  }
+  dataType T(T_value, prec);
+  Sample sample(file, T);
+  std::remove(file);
+  FINDmatrix X(&sample, true);
+
+  dataType tol(1, prec);               // relative, 64 bits of guard
+  mpf_div_2exp(tol.get_mpf_t(), tol.get_mpf_t(), prec - 64);
+  for (int step = 0; step < steps; step++)
+  {
+    int x = int(uniform() * Lx), y = int(uniform() * Ly);
+    Dir d = (uniform() < 0.5) ? E : S;
+    if (step % 5 == 0)                 // a bond that wraps around
+    {
+      x = Lx - 1;
+      d = E;
+    }
+    dataType J((uniform() - 0.3) * 2, prec);
+    sample.set_bond(x, y, d, J, T);
+    X.update(x, y, d);
+
+    dataType inc[4], fresh[4];
+    findPartition(sample, X, inc);
+    findPartition(sample, fresh);
+    for (int k = PP; k <= AA; k++)
+      if (abs(inc[k] - fresh[k]) > tol * abs(fresh[k]))
+      {
+        std::cerr << Lx << "x" << Ly << " step " << step << " sector " << k
+                  << ": " << inc[k] << " (update) != " << fresh[k] << "\n";
+        return false;
+      }
+  }
+  return true;
+}
+
+int main()
+{
+  if (!check(5, 5, 1.0, 256, 40) || !check(8, 7, 0.6, 512, 60) ||
+      !check(7, 3, 2.0, 128, 30))
+    return 1;
+  return 0;
+}